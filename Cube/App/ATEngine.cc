@@ -0,0 +1,178 @@
+#include "ATEngine.hh"
+
+#include <string.h>
+
+static bool startsWith(const char *line, const char *prefix) {
+  return strncmp(line, prefix, strlen(prefix)) == 0;
+}
+
+/* prefix may list alternatives separated by '|', e.g. "+CBC:|+CREG:" */
+static bool matchesPrefix(const char *line, const char *prefix) {
+  while (true) {
+    const char *end = strchr(prefix, '|');
+    size_t length = end ? (size_t)(end - prefix) : strlen(prefix);
+    if (strncmp(line, prefix, length) == 0) return true;
+    if (!end) return false;
+    prefix = end + 1;
+  }
+}
+
+ATEngine::ATEngine(Sender sender, void *context)
+  : sender(sender), senderContext(context)
+{
+  active = false;
+  sentAt = 0;
+  response[0] = '\0';
+  responseLength = 0;
+  urc = 0;
+  unsolicitedHandler = 0;
+  unsolicitedContext = 0;
+}
+
+bool ATEngine::submit(const char *cmd, const char *prefix, uint32_t timeoutMs,
+                      Callback callback, void *context, const char *final)
+{
+  uint16_t n;
+  Command *slot = queue.reserve(n);
+  if (n == 0) return false;
+
+  int length = strlen(cmd);
+  if (length + 5 > kCommandSize) return false;
+
+  memcpy(slot->text, "AT", 2);
+  memcpy(slot->text + 2, cmd, length);
+  memcpy(slot->text + 2 + length, "\r\n", 3);
+  slot->prefix = prefix;
+  slot->final = final;
+  slot->timeoutMs = timeoutMs;
+  slot->callback = callback;
+  slot->context = context;
+  queue.commit(1);
+  return true;
+}
+
+const ATEngine::Command * ATEngine::current() const {
+  uint16_t n;
+  const Command *cmd = queue.peek(n);
+  return (n > 0) ? cmd : 0;
+}
+
+void ATEngine::sendNext(uint32_t now) {
+  if (active) return;
+
+  const Command *cmd = current();
+  if (!cmd) return;
+
+  response[0] = '\0';
+  responseLength = 0;
+  active = true;
+  sentAt = now;
+  sender(senderContext, cmd->text);
+}
+
+void ATEngine::complete(Result result, uint32_t now) {
+  const Command *cmd = current();
+  Callback callback = cmd->callback;
+  void *context = cmd->context;
+
+  active = false;
+  queue.consume(1);
+
+  if (callback) {
+    callback(context, result, response);
+  }
+
+  // Pipeline: the next command goes out right away
+  sendNext(now);
+}
+
+void ATEngine::appendResponse(const char *line) {
+  uint16_t length = strlen(line);
+  uint16_t needed = length + ((responseLength > 0) ? 1 : 0);
+  if (responseLength + needed >= kResponseSize) return;
+
+  if (responseLength > 0) {
+    response[responseLength++] = '\n';
+  }
+  memcpy(response + responseLength, line, length + 1);
+  responseLength += length;
+}
+
+void ATEngine::onLine(const char *line, uint32_t now) {
+  if (line[0] == '\0') return;
+
+  URCType type = URCDispatcher::classify(line);
+
+  if (active) {
+    const Command *cmd = current();
+
+    if (startsWith(line, "AT")) {
+      // command echo
+      return;
+    }
+    if (strcmp(line, "OK") == 0) {
+      complete(kOK, now);
+      return;
+    }
+    if (strcmp(line, "ERROR") == 0) {
+      complete(kError, now);
+      return;
+    }
+    if (startsWith(line, "+CME ERROR") || startsWith(line, "+CMS ERROR")) {
+      appendResponse(line);
+      complete(kCMEError, now);
+      return;
+    }
+    if (cmd->final && startsWith(line, cmd->final)) {
+      appendResponse(line);
+      complete(kOK, now);
+      return;
+    }
+    if (cmd->prefix != 0 && matchesPrefix(line, cmd->prefix)) {
+      appendResponse(line);
+      return;
+    }
+    if (cmd->prefix == 0 && type == kURCNone) {
+      appendResponse(line);
+      return;
+    }
+  }
+
+  if (type != kURCNone && urc) {
+    if (urc->dispatch(type, line)) return;
+  }
+  if (unsolicitedHandler) {
+    unsolicitedHandler(unsolicitedContext, line);
+  }
+}
+
+void ATEngine::poll(uint32_t now) {
+  if (active) {
+    const Command *cmd = current();
+    if (now - sentAt >= cmd->timeoutMs) {
+      complete(kTimeout, now);
+    }
+  }
+  sendNext(now);
+}
+
+bool ATEngine::idle() const {
+  return !active && queue.empty();
+}
+
+uint32_t ATEngine::timeUntilDeadline(uint32_t now) const {
+  if (!active) return UINT32_MAX;
+
+  uint32_t elapsed = now - sentAt;
+  uint32_t timeout = current()->timeoutMs;
+  return (elapsed >= timeout) ? 0 : (timeout - elapsed);
+}
+
+void ATEngine::setURCDispatcher(URCDispatcher *dispatcher) {
+  urc = dispatcher;
+}
+
+void ATEngine::setUnsolicitedHandler(LineHandler handler, void *context) {
+  unsolicitedHandler = handler;
+  unsolicitedContext = context;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "Ring.hh"
+#include "URC.hh"
+
+/**
+ * Asynchronous AT command engine.
+ *
+ * Commands are queued with their own timeout and expected intermediate
+ * response prefix, and are sent back-to-back: the next one goes out as
+ * soon as the previous reaches its final result (OK, ERROR, +CME ERROR or
+ * a command specific final line). Completion is reported via callback.
+ * The engine owns no thread and no clock; the caller feeds it received
+ * lines and the current time in milliseconds.
+ *
+ * Known unsolicited result codes are routed to the URC dispatcher unless
+ * the command in flight explicitly expects that prefix, so a URC arriving
+ * in the middle of a response does not corrupt it.
+ */
+class ATEngine {
+public:
+  enum Result {
+    kOK         = 0,
+    kError      = 1,
+    kCMEError   = 2,    // +CME ERROR / +CMS ERROR, see response for the code
+    kTimeout    = 3
+  };
+
+  typedef void (*Callback)(void *context, Result result, const char *response);
+  typedef void (*LineHandler)(void *context, const char *line);
+
+  /// Writes command text to the modem: the GSM UART on the target, a
+  /// scripted fake modem on a host
+  typedef void (*Sender)(void *context, const char *data);
+
+  static const uint8_t  kQueueSize    = 8;
+  static const uint16_t kCommandSize  = 64;
+  static const uint16_t kResponseSize = 200;
+
+  ATEngine(Sender sender, void *context);
+
+  /**
+   * Queue a command (text after "AT"), returns false if the queue is full.
+   * Intermediate lines starting with prefix (any line if prefix is 0) are
+   * collected into the response, separated by '\n'. For concatenated
+   * commands ("+CBC;+CREG?") prefix may list alternatives separated by '|'.
+   * If final is given, a line starting with it completes the command with kOK.
+   */
+  bool submit(const char *cmd, const char *prefix, uint32_t timeoutMs,
+              Callback callback = 0, void *context = 0, const char *final = 0);
+
+  /// Handle one received line (without CR/LF)
+  void onLine(const char *line, uint32_t now);
+
+  /// Expire timed out commands and send the next queued one
+  void poll(uint32_t now);
+
+  /// True if no command is queued or in flight
+  bool idle() const;
+
+  /// Milliseconds until the command in flight times out (UINT32_MAX if none)
+  uint32_t timeUntilDeadline(uint32_t now) const;
+
+  /// Recognized unsolicited result codes go here
+  void setURCDispatcher(URCDispatcher *dispatcher);
+
+  /// Other lines that do not belong to the command in flight go here
+  void setUnsolicitedHandler(LineHandler handler, void *context);
+
+private:
+  struct Command {
+    char        text[kCommandSize];
+    const char *prefix;
+    const char *final;
+    uint32_t    timeoutMs;
+    Callback    callback;
+    void       *context;
+  };
+
+  Sender      sender;
+  void       *senderContext;
+  SPSCRing<Command, kQueueSize> queue;
+
+  bool        active;         // queue head has been sent
+  uint32_t    sentAt;
+  char        response[kResponseSize];
+  uint16_t    responseLength;
+
+  URCDispatcher *urc;
+  LineHandler unsolicitedHandler;
+  void       *unsolicitedContext;
+
+  const Command * current() const;
+  void sendNext(uint32_t now);
+  void complete(Result result, uint32_t now);
+  void appendResponse(const char *line);
+};
@@ -0,0 +1,99 @@
+#include "Console.hh"
+#include "SDBench.hh"
+
+#include <stdlib.h>
+#include <string.h>
+
+extern "C" {
+  #include "FreeRTOS.h"
+  #include "cmsis_os.h"
+  #include "task.h"
+  #include "usbd_cdc_if.h"
+  #include "usb_device.h"
+}
+
+#include "Ring.hh"
+
+#define RX_FIFO_SIZE      128
+#define TX_TIMEOUT_MS     100
+
+static SPSCRing<uint8_t, RX_FIFO_SIZE> rxRing;
+static TaskHandle_t rxWaiter;
+
+void Console_Receive(const uint8_t *data, uint32_t length) {
+  rxRing.push(data, length);      // overflow drops the excess
+
+  TaskHandle_t waiter = rxWaiter;
+  if (waiter == NULL) return;
+  rxWaiter = NULL;
+
+  BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+  vTaskNotifyGiveFromISR(waiter, &xHigherPriorityTaskWoken);
+  portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+void Console::print(const char *text) {
+  // CDC_Transmit_FS does not copy, keep the buffer until the transfer is done
+  static char buffer[128];
+  uint16_t length = strlen(text);
+  if (length > sizeof(buffer)) length = sizeof(buffer);
+
+  USBD_CDC_HandleTypeDef *hcdc = (USBD_CDC_HandleTypeDef *)hUsbDeviceFS.pClassData;
+  if (hcdc == NULL) return;         // not enumerated yet
+
+  uint32_t waited = 0;
+  while (hcdc->TxState != 0) {
+    if (waited++ >= TX_TIMEOUT_MS) return;    // no host listening
+    vTaskDelay(1);
+  }
+  memcpy(buffer, text, length);
+  CDC_Transmit_FS((uint8_t *)buffer, length);
+}
+
+int Console::readLine(char *line, int maxSize) {
+  int length = 0;
+  while (true) {
+    uint8_t c;
+    if (!rxRing.pop(c)) {
+      ulTaskNotifyTake(pdTRUE, 0);
+      rxWaiter = xTaskGetCurrentTaskHandle();
+      if (rxRing.empty()) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      }
+      rxWaiter = NULL;
+      continue;
+    }
+    if (c == '\r' || c == '\n') {
+      if (length == 0) continue;      // skip the other half of CRLF
+      line[length] = 0;
+      return length;
+    }
+    if (length < maxSize - 1) line[length++] = c;
+  }
+}
+
+void Console_Task(void const * argument) {
+  char line[64];
+
+  for (;;) {
+    Console::readLine(line, sizeof(line));
+
+    if (strncmp(line, "sdbench", 7) == 0) {
+      uint32_t sectors = strtoul(line + 7, NULL, 10);
+      SDBench::run(sectors ? sectors : SDBench::kDefaultSectors, Console::print);
+    }
+    else if (strncmp(line, "sdlog", 5) == 0) {
+      uint32_t kilobytes = strtoul(line + 5, NULL, 10);
+      SDBench::runLog(kilobytes ? kilobytes : SDBench::kDefaultLogKB, Console::print);
+    }
+    else if (strcmp(line, "sdwait") == 0) {
+      SDBench::printWaitStats(Console::print);
+    }
+    else if (strcmp(line, "sdcache") == 0) {
+      SDBench::printCacheStats(Console::print);
+    }
+    else {
+      Console::print("Commands: sdbench [sectors], sdlog [KB], sdwait, sdcache\r\n");
+    }
+  }
+}
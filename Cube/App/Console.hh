@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+
+#if defined (__cplusplus)
+extern "C" {
+#endif
+
+void Console_Task(void const * argument);
+
+/* Bytes received on the USB CDC port (called from the USB interrupt) */
+void Console_Receive(const uint8_t *data, uint32_t length);
+
+#if defined (__cplusplus)
+}
+#endif
+
+#if defined (__cplusplus)
+
+/**
+ * Line based command console on the USB CDC port.
+ *
+ *   sdbench [sectors]   SD card sector throughput, see SDBench.hh
+ *   sdlog [KB]          LogFile append latency, see SDBench.hh
+ *   sdwait              SD card wait histograms since the last sdbench
+ *   sdcache             Sector cache hits, misses and write-backs since the last sdlog
+ */
+class Console {
+public:
+  /// Send a string, waiting while the previous USB transfer is in flight
+  static void print(const char *text);
+
+  /// Block until a line arrives, returns its length without the line end
+  static int readLine(char *line, int maxSize);
+};
+
+#endif
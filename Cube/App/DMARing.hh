@@ -0,0 +1,148 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Receive ring filled by a circular DMA channel.
+ *
+ * The DMA controller owns the write side and only reports its position
+ * (buffer size minus the remaining transfer count). The interrupt handler
+ * commits that position once per burst (IDLE line, half/full transfer),
+ * and the consumer only sees committed data, so it always gets whole
+ * chunks. Free of HAL dependencies so the ring logic can run on a host.
+ *
+ * Both sides are tracked as running byte totals rather than positions,
+ * so a DMA that laps the consumer is not mistaken for a short burst. The
+ * position alone cannot tell a full lap from nothing, so the half/full
+ * transfer events are counted too: each one proves the DMA has passed
+ * another half of the buffer. Once the DMA is a whole buffer ahead of the
+ * consumer, its next byte lands on unread data while the consumer may be
+ * reading it, so exactly a full buffer already counts as an overrun and
+ * the consumer skips to the newest data.
+ */
+template<uint16_t size>
+class DMARxRing {
+  static_assert((size & (size - 1)) == 0, "size must be a power of two");
+
+public:
+  DMARxRing() {
+    reset();
+  }
+
+  void reset() {
+    written = consumed = 0;
+    halves = 0;
+    overruns = 0;
+    lost = false;
+  }
+
+  /// DMA target memory
+  uint8_t * data() {
+    return buffer;
+  }
+
+  uint16_t capacity() const {
+    return size;
+  }
+
+  /**
+   * Publish the DMA write position (call from ISR), returns the previous
+   * write total. Set boundary when called for a half/full transfer event.
+   */
+  uint32_t commit(uint16_t writePos, bool boundary) {
+    uint32_t last = written;
+    if (writePos >= size) writePos = 0;
+    uint32_t total = last + ((writePos - last) & (size - 1));
+
+    if (boundary) {
+      uint32_t passed = ++halves * (size / 2);
+      while ((int32_t)(total - passed) < 0) total += size;
+    }
+
+    // Count each overrun once, on the commit that gets a buffer ahead
+    uint32_t reader = consumed;
+    if (total - reader >= size && last - reader < size) overruns++;
+    written = total;
+    return last;
+  }
+
+  /// Total number of bytes committed so far
+  uint32_t committed() const {
+    return written;
+  }
+
+  /// Check whether committed data from write total 'from' on contains value
+  bool contains(uint32_t from, uint8_t value) const {
+    uint32_t w = written;
+    if (w - from > size) from = w - size;
+    for (; from != w; from++) {
+      if (buffer[from & (size - 1)] == value) return true;
+    }
+    return false;
+  }
+
+  /// Number of committed bytes not yet read
+  uint16_t available() {
+    return sync();
+  }
+
+  bool empty() {
+    return sync() == 0;
+  }
+
+  /// Read a single byte, returns false if nothing was committed
+  bool pop(uint8_t &b) {
+    if (sync() == 0) return false;
+    b = buffer[consumed & (size - 1)];
+    consumed++;
+    return true;
+  }
+
+  /// Read up to maxSize committed bytes, returns number of bytes copied
+  uint16_t read(uint8_t *dst, uint16_t maxSize) {
+    uint16_t nRead = 0;
+    uint16_t n;
+    while (nRead < maxSize && (n = sync()) > 0) {
+      uint16_t tail = consumed & (size - 1);
+      uint16_t chunk = (n < size - tail) ? n : (size - tail);
+      if (chunk > maxSize - nRead) chunk = maxSize - nRead;
+      for (uint16_t i = 0; i < chunk; i++) {
+        dst[nRead + i] = buffer[tail + i];
+      }
+      nRead += chunk;
+      consumed += chunk;
+    }
+    return nRead;
+  }
+
+  /// Number of times the DMA overwrote data that was not read yet
+  uint32_t getOverruns() const {
+    return overruns;
+  }
+
+  /// True if data was skipped since the last call (consumer side)
+  bool takeLost() {
+    sync();
+    bool was = lost;
+    lost = false;
+    return was;
+  }
+
+private:
+  uint8_t           buffer[size];
+  volatile uint32_t written;    // total bytes committed by the DMA
+  volatile uint32_t consumed;   // total bytes read by the consumer
+  uint32_t          halves;     // half/full transfer events seen
+  volatile uint32_t overruns;
+  bool              lost;       // consumer skipped overwritten data
+
+  /// Skip data the DMA has overwritten, returns number of unread bytes
+  uint16_t sync() {
+    uint32_t w = written;
+    if (w - consumed >= size) {
+      consumed = w;
+      lost = true;
+    }
+    return w - consumed;
+  }
+};
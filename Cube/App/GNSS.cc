@@ -0,0 +1,63 @@
+#include "GNSS.hh"
+
+#include <stdlib.h>
+#include <string.h>
+
+enum GNSSField {
+  kFieldRun         = 0,
+  kFieldFix         = 1,
+  kFieldDateTime    = 2,
+  kFieldLatitude    = 3,
+  kFieldLongitude   = 4,
+  kFieldAltitude    = 5,
+  kFieldSpeed       = 6,
+  kFieldCourse      = 7,
+  kFieldHDOP        = 10,
+  kFieldSatsInView  = 14,
+  kFieldSatsUsed    = 15
+};
+
+/*
+ * <run>,<fix>,<UTC date & time>,<lat>,<lon>,<MSL alt>,<speed>,<course>,
+ * <fix mode>,<reserved1>,<HDOP>,<PDOP>,<VDOP>,<reserved2>,<sats in view>,
+ * <sats used>,<GLONASS sats used>,<reserved3>,<C/N0 max>,<HPA>,<VPA>
+ *
+ * Fields are read in place; empty fields (no fix yet) read as zero.
+ */
+bool parseGNSSInfo(const char *payload, GNSSFix &fix) {
+  while (*payload == ' ') payload++;
+
+  const char *field = payload;
+  uint8_t index = 0;
+  while (field) {
+    const char *next = strchr(field, ',');
+    switch (index) {
+      case kFieldRun:       fix.running = (field[0] == '1'); break;
+      case kFieldFix:       fix.valid = (field[0] == '1'); break;
+      case kFieldDateTime: {
+        uint8_t length = next ? (next - field) : strlen(field);
+        if (length >= sizeof(fix.datetime)) length = sizeof(fix.datetime) - 1;
+        memcpy(fix.datetime, field, length);
+        fix.datetime[length] = 0;
+        break;
+      }
+      case kFieldLatitude:  fix.latitude = atof(field); break;
+      case kFieldLongitude: fix.longitude = atof(field); break;
+      case kFieldAltitude:  fix.altitude = atof(field); break;
+      case kFieldSpeed:     fix.speed = atof(field); break;
+      case kFieldCourse:    fix.course = atof(field); break;
+      case kFieldHDOP:      fix.hdop = atof(field); break;
+      case kFieldSatsInView: fix.satsInView = atoi(field); break;
+      case kFieldSatsUsed:  fix.satsUsed = atoi(field); break;
+    }
+    if (index == kFieldSatsUsed) break;
+    field = next ? next + 1 : 0;
+    index++;
+  }
+
+  // Need at least run and fix status to call it a report
+  if (index <= kFieldFix) return false;
+
+  fix.sequence++;
+  return true;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Navigation fix as reported by +CGNSINF / +UGNSINF.
+ *
+ * Filled once per report by parseGNSSInfo(); consumers read the struct
+ * instead of querying the modem again.
+ */
+struct GNSSFix {
+  bool     running;         // <GNSS run status>
+  bool     valid;           // <Fix status>
+  char     datetime[19];    // yyyyMMddhhmmss.sss (UTC)
+  float    latitude;        // degrees, +N
+  float    longitude;       // degrees, +E
+  float    altitude;        // MSL, m
+  float    speed;           // km/h
+  float    course;          // degrees
+  float    hdop;
+  uint8_t  satsInView;
+  uint8_t  satsUsed;
+  uint32_t sequence;        // incremented on every parsed report
+};
+
+/// Parse the payload after "+CGNSINF: " / "+UGNSINF: " into fix
+bool parseGNSSInfo(const char *payload, GNSSFix &fix);
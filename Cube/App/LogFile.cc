@@ -0,0 +1,144 @@
+#include "LogFile.hh"
+
+#include <string.h>
+
+extern "C" {
+  #include "ff_gen_drv.h"
+  #include "user_diskio.h"
+}
+
+LogFile::LogFile() {
+  _runs = 0;
+  _open = false;
+  _length = 0;
+  _capacity = 0;
+  _streamNext = 0;
+}
+
+FRESULT LogFile::open(const char *path, uint32_t size) {
+  if (_open) return FR_DENIED;
+
+  FRESULT res = f_open(&_file, path, FA_CREATE_ALWAYS | FA_READ | FA_WRITE);
+  if (res != FR_OK) return res;
+
+  // Seeking past the end in write mode allocates the cluster chain
+  size = (size + kSectorSize - 1) & ~(uint32_t)(kSectorSize - 1);
+  res = f_lseek(&_file, size);
+  if (res == FR_OK && f_size(&_file) != size) res = FR_DENIED;
+  if (res == FR_OK) res = f_sync(&_file);
+
+  // Map the chain once, from here on offsets translate without FAT reads
+  if (res == FR_OK) {
+    _map[0] = sizeof(_map) / sizeof(_map[0]);
+    _file.cltbl = _map;
+    res = f_lseek(&_file, CREATE_LINKMAP);
+  }
+  if (res != FR_OK) {
+    f_close(&_file);
+    f_unlink(path);
+    return res;
+  }
+
+  FATFS *fs = _file.fs;
+  _runs = 0;
+  for (const DWORD *run = _map + 1; run[0] != 0; run += 2) {
+    _runStart[_runs] = fs->database + (run[1] - 2) * fs->csize;
+    _runSectors[_runs] = run[0] * fs->csize;
+    _runs++;
+  }
+
+  _open = true;
+  _length = 0;
+  _capacity = size;
+  _streamNext = 0;
+  return FR_OK;
+}
+
+/* Write sector index of the file straight to the disk */
+FRESULT LogFile::writeSector(uint32_t index) {
+  uint8_t run = 0;
+  DWORD offset = index;
+  while (run < _runs && offset >= _runSectors[run]) {
+    offset -= _runSectors[run];
+    run++;
+  }
+  if (run == _runs) return FR_INT_ERR;
+
+  FATFS *fs = _file.fs;
+  DWORD lba = _runStart[run] + offset;
+
+  // Hold the volume so other FatFs users do not cut in on the card
+  if (!ff_req_grant(fs->sobj)) return FR_TIMEOUT;
+  if (lba != _streamNext) {
+    // Entering a run, rewriting the sector flush() left partly filled or
+    // retrying after an error: (re)start the stream here. A sector that
+    // does not continue the stream would go to the sector cache and stay
+    // dirty there, and its eviction would break up the stream.
+    SD_BeginStream(lba, _runSectors[run] - offset);
+  }
+  DRESULT result = disk_write(fs->drv, _sector, lba, 1);
+  ff_rel_grant(fs->sobj);
+
+  // The stream ends with the run and is given up on an error
+  bool streaming = result == RES_OK && offset + 1 < _runSectors[run];
+  _streamNext = streaming ? lba + 1 : 0;
+
+  return (result == RES_OK) ? FR_OK : FR_DISK_ERR;
+}
+
+FRESULT LogFile::write(const void *data, uint32_t length) {
+  if (!_open) return FR_INVALID_OBJECT;
+  if (length > _capacity - _length) return FR_DENIED;
+
+  const uint8_t *src = (const uint8_t *)data;
+  while (length > 0) {
+    uint32_t used = _length % kSectorSize;
+    uint32_t chunk = kSectorSize - used;
+    if (chunk > length) chunk = length;
+
+    memcpy(_sector + used, src, chunk);
+    src += chunk;
+    length -= chunk;
+    _length += chunk;
+
+    if (used + chunk == kSectorSize) {
+      FRESULT res = writeSector(_length / kSectorSize - 1);
+      if (res != FR_OK) return res;
+    }
+  }
+  return FR_OK;
+}
+
+FRESULT LogFile::flush() {
+  if (!_open) return FR_INVALID_OBJECT;
+
+  uint32_t used = _length % kSectorSize;
+  if (used == 0) return FR_OK;
+
+  // The same sector is written again once it fills up
+  memset(_sector + used, 0, kSectorSize - used);
+  return writeSector(_length / kSectorSize);
+}
+
+FRESULT LogFile::close() {
+  if (!_open) return FR_INVALID_OBJECT;
+
+  FRESULT res = flush();
+
+  FATFS *fs = _file.fs;
+  if (ff_req_grant(fs->sobj)) {
+    if (SD_EndStream() != RES_OK && res == FR_OK) res = FR_DISK_ERR;
+    ff_rel_grant(fs->sobj);
+  }
+
+  // Give back the unused preallocation, this is the only FAT update
+  FRESULT trim = f_lseek(&_file, _length);
+  if (trim == FR_OK) trim = f_truncate(&_file);
+  if (res == FR_OK) res = trim;
+
+  FRESULT closed = f_close(&_file);
+  if (res == FR_OK) res = closed;
+
+  _open = false;
+  return res;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+
+extern "C" {
+  #include "ff.h"
+}
+
+/**
+ * Append-only log file with preallocated space.
+ *
+ * open() allocates the whole file up front, commits the FAT and the
+ * directory entry once and builds the fast-seek cluster link map. Records
+ * are then packed into sectors that go straight to the disk at their
+ * computed LBA, streamed as one multiple block write per contiguous run
+ * (SD_BeginStream), with no FAT or directory access until close(), which
+ * trims the file to the data written. After a power loss the file keeps
+ * its preallocated size and nothing marks the end of the data: past the
+ * last record the clusters hold whatever they held before, which may be
+ * old records. Recovery needs records that identify themselves (e.g. a
+ * sequence number and a CRC).
+ */
+class LogFile {
+public:
+  enum {
+    kSectorSize     = 512,
+    kMaxFragments   = 8     // cluster runs the link map may hold
+  };
+
+  LogFile();
+
+  /**
+   * Create (or replace) the file at path with size bytes preallocated.
+   * FR_NOT_ENOUGH_CORE if the allocation is split into more than
+   * kMaxFragments runs, FR_DENIED if the volume is full.
+   */
+  FRESULT open(const char *path, uint32_t size);
+
+  /// Append a record, FR_DENIED if it does not fit in the preallocated space
+  FRESULT write(const void *data, uint32_t length);
+
+  /// Write out the partly filled last sector (zero padded), restreamed when full
+  FRESULT flush();
+
+  /// Flush, trim the file to the data written and close it
+  FRESULT close();
+
+  bool     isOpen()       { return _open; }
+  uint32_t size()         { return _length; }
+  uint32_t capacity()     { return _capacity; }
+  uint8_t  fragments()    { return _runs; }
+
+private:
+  FIL       _file;
+  DWORD     _map[2 + 2 * kMaxFragments];
+  DWORD     _runStart[kMaxFragments];     // first LBA of each run
+  DWORD     _runSectors[kMaxFragments];
+  uint8_t   _runs;
+  bool      _open;
+  uint32_t  _length;                      // bytes appended
+  uint32_t  _capacity;                    // bytes preallocated
+  DWORD     _streamNext;                  // LBA continuing the stream, 0 if none
+  uint8_t   _sector[kSectorSize];         // sector being filled
+
+  FRESULT writeSector(uint32_t index);
+};
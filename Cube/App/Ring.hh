@@ -0,0 +1,135 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+/**
+ * Lock-free single-producer/single-consumer ring buffer.
+ *
+ * The producer only writes head and the consumer only writes tail, so an
+ * ISR and a task can share the ring without critical sections. Indices run
+ * freely and are masked on access, which requires a power-of-two size.
+ */
+template<typename T, uint16_t size>
+class SPSCRing {
+  static_assert(size != 0 && (size & (size - 1)) == 0, "Ring size must be a power of two");
+  static_assert(size <= 0x8000, "Ring size must fit 16-bit free running indices");
+
+public:
+  SPSCRing() : head(0), tail(0) {}
+
+  /// Discard all contents (not safe while producer/consumer are active)
+  void reset() {
+    head.store(0, std::memory_order_relaxed);
+    tail.store(0, std::memory_order_relaxed);
+  }
+
+  uint16_t capacity() const {
+    return size;
+  }
+
+  uint16_t count() const {
+    return (uint16_t)(head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire));
+  }
+
+  uint16_t space() const {
+    return size - count();
+  }
+
+  bool empty() const {
+    return count() == 0;
+  }
+
+  bool full() const {
+    return count() == size;
+  }
+
+  /* Producer side ---------------------------------------------------------*/
+
+  bool push(const T &value) {
+    uint16_t h = head.load(std::memory_order_relaxed);
+    if ((uint16_t)(h - tail.load(std::memory_order_acquire)) == size) return false;
+    buffer[h & kMask] = value;
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  /// Push up to n items, returns number of items pushed
+  uint16_t push(const T *src, uint16_t n) {
+    uint16_t nPushed = 0;
+    while (nPushed < n) {
+      uint16_t chunk;
+      T *dst = reserve(chunk);
+      if (chunk == 0) break;
+      if (chunk > n - nPushed) chunk = n - nPushed;
+      for (uint16_t i = 0; i < chunk; i++) {
+        dst[i] = src[nPushed + i];
+      }
+      commit(chunk);
+      nPushed += chunk;
+    }
+    return nPushed;
+  }
+
+  /// Contiguous free region starting at head (n receives its length)
+  T * reserve(uint16_t &n) {
+    uint16_t h = head.load(std::memory_order_relaxed);
+    uint16_t free = size - (uint16_t)(h - tail.load(std::memory_order_acquire));
+    uint16_t toEnd = size - (h & kMask);
+    n = (free < toEnd) ? free : toEnd;
+    return buffer + (h & kMask);
+  }
+
+  /// Publish n items written into the region returned by reserve()
+  void commit(uint16_t n) {
+    head.store(head.load(std::memory_order_relaxed) + n, std::memory_order_release);
+  }
+
+  /* Consumer side ---------------------------------------------------------*/
+
+  bool pop(T &value) {
+    uint16_t t = tail.load(std::memory_order_relaxed);
+    if (head.load(std::memory_order_acquire) == t) return false;
+    value = buffer[t & kMask];
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  /// Pop up to n items, returns number of items popped
+  uint16_t pop(T *dst, uint16_t n) {
+    uint16_t nPopped = 0;
+    while (nPopped < n) {
+      uint16_t chunk;
+      const T *src = peek(chunk);
+      if (chunk == 0) break;
+      if (chunk > n - nPopped) chunk = n - nPopped;
+      for (uint16_t i = 0; i < chunk; i++) {
+        dst[nPopped + i] = src[i];
+      }
+      consume(chunk);
+      nPopped += chunk;
+    }
+    return nPopped;
+  }
+
+  /// Contiguous readable region starting at tail (n receives its length)
+  const T * peek(uint16_t &n) const {
+    uint16_t t = tail.load(std::memory_order_relaxed);
+    uint16_t used = (uint16_t)(head.load(std::memory_order_acquire) - t);
+    uint16_t toEnd = size - (t & kMask);
+    n = (used < toEnd) ? used : toEnd;
+    return buffer + (t & kMask);
+  }
+
+  /// Release n items read through peek()
+  void consume(uint16_t n) {
+    tail.store(tail.load(std::memory_order_relaxed) + n, std::memory_order_release);
+  }
+
+private:
+  static const uint16_t kMask = size - 1;
+
+  T                     buffer[size];
+  std::atomic<uint16_t> head;     // written by producer only
+  std::atomic<uint16_t> tail;     // written by consumer only
+};
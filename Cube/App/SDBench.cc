@@ -0,0 +1,199 @@
+#include "SDBench.hh"
+
+#include <stdio.h>
+#include <string.h>
+
+extern "C" {
+  #include "FreeRTOS.h"
+  #include "task.h"
+  #include "stm32f3xx_hal.h"
+  #include "ff_gen_drv.h"
+  #include "user_diskio.h"
+  #include "fatfs.h"
+}
+
+#include "LogFile.hh"
+
+#define SECTOR_SIZE       512
+
+static uint8_t buffer[SDBench::kChunkSectors * SECTOR_SIZE];
+
+enum Pass {
+  kReadSingle,
+  kReadMulti,
+  kWriteSingle,
+  kWriteMulti
+};
+
+static const char * const passNames[] = { "read 1x", "read 4x", "write 1x", "write 4x" };
+
+/* Time one pass over the sectors in DWT cycles, 0 on a disk error */
+static uint32_t runPass(Pass pass, uint32_t first, uint32_t sectors) {
+  uint32_t step = (pass == kReadSingle || pass == kWriteSingle) ? 1 : SDBench::kChunkSectors;
+  uint32_t cycles = 0;
+
+  for (uint32_t sector = first; sector < first + sectors; sector += step) {
+    bool write = (pass == kWriteSingle || pass == kWriteMulti);
+    // Writes put back what is there, the read is not timed
+    if (write && disk_read(0, buffer, sector, step) != RES_OK) return 0;
+
+    uint32_t start = DWT->CYCCNT;
+    DRESULT result = write ? disk_write(0, buffer, sector, step) : disk_read(0, buffer, sector, step);
+    cycles += DWT->CYCCNT - start;
+
+    if (result != RES_OK) return 0;
+  }
+  return cycles ? cycles : 1;
+}
+
+bool SDBench::run(uint32_t sectors, void (*print)(const char *line)) {
+  char line[80];
+
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  if (disk_initialize(0) & STA_NOINIT) {
+    print("sdbench: no card\r\n");
+    return false;
+  }
+
+  DWORD count;
+  if (disk_ioctl(0, GET_SECTOR_COUNT, &count) != RES_OK || count < 2 * sectors) {
+    print("sdbench: card size unknown or too small\r\n");
+    return false;
+  }
+
+  // The cycle counter wraps after a minute at the slowest SPI clock
+  if (sectors > kMaxSectors) sectors = kMaxSectors;
+  sectors -= sectors % kChunkSectors;
+  if (sectors == 0) sectors = kChunkSectors;
+
+  // Time the card itself, not the sector cache
+  if (SD_EnableCache(0) != RES_OK) {
+    print("sdbench: cache write-back failed\r\n");
+    return false;
+  }
+
+  SD_ResetWaitStats();
+  uint32_t first = (count / 2) & ~(uint32_t)(kChunkSectors - 1);
+
+  for (int pass = kReadSingle; pass <= kWriteMulti; pass++) {
+    uint32_t cycles = runPass((Pass)pass, first, sectors);
+    if (cycles == 0) {
+      snprintf(line, sizeof(line), "sdbench: %s failed\r\n", passNames[pass]);
+      print(line);
+      SD_EnableCache(1);
+      return false;
+    }
+
+    uint32_t us = cycles / (SystemCoreClock / 1000000);
+    uint32_t kbps = (uint32_t)((uint64_t)sectors * SECTOR_SIZE * 1000 / 1024 * 1000 / us);
+    snprintf(line, sizeof(line), "sdbench: %s %lu sectors in %lu ms, %lu KB/s, %lu us/sector\r\n",
+      passNames[pass], sectors, us / 1000, kbps, us / sectors);
+    print(line);
+  }
+
+  SD_EnableCache(1);
+  printWaitStats(print);
+  return true;
+}
+
+static FATFS logVolume;
+static LogFile logFile;
+
+bool SDBench::runLog(uint32_t kilobytes, void (*print)(const char *line)) {
+  char line[96];
+
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  FRESULT res = f_mount(&logVolume, USER_Path, 1);
+  if (res == FR_OK) res = logFile.open("BENCH.LOG", kilobytes * 1024);
+  if (res != FR_OK) {
+    snprintf(line, sizeof(line), "sdlog: open failed (%d)\r\n", res);
+    print(line);
+    f_mount(NULL, USER_Path, 0);
+    return false;
+  }
+
+  SD_ResetWaitStats();
+  SD_ResetCacheStats();
+
+  // Fixed size records, the latency of each append is what a logger sees
+  uint8_t record[kLogRecordSize];
+  uint32_t count = 0, maxUs = 0, totalUs = 0;
+  while (res == FR_OK && logFile.size() + sizeof(record) <= logFile.capacity()) {
+    memset(record, (uint8_t)count, sizeof(record));
+
+    uint32_t start = DWT->CYCCNT;
+    res = logFile.write(record, sizeof(record));
+    uint32_t us = (DWT->CYCCNT - start) / (SystemCoreClock / 1000000);
+
+    totalUs += us;
+    if (us > maxUs) maxUs = us;
+    count++;
+  }
+
+  uint8_t fragments = logFile.fragments();
+  FRESULT closed = logFile.close();
+  if (res == FR_OK) res = closed;
+  f_mount(NULL, USER_Path, 0);
+
+  if (res != FR_OK || count == 0) {
+    snprintf(line, sizeof(line), "sdlog: write failed (%d)\r\n", res);
+    print(line);
+    return false;
+  }
+
+  snprintf(line, sizeof(line), "sdlog: %lu records of %u bytes in %u runs, %lu KB/s, avg %lu us, max %lu us\r\n",
+    count, (unsigned)kLogRecordSize, (unsigned)fragments,
+    (uint32_t)((uint64_t)count * kLogRecordSize * 1000 / 1024 * 1000 / (totalUs ? totalUs : 1)),
+    totalUs / count, maxUs);
+  print(line);
+
+  printWaitStats(print);
+  printCacheStats(print);
+  return true;
+}
+
+void SDBench::printCacheStats(void (*print)(const char *line)) {
+  char line[96];
+  const SD_CacheStats *stats = SD_GetCacheStats();
+  uint32_t accesses = stats->hits + stats->misses;
+
+  snprintf(line, sizeof(line), "cache %ux%u: %lu hits, %lu misses (%lu%% hits), %lu write-backs\r\n",
+    (unsigned)SD_CACHE_SETS, (unsigned)SD_CACHE_WAYS, stats->hits, stats->misses,
+    accesses ? stats->hits * 100 / accesses : 0, stats->writebacks);
+  print(line);
+}
+
+static const char * const waitNames[SD_WAIT_COUNT] = { "select", "read", "write", "erase" };
+
+void SDBench::printWaitStats(void (*print)(const char *line)) {
+  char line[128];
+
+  for (int op = 0; op < SD_WAIT_COUNT; op++) {
+    const SD_WaitStats *stats = SD_GetWaitStats((SD_WaitOp)op);
+    if (stats->count == 0) continue;
+
+    snprintf(line, sizeof(line), "wait %s: %lu, avg %lu us, max %lu us, %lu timeouts\r\n",
+      waitNames[op], stats->count, stats->totalUs / stats->count, stats->maxUs, stats->timeouts);
+    print(line);
+
+    // One column per non-empty bucket, labelled with its upper bound
+    size_t used = 0;
+    for (int n = 0; n < SD_WAIT_BUCKETS; n++) {
+      if (stats->buckets[n] == 0) continue;
+
+      char label[12];
+      if (n < SD_WAIT_BUCKETS - 1) snprintf(label, sizeof(label), "<%luus", 64UL << n);
+      else snprintf(label, sizeof(label), "more");
+
+      int length = snprintf(line + used, sizeof(line) - 2 - used, " %s:%lu", label, stats->buckets[n]);
+      if (length < 0 || used + length >= sizeof(line) - 2) break;
+      used += length;
+    }
+    strcpy(line + used, "\r\n");
+    print(line);
+  }
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * SD card sector throughput through the disk driver, bypassing FatFs.
+ *
+ * Reads a run of sectors from the middle of the card one at a time and in
+ * multi-sector chunks, then writes the same data back the same two ways
+ * (the card content is unchanged). Each result line is passed to print,
+ * followed by the card wait histograms of the run. The driver's sector
+ * cache is turned off for the run.
+ */
+class SDBench {
+public:
+  enum {
+    kDefaultSectors   = 256,
+    kMaxSectors       = 2048,
+    kChunkSectors     = 4,
+    kLogRecordSize    = 64,
+    kDefaultLogKB     = 256
+  };
+
+  static bool run(uint32_t sectors, void (*print)(const char *line));
+
+  /**
+   * Append fixed size records to a preallocated LogFile of the given size
+   * until it is full, and report the per-record latency. Mounts the volume
+   * for the run.
+   */
+  static bool runLog(uint32_t kilobytes, void (*print)(const char *line));
+
+  /// Card wait histograms collected by the disk driver (user_diskio.h)
+  static void printWaitStats(void (*print)(const char *line));
+
+  /// Hit, miss and write-back counts of the driver's sector cache
+  static void printCacheStats(void (*print)(const char *line));
+};
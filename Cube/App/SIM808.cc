@@ -2,6 +2,13 @@
 #include "UART.hh"
 #include "config.h"
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Sent by the modem when it waits for data, not terminated by a line break */
+static const char kPrompt[] = "> ";
+
 extern "C" {
   #include "FreeRTOS.h"
   #include "cmsis_os.h"
@@ -11,22 +18,22 @@ extern "C" {
 }
 
 
-char buf[80];
 char line[200];
 SIM808 gsm;
 
 void SIM808_Task(void const * argument) {
-  UART::init();  
-  
+  UART::init();
+
   vTaskDelay(5000);
-  
+
   gsm.initialize();
   gsm.checkPIN();
   gsm.sendPIN(SIM_PIN1);
-  
+
   //gsm.enableCharging();
-  
+
   gsm.enableGPS();
+  gsm.enableGNSSReports(1);
 
   /* Infinite loop */
   for(;;)
@@ -34,175 +41,303 @@ void SIM808_Task(void const * argument) {
     /* toggle LED */
     HAL_GPIO_TogglePin(LD3_GPIO_Port, GPIO_PIN_9);
 
-    gsm.checkBattery();
+    /* One concatenated query for the whole status snapshot.
+     * Position also arrives on its own as +UGNSINF between polls. */
+    gsm.requestStatus();
+    gsm.runUntilIdle();
 
-    gsm.checkNetwork();
+    const UARTLatency &latency = UART::getLatency();
+    if (latency.count > 0) {
+      snprintf(line, sizeof(line), "RX wakeup latency: last %lu us, max %lu us, avg %lu us\r\n",
+        latency.lastUs, latency.maxUs, latency.totalUs / latency.count);
+      CDC_Transmit_FS((uint8_t *)line, strlen(line));
+    }
 
-    gsm.getGPSInfo();
-    
-    while (true) {
-      int nRead = TextUART::readLine(buf, 80, '\n');
-      if (nRead == 0) break;
-      
-      while (nRead > 0) {
-        char c = buf[nRead - 1];
-        if (c == '\r' || c == '\n') {
-          buf[nRead - 1] = 0;
-          nRead--;
-        }
-        else break;
-      }
-        
-      //if (nRead > 0) {
-        strcpy(line, "<< [");
-        strcat(line, buf);
-        strcat(line, "]\r\n");
-        CDC_Transmit_FS((uint8_t *)line, strlen(line));
-      //}
+    uint32_t overruns = UART::getOverruns();
+    uint32_t txErrors = UART::getTxErrors();
+    if (overruns > 0 || txErrors > 0) {
+      snprintf(line, sizeof(line), "RX overruns: %lu, TX errors: %lu\r\n", overruns, txErrors);
+      CDC_Transmit_FS((uint8_t *)line, strlen(line));
     }
-    
-    vTaskDelay(2000);     
+
+    /* Keep handling unsolicited lines until the next poll */
+    gsm.run(2000);
   }
 }
 
 
-  
+
+  SIM808::SIM808() : at(send, this) {
+    status = OK;
+    lineLength = 0;
+    memset(&snapshot, 0, sizeof(snapshot));
+    memset(&gnssFix, 0, sizeof(gnssFix));
+    urc.setHandler(kURCGNSSInfo, onGNSSReport, this);
+    at.setURCDispatcher(&urc);
+    at.setUnsolicitedHandler(onUnsolicited, this);
+  }
+
+  void SIM808::setURCHandler(URCType type, URCDispatcher::Handler handler, void *context) {
+    urc.setHandler(type, handler, context);
+  }
+
   void SIM808::initialize() {
-    sendCommand("");
-    expectOK();         // in case the command echo is on
     status = OK;
-    expectOK();
-    sendCommand("E0");
-    expectOK();
-    expectOK();
+    submit("", 0, 500);         // in case the command echo is on
+    submit("E0", 0, 500);
+    runUntilIdle();
   }
 
   bool SIM808::checkPIN() {
-    status = OK;
-    sendCommand("+CPIN?");
-    expectResponse("+CPIN:");
-    expectOK();
-    return false;
+    return execute("+CPIN?", "+CPIN:", 5000);
   }
-  
+
   bool SIM808::checkNetwork() {
-    status = OK;
-    sendCommand("+CREG?");
-    expectResponse("+CREG:");
-    expectOK();
-    return false;
+    return execute("+CREG?", "+CREG:", 1000, onNetwork);
   }
-  
+
   bool SIM808::checkBattery() {
-    status = OK;
-    sendCommand("+CBC");
-    expectResponse("+CBC:");
-    expectOK();
-    return false;
+    return execute("+CBC", "+CBC:", 1000, onBattery);
   }
-  
-  void SIM808::sendPIN(const char *pin) {
-    status = OK;
-    sendCommand("+CPIN=", pin);
-    vTaskDelay(3000);
-    //expectResponse("+CPIN:");
-    expectOK();
+
+  bool SIM808::sendPIN(const char *pin) {
+    char cmd[24];
+    snprintf(cmd, sizeof(cmd), "+CPIN=%s", pin);
+    return execute(cmd, 0, 5000);
   }
-  
+
   bool SIM808::enableCharging() {
-    status = OK;
-    sendCommand("+ECHARGE=1");
-    vTaskDelay(1000);
-    expectOK();    
+    return execute("+ECHARGE=1", 0, 1000);
   }
-  
+
   bool SIM808::disableCharging() {
-    status = OK;
-    sendCommand("+ECHARGE=0");
-    vTaskDelay(1000);
-    expectOK();    
+    return execute("+ECHARGE=0", 0, 1000);
   }
-  
+
   bool SIM808::enableGPS() {
-    status = OK;
-    sendCommand("+CGNSPWR=", "1");
-    expectOK();    
+    return execute("+CGNSPWR=1", 0, 1000);
   }
-  
+
   bool SIM808::disableGPS() {
-    status = OK;
-    sendCommand("+CGNSPWR=", "0");
-    expectOK();    
+    return execute("+CGNSPWR=0", 0, 1000);
+  }
+
+  bool SIM808::enableGNSSReports(uint8_t period) {
+    char cmd[16];
+    snprintf(cmd, sizeof(cmd), "+CGNSURC=%d", period);
+    return execute(cmd, 0, 1000);
   }
 
   bool SIM808::getGPSInfo() {
-    status = OK;
-    sendCommand("+CGNSINF");
-    expectResponse("+CGNSINF: ");
-    expectOK();      
+    return execute("+CGNSINF", "+CGNSINF:", 1000, onGPSInfo);
+  }
+
+  bool SIM808::requestNetwork() {
+    return submit("+CREG?", "+CREG:", 1000, onNetwork);
+  }
+
+  bool SIM808::requestBattery() {
+    return submit("+CBC", "+CBC:", 1000, onBattery);
+  }
+
+  bool SIM808::requestGPSInfo() {
+    return submit("+CGNSINF", "+CGNSINF:", 1000, onGPSInfo);
+  }
+
+  bool SIM808::requestStatus() {
+    return submit("+CBC;+CREG?;+CGATT?;+CGNSINF", "+CBC:|+CREG:|+CGATT:|+CGNSINF:", 2000, onStatus);
   }
 
-  
   bool SIM808::isError() {
     return status != OK;
   }
- 
-  bool SIM808::expectOK() {
-    char buf[20];
-    int nRead = uart.readLine(buf, 20, '\n');
-
-    char line[30];
-    strcpy(line, "< ");
-    strcat(line, buf);
-    CDC_Transmit_FS((uint8_t *)line, strlen(line));
 
-    if (strcmp(buf, "OK") != 0) {
+  bool SIM808::submit(const char *cmd, const char *prefix, uint32_t timeoutMs,
+                      ATEngine::Callback callback, const char *final) {
+    if (callback == 0) callback = onResult;
+    if (!at.submit(cmd, prefix, timeoutMs, callback, this, final)) {
       status = NOT_OK;
+      return false;
     }
+    return true;
   }
-  
-  bool SIM808::expectResponse(const char *prefix) {
-    char buf[80];
-    uart.readLine(buf, 80, '\n');
 
-    int nRead = uart.readLine(buf, 80, '\n');
+  bool SIM808::execute(const char *cmd, const char *prefix, uint32_t timeoutMs,
+                       ATEngine::Callback callback) {
+    status = OK;
+    if (!submit(cmd, prefix, timeoutMs, callback)) return false;
+    runUntilIdle();
+    return status == OK;
+  }
 
-    if (nRead > 0) {
-      char line[50];
-      strcpy(line, "< ");
-      strcat(line, buf);
-      CDC_Transmit_FS((uint8_t *)line, strlen(line));
+  bool SIM808::runUntilIdle(uint32_t timeoutMs) {
+    uint32_t start = xTaskGetTickCount();
+    while (!at.idle()) {
+      uint32_t elapsed = xTaskGetTickCount() - start;
+      if (elapsed >= timeoutMs) return false;
+      process(timeoutMs - elapsed);
+    }
+    return true;
+  }
+
+  void SIM808::run(uint32_t durationMs) {
+    uint32_t start = xTaskGetTickCount();
+    while (true) {
+      uint32_t elapsed = xTaskGetTickCount() - start;
+      if (elapsed >= durationMs) break;
+      process(durationMs - elapsed);
     }
+  }
+
+  /* Wait for one line (or the next command deadline) and feed it to the engine */
+  void SIM808::process(uint32_t timeoutMs) {
+    uint32_t now = xTaskGetTickCount();
+    at.poll(now);
+
+    uint32_t wait = at.timeUntilDeadline(now);
+    if (wait > timeoutMs) wait = timeoutMs;
+
+    int nRead = uart.readLine(lineBuf + lineLength, sizeof(lineBuf) - lineLength, '\n', wait, kPrompt);
+    lineLength += nRead;
+
+    // The start of a partial line may be gone if the ring was overrun
+    if (uart.takeOverrun()) {
+      log("<< overrun [", lineBuf);
+      lineLength = 0;
+      return;
+    }
+    if (lineLength == 0) return;
+
+    // Keep partial lines until the rest arrives
+    // A data prompt ("> " after +CIPSEND) ends without a line break
+    bool complete = (lineBuf[lineLength - 1] == '\n') || (lineLength >= sizeof(lineBuf) - 1) ||
+      (lineLength >= sizeof(kPrompt) - 1 && 0 == strcmp(lineBuf + lineLength - (sizeof(kPrompt) - 1), kPrompt));
+    if (!complete) return;
+
+    while (lineLength > 0) {
+      char c = lineBuf[lineLength - 1];
+      if (c == '\r' || c == '\n') {
+        lineBuf[lineLength - 1] = 0;
+        lineLength--;
+      }
+      else break;
+    }
+    lineLength = 0;
+
+    if (lineBuf[0] != 0) {
+      log("<< [", lineBuf);
+    }
+    at.onLine(lineBuf, xTaskGetTickCount());
+  }
+
+  void SIM808::send(void *context, const char *data) {
+    SIM808 *self = (SIM808 *)context;
+    self->uart.write(data);
+  }
+
+  void SIM808::log(const char *tag, const char *text) {
+    char msg[220];
+    snprintf(msg, sizeof(msg), "%s%s]\r\n", tag, text);
+    CDC_Transmit_FS((uint8_t *)msg, strlen(msg));
+  }
+
+  void SIM808::onResult(void *context, ATEngine::Result result, const char *response) {
+    SIM808 *self = (SIM808 *)context;
+    if (result != ATEngine::kOK) {
+      self->status = NOT_OK;
+    }
+  }
+
+  /* +CREG: <n>,<stat> */
+  static void parseNetwork(const char *line, SIM808Status &status) {
+    const char *field = strchr(line, ',');
+    if (field) {
+      status.networkStatus = atoi(field + 1);
+    }
+  }
+
+  /* +CBC: <bcs>,<bcl>,<voltage> */
+  static void parseBattery(const char *line, SIM808Status &status) {
+    const char *field = strchr(line, ',');
+    if (field) {
+      status.batteryPercent = atoi(field + 1);
+      field = strchr(field + 1, ',');
+      if (field) {
+        status.batteryVoltage = atoi(field + 1);
+      }
+    }
+  }
+
+  /* +CGATT: <state> */
+  static void parseGPRS(const char *line, SIM808Status &status) {
+    const char *field = strchr(line, ':');
+    if (field) {
+      status.gprsAttached = (atoi(field + 1) == 1);
+    }
+  }
+
+  void SIM808::onNetwork(void *context, ATEngine::Result result, const char *response) {
+    SIM808 *self = (SIM808 *)context;
+    onResult(context, result, response);
+    if (result != ATEngine::kOK) return;
+
+    parseNetwork(response, self->snapshot);
+  }
+
+  void SIM808::onBattery(void *context, ATEngine::Result result, const char *response) {
+    SIM808 *self = (SIM808 *)context;
+    onResult(context, result, response);
+    if (result != ATEngine::kOK) return;
+
+    parseBattery(response, self->snapshot);
+  }
+
+  /* +CGNSINF: <run>,<fix>,<time>,<lat>,<lon>,... */
+  void SIM808::onGPSInfo(void *context, ATEngine::Result result, const char *response) {
+    SIM808 *self = (SIM808 *)context;
+    onResult(context, result, response);
+    if (result != ATEngine::kOK) return;
+
+    if (strncmp(response, "+CGNSINF:", 9) != 0) return;
+
+    parseGNSSInfo(response + 9, self->gnssFix);
+  }
+
+  /* Intermediate lines of +CBC;+CREG?;+CGATT?;+CGNSINF, one per query */
+  void SIM808::onStatus(void *context, ATEngine::Result result, const char *response) {
+    SIM808 *self = (SIM808 *)context;
+    onResult(context, result, response);
+    if (result != ATEngine::kOK) return;
 
-    uart.readLine(buf, 80, '\n');
-  }
-  
-  void SIM808::sendCommand(const char *cmd) {
-    /*
-    char line[40];
-    strcpy(line, "> AT");
-    strcat(line, cmd);
-    strcat(line, "\r\n");
-    CDC_Transmit_FS((uint8_t *)line, strlen(line));
-    */
-    
-    uart.write("AT");
-    uart.write(cmd);
-    uart.write("\r\n");
-  }
-
-  void SIM808::sendCommand(const char *cmd, const char *data) {
-    /*
-    char line[40];
-    strcpy(line, "> AT");
-    strcat(line, cmd);
-    strcat(line, data);
-    strcat(line, "\r\n");
-    CDC_Transmit_FS((uint8_t *)line, strlen(line));
-    */
-    
-    uart.write("AT");
-    uart.write(cmd);
-    uart.write(data);
-    uart.write("\r\n");
-  }  
+    const char *line = response;
+    while (line && *line) {
+      if (strncmp(line, "+CBC:", 5) == 0) {
+        parseBattery(line, self->snapshot);
+      }
+      else if (strncmp(line, "+CREG:", 6) == 0) {
+        parseNetwork(line, self->snapshot);
+      }
+      else if (strncmp(line, "+CGATT:", 7) == 0) {
+        parseGPRS(line, self->snapshot);
+      }
+      else if (strncmp(line, "+CGNSINF:", 9) == 0) {
+        parseGNSSInfo(line + 9, self->gnssFix);
+      }
+      line = strchr(line, '\n');
+      if (line) line++;
+    }
+    self->snapshot.updated = xTaskGetTickCount();
+  }
+
+  /* +UGNSINF: <run>,<fix>,... pushed by the modem after AT+CGNSURC=<n> */
+  void SIM808::onGNSSReport(void *context, URCType type, const char *line) {
+    SIM808 *self = (SIM808 *)context;
+    const char *payload = strchr(line, ':');
+    if (payload) {
+      parseGNSSInfo(payload + 1, self->gnssFix);
+    }
+  }
+
+  void SIM808::onUnsolicited(void *context, const char *line) {
+    // already logged in process()
+  }
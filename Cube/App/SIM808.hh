@@ -13,6 +13,19 @@ void SIM808_Task(void const * argument);
 #if defined (__cplusplus)
 
 #include "UART.hh"
+#include "ATEngine.hh"
+#include "GNSS.hh"
+
+/**
+ * Modem status collected by one concatenated query (SIM808::requestStatus).
+ */
+struct SIM808Status {
+  uint8_t  networkStatus;       // +CREG <stat>
+  uint8_t  batteryPercent;
+  uint16_t batteryVoltage;      // mV
+  bool     gprsAttached;        // +CGATT
+  uint32_t updated;             // tick of the last complete snapshot
+};
 
 class SIM808 {
 public:
@@ -21,37 +34,83 @@ public:
     NOT_OK = 1
   };
 
-  
+  SIM808();
+
   void initialize();
 
   bool checkPIN();
-  
+
   bool checkNetwork();
   bool checkBattery();
   bool checkGPS();
   bool getGPSInfo();
-  
-  void sendPIN(const char *pin);
-  
+
+  bool sendPIN(const char *pin);
+
   bool configureSMS();
   bool sendSMS(const char *number, const char *message);
 
   bool enableGPS();
   bool disableGPS();
-  
+
+  /// Have the modem push +UGNSINF every period fixes (0 turns it off)
+  bool enableGNSSReports(uint8_t period);
+
   bool enableCharging();
   bool disableCharging();
-  
+
   bool isError();
 
+  /* Asynchronous queries, completed by run()/runUntilIdle() */
+  bool requestNetwork();
+  bool requestBattery();
+  bool requestGPSInfo();
+
+  /// Battery, network, GPRS and GNSS state in a single AT command line
+  bool requestStatus();
+
+  /// Process modem lines until all queued commands complete
+  bool runUntilIdle(uint32_t timeoutMs = 30000);
+
+  /// Process modem lines (commands and unsolicited) for a while
+  void run(uint32_t durationMs);
+
+  /// Register a handler for an unsolicited result code
+  void setURCHandler(URCType type, URCDispatcher::Handler handler, void *context);
+
+  uint8_t  getNetworkStatus()    { return snapshot.networkStatus; }
+  uint8_t  getBatteryPercent()   { return snapshot.batteryPercent; }
+  uint16_t getBatteryVoltage()   { return snapshot.batteryVoltage; }
+  const SIM808Status & getSnapshot() { return snapshot; }
+  const GNSSFix & getGNSSFix()   { return gnssFix; }
+
 private:
   int  status;
   TextUART uart;
-  
-  bool expectOK();
-  bool expectResponse(const char *prefix);
-  void sendCommand(const char *cmd);
-  void sendCommand(const char *cmd, const char *data);
+  ATEngine at;
+  URCDispatcher urc;
+
+  char     lineBuf[200];
+  uint16_t lineLength;
+
+  SIM808Status snapshot;
+  GNSSFix  gnssFix;             // last +CGNSINF / +UGNSINF report
+
+  bool submit(const char *cmd, const char *prefix, uint32_t timeoutMs,
+              ATEngine::Callback callback = 0, const char *final = 0);
+  bool execute(const char *cmd, const char *prefix, uint32_t timeoutMs,
+               ATEngine::Callback callback = 0);
+  void process(uint32_t timeoutMs);
+  void log(const char *tag, const char *text);
+
+  static void send(void *context, const char *data);
+  static void onResult(void *context, ATEngine::Result result, const char *response);
+  static void onNetwork(void *context, ATEngine::Result result, const char *response);
+  static void onBattery(void *context, ATEngine::Result result, const char *response);
+  static void onGPSInfo(void *context, ATEngine::Result result, const char *response);
+  static void onStatus(void *context, ATEngine::Result result, const char *response);
+  static void onGNSSReport(void *context, URCType type, const char *line);
+  static void onUnsolicited(void *context, const char *line);
 };
 
 #endif
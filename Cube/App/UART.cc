@@ -1,127 +1,376 @@
 #include "UART.hh"
 
+#include <string.h>
+
 #include "usart.h"
 #include "usbd_cdc_if.h"
 
 #include "FreeRTOS.h"
 #include "cmsis_os.h"
 #include "task.h"
+#include "semphr.h"
 
-#include "fifo.h"
+#include "config.h"
+#include "Ring.hh"
+#include "DMARing.hh"
 
 #define RX_FIFO_SIZE    128
 #define TX_FIFO_SIZE    128
+/* The DMA laps the ring if the reader falls a whole buffer behind. At 9600
+ * baud (960 B/s) 512 bytes last 530 ms, covering a modem burst arriving
+ * while the SIM808 task is busy with the previous lines: its engine work,
+ * CDC logging and the time slices of the other task at its priority. Keep
+ * it a power of two for the ring, and watch UART::getOverruns(). */
+#define RX_DMA_SIZE     512
+
+#define TX_TIMEOUT_MS   1000
+#define RX_TIMEOUT_MS   2000
+
+/* Notification bit of the reader task, other bits stay with their owners */
+#define RX_NOTIFY_BIT   (1UL << 30)
+
+static SPSCRing<uint8_t, TX_FIFO_SIZE> txRing;
+static SemaphoreHandle_t txSpace;         // given from ISR when ring space frees up
+
+void serTxInit();
+uint16_t serReadCount();
+
+static TaskHandle_t rxWaiter;             // task blocked in serWaitReceive, NULL if none
+static volatile int16_t rxDelim;          // byte completing the wait, -1 for any data
+static volatile uint32_t rxSignalCycles;  // DWT cycle count when the waiter was signalled
+static UARTLatency rxLatency;
+
+/* Wake the task blocked in serWaitReceive (call from ISR) */
+static void serSignalReader() {
+  TaskHandle_t waiter = rxWaiter;
+  if (waiter == NULL) return;
+  rxWaiter = NULL;
+  rxSignalCycles = DWT->CYCCNT;
+
+  BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+  xTaskNotifyFromISR(waiter, RX_NOTIFY_BIT, eSetBits, &xHigherPriorityTaskWoken);
+  portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+/* Block until delim (or any byte if delim < 0) is received, false on timeout */
+bool serWaitReceive(int16_t delim, uint32_t timeoutMs) {
+  xTaskNotifyWait(0, RX_NOTIFY_BIT, NULL, 0);   // drop a stale signal
+  rxDelim = delim;
+  rxWaiter = xTaskGetCurrentTaskHandle();
+
+  // Data committed before the waiter was registered would not signal us
+  if (serReadCount() > 0) {
+    rxWaiter = NULL;
+    return true;
+  }
+
+  uint32_t bits = 0;
+  xTaskNotifyWait(0, RX_NOTIFY_BIT, &bits, pdMS_TO_TICKS(timeoutMs));
+  rxWaiter = NULL;
+  bool signalled = (bits & RX_NOTIFY_BIT) != 0;
+
+  if (signalled) {
+    uint32_t us = (DWT->CYCCNT - rxSignalCycles) / (SystemCoreClock / 1000000);
+    rxLatency.count++;
+    rxLatency.lastUs = us;
+    rxLatency.totalUs += us;
+    if (us > rxLatency.maxUs) rxLatency.maxUs = us;
+  }
+  return signalled;
+}
+
+#if UART_RX_DMA
+
+static DMA_HandleTypeDef hdma_usart2_rx;
+static DMARxRing<RX_DMA_SIZE> rxRing;
+
+void serInit() {
+  serTxInit();
+  rxRing.reset();
+
+  /* USART2_RX is mapped to DMA1 channel 6 */
+  __HAL_RCC_DMA1_CLK_ENABLE();
+  hdma_usart2_rx.Instance = DMA1_Channel6;
+  hdma_usart2_rx.Init.Direction = DMA_PERIPH_TO_MEMORY;
+  hdma_usart2_rx.Init.PeriphInc = DMA_PINC_DISABLE;
+  hdma_usart2_rx.Init.MemInc = DMA_MINC_ENABLE;
+  hdma_usart2_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+  hdma_usart2_rx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+  hdma_usart2_rx.Init.Mode = DMA_CIRCULAR;
+  hdma_usart2_rx.Init.Priority = DMA_PRIORITY_HIGH;
+  if (HAL_DMA_Init(&hdma_usart2_rx) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  __HAL_LINKDMA(&huart2, hdmarx, hdma_usart2_rx);
+
+  HAL_NVIC_SetPriority(DMA1_Channel6_IRQn, 5, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Channel6_IRQn);
+
+  HAL_UART_Receive_DMA(&huart2, rxRing.data(), rxRing.capacity());
+
+  __HAL_UART_CLEAR_IDLEFLAG(&huart2);
+  __HAL_UART_ENABLE_IT(&huart2, UART_IT_IDLE);
+}
+
+/* Called once per burst (IDLE line) and on half/full DMA transfer (boundary) */
+void serOnReceiveChunk(bool boundary) {
+  uint16_t writePos = RX_DMA_SIZE - __HAL_DMA_GET_COUNTER(&hdma_usart2_rx);
+  uint32_t last = rxRing.commit(writePos, boundary);
+
+  if (rxWaiter != NULL) {
+    int16_t delim = rxDelim;
+    if ((delim < 0) ? (rxRing.committed() != last) : rxRing.contains(last, delim)) {
+      serSignalReader();
+    }
+  }
+
+  /* toggle LED */
+  HAL_GPIO_TogglePin(LD3_GPIO_Port, GPIO_PIN_10);
+}
+
+int serRead(uint8_t *b) {
+  if (!rxRing.pop(*b)) {
+    HAL_GPIO_WritePin(LD3_GPIO_Port, GPIO_PIN_10, GPIO_PIN_RESET);
+    return -1;
+  }
+  return 0;
+}
+
+uint16_t serReadCount() {
+  return rxRing.available();
+}
+
+uint32_t serOverrunCount() {
+  return rxRing.getOverruns();
+}
 
-FIFO(RXFIFO, uint8_t, RX_FIFO_SIZE);
-FIFO(TXFIFO, uint8_t, TX_FIFO_SIZE);
+bool serTakeOverrun() {
+  return rxRing.takeLost();
+}
+
+void MHAL_UART_RxDMA_IRQHandler(UART_HandleTypeDef *huart) {
+  HAL_DMA_IRQHandler(huart->hdmarx);
+}
+
+void HAL_UART_RxHalfCpltCallback(UART_HandleTypeDef *huart) {
+  if (huart == &huart2) serOnReceiveChunk(true);
+}
+
+void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart) {
+  if (huart == &huart2) serOnReceiveChunk(true);
+}
+
+#else
+
+static SPSCRing<uint8_t, RX_FIFO_SIZE> rxRing;
+static volatile uint32_t rxOverruns;
+static volatile bool rxLost;
 
 void serInit() {
-  FIFO_INIT(RXFIFO);
-  FIFO_INIT(TXFIFO);
+  serTxInit();
+  rxRing.reset();
   __HAL_UART_ENABLE_IT(&huart2, UART_IT_RXNE);
 }
 
 int serOnReceive() {
   uint8_t b = huart2.Instance->RDR;
 
-  if (FIFO_FULL(RXFIFO)) {
+  if (!rxRing.push(b)) {
     // buffer overrun
+    rxOverruns++;
+    rxLost = true;
+    return -1;
+  }
+
+  if (rxWaiter != NULL && (rxDelim < 0 || rxDelim == b)) {
+    serSignalReader();
+  }
+  return 0;
+}
+
+int serRead(uint8_t *b) {
+  if (!rxRing.pop(*b)) {
+    HAL_GPIO_WritePin(LD3_GPIO_Port, GPIO_PIN_10, GPIO_PIN_RESET);
     return -1;
   }
+  return 0;
+}
 
-  UBaseType_t uxSavedInterruptStatus;
-  uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
+uint16_t serReadCount() {
+  return rxRing.count();
+}
 
-    FIFO_PUSH(RXFIFO, b);
+uint32_t serOverrunCount() {
+  return rxOverruns;
+}
 
-  taskEXIT_CRITICAL_FROM_ISR(uxSavedInterruptStatus);
+bool serTakeOverrun() {
+  bool lost = rxLost;
+  rxLost = false;
+  return lost;
+}
 
-  return 0;
+#endif
+
+#if UART_TX_DMA
+
+static DMA_HandleTypeDef hdma_usart2_tx;
+static volatile uint16_t txChunk;         // length of the transfer in flight, 0 if idle
+static volatile uint32_t txErrors;        // transfers aborted by a DMA error
+
+/* Hand the next contiguous ring region to DMA if the channel is idle */
+static void serTxKick() {
+  if (txChunk != 0) return;
+
+  uint16_t n;
+  const uint8_t *src = txRing.peek(n);
+  if (n == 0) return;
+
+  txChunk = n;
+  HAL_DMA_Start_IT(&hdma_usart2_tx, (uint32_t)src, (uint32_t)&huart2.Instance->TDR, n);
+}
+
+static void serOnTransmitComplete(DMA_HandleTypeDef *hdma) {
+  txRing.consume(txChunk);
+  txChunk = 0;
+  serTxKick();
+
+  BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+  xSemaphoreGiveFromISR(txSpace, &xHigherPriorityTaskWoken);
+  portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+/* The channel stops on a transfer error; drop the chunk and carry on with the rest */
+static void serOnTransmitError(DMA_HandleTypeDef *hdma) {
+  txErrors++;
+  txRing.consume(txChunk);
+  txChunk = 0;
+  serTxKick();
+
+  BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+  xSemaphoreGiveFromISR(txSpace, &xHigherPriorityTaskWoken);
+  portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+uint32_t serTxErrorCount() {
+  return txErrors;
+}
+
+void serTxInit() {
+  txRing.reset();
+  txChunk = 0;
+  if (txSpace == NULL) txSpace = xSemaphoreCreateBinary();
+
+  /* USART2_TX is mapped to DMA1 channel 7 */
+  __HAL_RCC_DMA1_CLK_ENABLE();
+  hdma_usart2_tx.Instance = DMA1_Channel7;
+  hdma_usart2_tx.Init.Direction = DMA_MEMORY_TO_PERIPH;
+  hdma_usart2_tx.Init.PeriphInc = DMA_PINC_DISABLE;
+  hdma_usart2_tx.Init.MemInc = DMA_MINC_ENABLE;
+  hdma_usart2_tx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+  hdma_usart2_tx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+  hdma_usart2_tx.Init.Mode = DMA_NORMAL;
+  hdma_usart2_tx.Init.Priority = DMA_PRIORITY_MEDIUM;
+  if (HAL_DMA_Init(&hdma_usart2_tx) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  __HAL_LINKDMA(&huart2, hdmatx, hdma_usart2_tx);
+  hdma_usart2_tx.XferCpltCallback = serOnTransmitComplete;
+  hdma_usart2_tx.XferErrorCallback = serOnTransmitError;
+
+  HAL_NVIC_SetPriority(DMA1_Channel7_IRQn, 5, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Channel7_IRQn);
+
+  SET_BIT(huart2.Instance->CR3, USART_CR3_DMAT);
+}
+
+static void serTxStart() {
+  taskENTER_CRITICAL();
+  serTxKick();
+  taskEXIT_CRITICAL();
+}
+
+void MHAL_UART_TxDMA_IRQHandler(UART_HandleTypeDef *huart) {
+  HAL_DMA_IRQHandler(huart->hdmatx);
+}
+
+#else
+
+void serTxInit() {
+  txRing.reset();
+  if (txSpace == NULL) txSpace = xSemaphoreCreateBinary();
 }
 
 int serOnTransmitEmpty() {
-  if (FIFO_EMPTY(TXFIFO)) {
+  uint8_t b;
+  if (!txRing.pop(b)) {
     // buffer underrun
     __HAL_UART_DISABLE_IT(&huart2, UART_IT_TXE);
+
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    xSemaphoreGiveFromISR(txSpace, &xHigherPriorityTaskWoken);
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
     return -1;
   }
 
-  uint8_t b;
-
-  UBaseType_t uxSavedInterruptStatus;
-  uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
-
-    FIFO_POP(TXFIFO, b);
-   
-  taskEXIT_CRITICAL_FROM_ISR(uxSavedInterruptStatus);
-
   huart2.Instance->TDR = b;
   return 0;
 }
 
-int serRead(uint8_t *b) {
-  if (FIFO_EMPTY(RXFIFO)) {
-    HAL_GPIO_WritePin(LD3_GPIO_Port, GPIO_PIN_10, GPIO_PIN_RESET);
-    return -1;
-  }
-  taskENTER_CRITICAL();
-  FIFO_POP(RXFIFO, *b);
-  taskEXIT_CRITICAL();
+static void serTxStart() {
+  __HAL_UART_ENABLE_IT(&huart2, UART_IT_TXE);
+}
+
+uint32_t serTxErrorCount() {
   return 0;
 }
 
+#endif
+
 int serWrite(uint8_t b) {
-  if (FIFO_FULL(TXFIFO)) {
+  if (!txRing.push(b)) {
     // buffer overrun
     return -1;
   }
-  taskENTER_CRITICAL();
-  FIFO_PUSH(TXFIFO, b);
-  taskEXIT_CRITICAL();
 
-  __HAL_UART_ENABLE_IT(&huart2, UART_IT_TXE);
+  serTxStart();
   return 0;
 }
 
-uint16_t serReadCount() {
-  return FIFO_COUNT(RXFIFO);
+/* Queue a whole buffer, blocking the caller until ring space frees up */
+int serWriteBuffer(const uint8_t *data, uint16_t size) {
+  while (size > 0) {
+    uint16_t nPushed = txRing.push(data, size);
+    data += nPushed;
+    size -= nPushed;
+
+    serTxStart();
+
+    if (size > 0) {
+      if (xSemaphoreTake(txSpace, TX_TIMEOUT_MS / portTICK_PERIOD_MS) != pdTRUE) {
+        return -1;
+      }
+    }
+  }
+  return 0;
 }
 
 uint16_t serWriteCount() {
-  return FIFO_COUNT(TXFIFO);
+  return txRing.count();
 }
 
 
 int serWriteString(const char *str) {
-  //HAL_UART_Transmit(&huart2, str, strlen(str), 200);
-  //return 0;
-  
-  uint8_t nRetries = 100;
-  while (*str) {
-    //huart2.Instance->TDR = (*str & (uint8_t)0xFF);
-    //UART_WaitOnFlagUntilTimeout(&huart2, UART_FLAG_TXE, RESET, 200);
-    if (0 != serWrite(*str)) {
-      if (0 == nRetries) return -1;
-      vTaskDelay(10);
-      nRetries--;
-    }
-    else {
-      str++;
-    }
-    //str++;
-  }
-  //UART_WaitOnFlagUntilTimeout(&huart2, UART_FLAG_TC, RESET, 200);
-  return 0;
+  return serWriteBuffer((const uint8_t *)str, strlen(str));
 }
 
 int serReadLine(char *str, uint16_t maxSize) {
-  uint8_t nRetries = 100;
   uint32_t nReceived = 0;
   while (maxSize > 0) {
     if (0 != serRead((uint8_t *)str)) {
-      if (0 == nRetries) break;
-      vTaskDelay(10);
-      nRetries--;
+      if (!serWaitReceive('\n', RX_TIMEOUT_MS)) break;
     }
     else {
       if (*str == '\r' || *str == '\n') break;
@@ -136,11 +385,25 @@ int serReadLine(char *str, uint16_t maxSize) {
 
 
 void UART::init() {
+  /* Cycle counter for wakeup latency measurement */
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
   serInit();
 }
 
 void UART::write(uint8_t b) {
-  serWrite(b);
+  serWriteBuffer(&b, 1);
+}
+
+int UART::write(const uint8_t *data, size_t size) {
+  while (size > 0) {
+    uint16_t chunk = (size > 0xFFFF) ? 0xFFFF : size;
+    if (0 != serWriteBuffer(data, chunk)) return -1;
+    data += chunk;
+    size -= chunk;
+  }
+  return 0;
 }
 
 uint8_t UART::read() {
@@ -152,24 +415,39 @@ int UART::available() {
   return serReadCount();
 }
 
+bool UART::waitReceive(int16_t delim, uint32_t timeoutMs) {
+  return serWaitReceive(delim, timeoutMs);
+}
+
+const UARTLatency & UART::getLatency() {
+  return rxLatency;
+}
+
+uint32_t UART::getOverruns() {
+  return serOverrunCount();
+}
+
+bool UART::takeOverrun() {
+  return serTakeOverrun();
+}
+
+uint32_t UART::getTxErrors() {
+  return serTxErrorCount();
+}
+
 void TextUART::write (const char * string) {
-  while (*string != 0) {
-    UART::write(*string);
-    string++;
-  }
+  UART::write((const uint8_t *)string, strlen(string));
 }
 
 int TextUART::read (char *string, int nChars) {
   int nRead = 0;
   while (nChars > 0) {
-    int nRetries = 200;
-    while (UART::available() == 0) {
-      nRetries--;
-      if (nRetries == 0) {
+    if (UART::available() == 0) {
+      if (!UART::waitReceive(-1, RX_TIMEOUT_MS)) {
         *string = 0;
         return nRead;
       }
-      vTaskDelay(10);
+      continue;
     }
     *string = UART::read();
     nRead++;
@@ -179,21 +457,29 @@ int TextUART::read (char *string, int nChars) {
   return nRead;
 }
 
-int TextUART::readLine (char *string, int nChars, char delim) {
+int TextUART::readLine (char *string, int nChars, char delim, uint32_t timeoutMs, const char *prompt) {
   int nRead = 0;
-  const char *line = string;
+  size_t promptLength = (prompt != NULL) ? strlen(prompt) : 0;
+  TickType_t start = xTaskGetTickCount();
+  TickType_t timeout = pdMS_TO_TICKS(timeoutMs);
+
   while (nChars > 1) {
-    int nRetries = 200;
-    while (UART::available() == 0) {
-      nRetries--;
-      if (nRetries == 0) return nRead;
-      vTaskDelay(10);
+    if (UART::available() == 0) {
+      // Wake on any data, a prompt is not followed by the delimiter
+      TickType_t elapsed = xTaskGetTickCount() - start;
+      if (elapsed >= timeout) break;
+      UART::waitReceive(-1, (timeout - elapsed) * portTICK_PERIOD_MS);
+      continue;
     }
     uint8_t b = UART::read();
     *string++ = b;
     nRead++;
     nChars--;
-    if (b == delim) {      
+    if (b == delim) {
+      break;
+    }
+    if (promptLength > 0 && (size_t)nRead >= promptLength &&
+        0 == memcmp(string - promptLength, prompt, promptLength)) {
       break;
     }
   }
@@ -252,6 +538,15 @@ void MHAL_UART_IRQHandler(UART_HandleTypeDef *huart)
     //HAL_UARTEx_WakeupCallback(huart);
   }
 
+#if UART_RX_DMA
+  /* UART idle line detected (end of receive burst) ---------------------------*/
+  if((__HAL_UART_GET_IT(huart, UART_IT_IDLE) != RESET) && (__HAL_UART_GET_IT_SOURCE(huart, UART_IT_IDLE) != RESET))
+  {
+    __HAL_UART_CLEAR_IDLEFLAG(huart);
+
+    serOnReceiveChunk(false);
+  }
+#else
   /* UART in mode Receiver ---------------------------------------------------*/
   if((__HAL_UART_GET_IT(huart, UART_IT_RXNE) != RESET) && (__HAL_UART_GET_IT_SOURCE(huart, UART_IT_RXNE) != RESET))
   {
@@ -262,7 +557,9 @@ void MHAL_UART_IRQHandler(UART_HandleTypeDef *huart)
 
     serOnReceive();
   }
+#endif
 
+#if !UART_TX_DMA
   /* UART in mode Transmitter ------------------------------------------------*/
   if((__HAL_UART_GET_IT(huart, UART_IT_TXE) != RESET) &&(__HAL_UART_GET_IT_SOURCE(huart, UART_IT_TXE) != RESET))
   {
@@ -272,6 +569,7 @@ void MHAL_UART_IRQHandler(UART_HandleTypeDef *huart)
     
     serOnTransmitEmpty();
   }
+#endif
 
   /* UART in mode Transmitter (transmission end) -----------------------------*/
   if((__HAL_UART_GET_IT(huart, UART_IT_TC) != RESET) &&(__HAL_UART_GET_IT_SOURCE(huart, UART_IT_TC) != RESET))
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <stddef.h>
 
 #include "usart.h"
 
@@ -9,22 +10,51 @@ extern "C" {
 #endif
 
 void MHAL_UART_IRQHandler(UART_HandleTypeDef *huart);
+void MHAL_UART_RxDMA_IRQHandler(UART_HandleTypeDef *huart);
+void MHAL_UART_TxDMA_IRQHandler(UART_HandleTypeDef *huart);
 
 #if defined (__cplusplus)
 }
 #endif
 
+/// Time from a line completing in the RX interrupt to the reader task running
+struct UARTLatency {
+  uint32_t count;
+  uint32_t lastUs;
+  uint32_t maxUs;
+  uint32_t totalUs;
+};
+
 class UART {
 public:
   static void init();
   static void write(uint8_t b);
+  static int write(const uint8_t *data, size_t size);
   static uint8_t read();
   static int available();
+
+  /// Block until delim (or any byte if delim < 0) arrives, false on timeout
+  static bool waitReceive(int16_t delim, uint32_t timeoutMs);
+  static const UARTLatency & getLatency();
+
+  /// Number of times received data was lost because the reader fell behind
+  static uint32_t getOverruns();
+  /// True if received data was lost since the last call
+  static bool takeOverrun();
+  /// Number of transmit chunks dropped on a DMA transfer error
+  static uint32_t getTxErrors();
 };
 
 class TextUART : public UART {
 public:
   static void write (const char * string);  
   static int read (char *string, int nChars);
-  static int readLine (char *string, int nChars, char delim = '\r');
+
+  /**
+   * Read until delim or until the text read ends with prompt (if given),
+   * returns number of bytes read. On timeout returns what was received so
+   * far, which may be a partial line.
+   */
+  static int readLine (char *string, int nChars, char delim = '\r', uint32_t timeoutMs = 2000,
+                       const char *prompt = NULL);
 };
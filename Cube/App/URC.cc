@@ -0,0 +1,69 @@
+#include "URC.hh"
+
+#include <string.h>
+
+struct URCPrefix {
+  const char *prefix;
+  uint8_t     length;
+  URCType     type;
+};
+
+#define URC_PREFIX(str, type)   { str, sizeof(str) - 1, type }
+
+static const URCPrefix urcTable[] = {
+  URC_PREFIX("RING",                 kURCRing),
+  URC_PREFIX("NO CARRIER",           kURCNoCarrier),
+  URC_PREFIX("+CMTI:",               kURCNewSMS),
+  URC_PREFIX("+CGNSINF:",            kURCGNSSInfo),
+  URC_PREFIX("+UGNSINF:",            kURCGNSSInfo),
+  URC_PREFIX("CLOSED",               kURCClosed),
+  URC_PREFIX("+PDP: DEACT",          kURCPDPDeact),
+  URC_PREFIX("+CPIN:",               kURCSIMStatus),
+  URC_PREFIX("Call Ready",           kURCCallReady),
+  URC_PREFIX("SMS Ready",            kURCSMSReady),
+  URC_PREFIX("NORMAL POWER DOWN",    kURCPowerDown),
+  URC_PREFIX("UNDER-VOLTAGE POWER",  kURCPowerDown),
+  URC_PREFIX("OVER-VOLTAGE POWER",   kURCPowerDown),
+  URC_PREFIX("UNDER-VOLTAGE WARN",   kURCVoltageWarning),
+  URC_PREFIX("OVER-VOLTAGE WARN",    kURCVoltageWarning),
+};
+
+static const uint8_t urcTableSize = sizeof(urcTable) / sizeof(urcTable[0]);
+
+URCDispatcher::URCDispatcher() {
+  for (uint8_t idx = 0; idx < kURCCount; idx++) {
+    handlers[idx] = 0;
+    contexts[idx] = 0;
+    counts[idx] = 0;
+  }
+}
+
+URCType URCDispatcher::classify(const char *line) {
+  // "<n>, CLOSED" when multiple connections are enabled
+  if (line[0] >= '0' && line[0] <= '9' && line[1] == ',' && line[2] == ' ') {
+    line += 3;
+  }
+
+  for (uint8_t idx = 0; idx < urcTableSize; idx++) {
+    const URCPrefix &entry = urcTable[idx];
+    if (entry.prefix[0] != line[0]) continue;
+    if (strncmp(line, entry.prefix, entry.length) == 0) {
+      return entry.type;
+    }
+  }
+  return kURCNone;
+}
+
+void URCDispatcher::setHandler(URCType type, Handler handler, void *context) {
+  if (type < 0 || type >= kURCCount) return;
+  handlers[type] = handler;
+  contexts[type] = context;
+}
+
+bool URCDispatcher::dispatch(URCType type, const char *line) {
+  if (type < 0 || type >= kURCCount) return false;
+  counts[type]++;
+  if (!handlers[type]) return false;
+  handlers[type](contexts[type], type, line);
+  return true;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Unsolicited result codes reported by the SIM808.
+ */
+enum URCType {
+  kURCNone = -1,
+  kURCRing = 0,
+  kURCNoCarrier,
+  kURCNewSMS,             // +CMTI: "SM",<index>
+  kURCGNSSInfo,           // +CGNSINF: / +UGNSINF: (CGNSURC reports)
+  kURCClosed,             // CLOSED, <n>, CLOSED
+  kURCPDPDeact,           // +PDP: DEACT
+  kURCSIMStatus,          // +CPIN: <code>
+  kURCCallReady,
+  kURCSMSReady,
+  kURCPowerDown,          // NORMAL POWER DOWN, UNDER/OVER-VOLTAGE POWER DOWN
+  kURCVoltageWarning,     // UNDER/OVER-VOLTAGE WARNNING
+  kURCCount
+};
+
+/**
+ * Classifies modem lines by prefix and routes unsolicited ones to handlers.
+ *
+ * Lines are classified in place (no copy into a second buffer) against a
+ * prefix table built at compile time; the first character rejects most
+ * candidates before any compare.
+ */
+class URCDispatcher {
+public:
+  typedef void (*Handler)(void *context, URCType type, const char *line);
+
+  URCDispatcher();
+
+  /// Returns the URC type for a line, kURCNone for solicited/unknown lines
+  static URCType classify(const char *line);
+
+  void setHandler(URCType type, Handler handler, void *context);
+
+  /// Route a classified line to its handler, false if none is registered
+  bool dispatch(URCType type, const char *line);
+
+  /// Number of URCs seen per type
+  uint32_t getCount(URCType type) const { return counts[type]; }
+
+private:
+  Handler   handlers[kURCCount];
+  void     *contexts[kURCCount];
+  uint32_t  counts[kURCCount];
+};
@@ -4,3 +4,9 @@
 #define GPRS_USER     ""
 #define GPRS_PASS     ""
 
+
+/* Receive the GSM link with circular DMA and IDLE line detection */
+#define UART_RX_DMA   1
+
+/* Transmit to the GSM link with DMA straight from the TX ring */
+#define UART_TX_DMA   1
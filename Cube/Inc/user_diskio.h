@@ -43,11 +43,61 @@
 /* USER CODE BEGIN 0 */
 
 /* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
 /* Exported types ------------------------------------------------------------*/
+
+/* Card waits tracked by the driver */
+typedef enum {
+  SD_WAIT_SELECT = 0,   /* card busy before a command (programming after a write) */
+  SD_WAIT_READ,         /* data token of a read */
+  SD_WAIT_WRITE,        /* busy between blocks of a write */
+  SD_WAIT_ERASE,
+  SD_WAIT_COUNT
+} SD_WaitOp;
+
+/* Wait time histogram, bucket n counts waits below 64 << n us (the last one everything longer) */
+#define SD_WAIT_BUCKETS   12
+
+typedef struct {
+  uint32_t count;
+  uint32_t timeouts;
+  uint32_t maxUs;
+  uint32_t totalUs;
+  uint32_t buckets[SD_WAIT_BUCKETS];
+} SD_WaitStats;
+
+typedef struct {
+  uint32_t hits;        /* single sector accesses served from the cache */
+  uint32_t misses;      /* single sector accesses that took a line */
+  uint32_t writebacks;  /* dirty sectors written to the card */
+} SD_CacheStats;
+
 /* Exported constants --------------------------------------------------------*/
+
+/* Write-back sector cache, sets x ways lines of 512 bytes (LRU within a set) */
+#ifndef SD_CACHE_SETS
+#define SD_CACHE_SETS     1
+#endif
+#ifndef SD_CACHE_WAYS
+#define SD_CACHE_WAYS     4
+#endif
+
 /* Exported functions ------------------------------------------------------- */
 extern Diskio_drvTypeDef  USER_Driver;
 
+const SD_WaitStats * SD_GetWaitStats(SD_WaitOp op);
+void SD_ResetWaitStats(void);
+
+/* Streaming writes to a contiguous region, see user_diskio.c */
+void SD_BeginStream(DWORD sector, DWORD count);
+DRESULT SD_EndStream(void);
+
+/* Sector cache in front of the card, see user_diskio.c */
+const SD_CacheStats * SD_GetCacheStats(void);
+void SD_ResetCacheStats(void);
+DRESULT SD_EnableCache(BYTE enable);
+
 /* USER CODE END 0 */
    
 #ifdef __cplusplus
@@ -41,6 +41,7 @@
 #include "usbd_cdc_if.h"
 #include "config.h"
 #include "App/SIM808.hh"
+#include "App/Console.hh"
 /* USER CODE END Includes */
 
 /* Variables -----------------------------------------------------------------*/
@@ -49,6 +50,7 @@ osThreadId defaultTaskHandle;
 /* USER CODE BEGIN Variables */
 
 osThreadId secondTaskHandle;
+osThreadId consoleTaskHandle;
 extern USBD_HandleTypeDef hUsbDeviceFS;
 
 /* USER CODE END Variables */
@@ -96,6 +98,10 @@ void MX_FREERTOS_Init(void) {
   /* add threads, ... */
   osThreadDef(secondTask, SIM808_Task, osPriorityNormal, 0, 512);
   secondTaskHandle = osThreadCreate(osThread(secondTask), NULL);
+
+  /* FatFs keeps a DIR with its sector buffer on the stack in f_open */
+  osThreadDef(consoleTask, Console_Task, osPriorityBelowNormal, 0, 512);
+  consoleTaskHandle = osThreadCreate(osThread(consoleTask), NULL);
   /* USER CODE END RTOS_THREADS */
 
   /* USER CODE BEGIN RTOS_QUEUES */
@@ -59,6 +59,7 @@ void MX_FREERTOS_Init(void);
 
 /* USER CODE BEGIN PFP */
 /* Private function prototypes -----------------------------------------------*/
+void disk_timerproc(void);
 
 /* USER CODE END PFP */
 
@@ -185,6 +186,9 @@ void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim)
     HAL_IncTick();
   }
 /* USER CODE BEGIN Callback 1 */
+  if (htim->Instance == TIM1) {
+    disk_timerproc();
+  }
 
 /* USER CODE END Callback 1 */
 }
@@ -39,6 +39,7 @@
 /* USER CODE BEGIN 0 */
 
 #include "usart.h"
+#include "spi.h"
 
 /* USER CODE END 0 */
 
@@ -110,5 +111,37 @@ void USART2_IRQHandler(void)
   MHAL_UART_IRQHandler(&huart2);
 }
 
+/**
+* @brief This function handles DMA1 channel6 global interrupt (USART2_RX).
+*/
+void DMA1_Channel6_IRQHandler(void)
+{
+  MHAL_UART_RxDMA_IRQHandler(&huart2);
+}
+
+/**
+* @brief This function handles DMA1 channel7 global interrupt (USART2_TX).
+*/
+void DMA1_Channel7_IRQHandler(void)
+{
+  MHAL_UART_TxDMA_IRQHandler(&huart2);
+}
+
+/**
+* @brief This function handles DMA2 channel1 global interrupt (SPI3_RX, SD card).
+*/
+void DMA2_Channel1_IRQHandler(void)
+{
+  HAL_DMA_IRQHandler(hspi3.hdmarx);
+}
+
+/**
+* @brief This function handles DMA2 channel2 global interrupt (SPI3_TX, SD card).
+*/
+void DMA2_Channel2_IRQHandler(void)
+{
+  HAL_DMA_IRQHandler(hspi3.hdmatx);
+}
+
 /* USER CODE END 1 */
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
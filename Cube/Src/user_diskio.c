@@ -43,9 +43,21 @@
 /* Includes ------------------------------------------------------------------*/
 #include <string.h>
 #include "ff_gen_drv.h"
+#include "user_diskio.h"
 #include "spi.h"
+#include "FreeRTOS.h"
+#include "task.h"
 
 /* Private typedef -----------------------------------------------------------*/
+
+/* Sector cache line */
+typedef struct {
+	DWORD sector;
+	DWORD stamp;		/* CacheClock when last used */
+	BYTE valid;
+	BYTE dirty;			/* Newer than the card */
+} CacheLine;
+
 /* Private define ------------------------------------------------------------*/
 
 /* Define hardware resources (SPI peripheral and various pins used) */
@@ -55,6 +67,15 @@
 #define	MMC_CD		  (GPIO_PIN_RESET == HAL_GPIO_ReadPin(SD_CDET_GPIO_Port, SD_CDET_Pin))
 #define	MMC_WP		  0     /* Write protected (yes:true, no:false, default:false) */
 
+/* Block transfers at least this long go through DMA, shorter ones byte by byte */
+#define DMA_MIN_LENGTH	16
+/* A sector takes ~15 ms at the slowest SPI clock */
+#define DMA_TIMEOUT_MS	100
+/* Card waits poll back to back this long, then once per RTOS tick */
+#define WAIT_SPIN_US	200
+
+#define CACHE_LINES		(SD_CACHE_SETS * SD_CACHE_WAYS)
+
 /* MMC card type flags (MMC_GET_TYPE) */
 #define CT_MMC		0x01		/* MMC ver 3 */
 #define CT_SD1		0x02		/* SD ver 1 */
@@ -96,6 +117,22 @@ static volatile
 static
   BYTE CardType;			/* Card type flags */
 
+static DMA_HandleTypeDef hdma_spi_rx;
+static DMA_HandleTypeDef hdma_spi_tx;
+static TaskHandle_t dmaWaiter;		/* Task sleeping in xfer_spi_dma, NULL if none */
+
+static SD_WaitStats waitStats[SD_WAIT_COUNT];
+
+static DWORD StreamNext;		/* Next sector of the streaming region (SD_BeginStream) */
+static DWORD StreamEnd;			/* End of the streaming region, 0 if none */
+static BYTE StreamOpen;			/* CMD25 of the stream in progress, card selected */
+
+static CacheLine CacheLines[CACHE_LINES];	/* Set n is lines n*SD_CACHE_WAYS.. */
+static BYTE CacheData[CACHE_LINES][512];
+static DWORD CacheClock;
+static BYTE CacheEnabled = 1;
+static SD_CacheStats cacheStats;
+
 /* Private function prototypes -----------------------------------------------*/
            
 DSTATUS USER_initialize (BYTE pdrv);
@@ -124,13 +161,65 @@ Diskio_drvTypeDef  USER_Driver =
 /* Private functions ---------------------------------------------------------*/
 
 
+/* Set up the SPI3 DMA channels (once) */
+static
+void init_spi_dma (void)
+{
+  if (SPI_HANDLE.hdmarx == &hdma_spi_rx) return;
+
+  /* SPI3_RX is mapped to DMA2 channel 1, SPI3_TX to DMA2 channel 2 */
+  __HAL_RCC_DMA2_CLK_ENABLE();
+  hdma_spi_rx.Instance = DMA2_Channel1;
+  hdma_spi_rx.Init.Direction = DMA_PERIPH_TO_MEMORY;
+  hdma_spi_rx.Init.PeriphInc = DMA_PINC_DISABLE;
+  hdma_spi_rx.Init.MemInc = DMA_MINC_ENABLE;
+  hdma_spi_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+  hdma_spi_rx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+  hdma_spi_rx.Init.Mode = DMA_NORMAL;
+  hdma_spi_rx.Init.Priority = DMA_PRIORITY_HIGH;    /* drain RX before feeding TX */
+  if (HAL_DMA_Init(&hdma_spi_rx) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  __HAL_LINKDMA(&SPI_HANDLE, hdmarx, hdma_spi_rx);
+
+  hdma_spi_tx.Instance = DMA2_Channel2;
+  hdma_spi_tx.Init.Direction = DMA_MEMORY_TO_PERIPH;
+  hdma_spi_tx.Init.PeriphInc = DMA_PINC_DISABLE;
+  hdma_spi_tx.Init.MemInc = DMA_MINC_ENABLE;
+  hdma_spi_tx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+  hdma_spi_tx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+  hdma_spi_tx.Init.Mode = DMA_NORMAL;
+  hdma_spi_tx.Init.Priority = DMA_PRIORITY_MEDIUM;
+  if (HAL_DMA_Init(&hdma_spi_tx) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  __HAL_LINKDMA(&SPI_HANDLE, hdmatx, hdma_spi_tx);
+
+  HAL_NVIC_SetPriority(DMA2_Channel1_IRQn, 5, 0);
+  HAL_NVIC_EnableIRQ(DMA2_Channel1_IRQn);
+  HAL_NVIC_SetPriority(DMA2_Channel2_IRQn, 5, 0);
+  HAL_NVIC_EnableIRQ(DMA2_Channel2_IRQn);
+}
+
 /* Initialize MMC interface */
 static
 void init_spi (void)
 {
+	init_spi_dma();
 	CS_HIGH;			/* Set CS# high */
 
-	for (Timer1 = 10; Timer1; ) ;	/* 10ms */
+	/* Wait times are measured with the cycle counter */
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING) {
+		vTaskDelay(pdMS_TO_TICKS(10));
+	}
+	else {
+		for (Timer1 = 10; Timer1; ) ;	/* 10ms */
+	}
 }
 
 /* Exchange a byte */
@@ -146,54 +235,188 @@ BYTE xchg_spi (
 }
 
 
+/* Wake the task waiting for the block transfer (called from the DMA ISR) */
+static
+void dma_done (void)
+{
+  TaskHandle_t waiter = dmaWaiter;
+  if (waiter == NULL) return;
+  dmaWaiter = NULL;
+
+  BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+  vTaskNotifyGiveFromISR(waiter, &xHigherPriorityTaskWoken);
+  portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+void HAL_SPI_TxRxCpltCallback (SPI_HandleTypeDef *hspi)
+{
+  if (hspi == &SPI_HANDLE) dma_done();
+}
+
+void HAL_SPI_ErrorCallback (SPI_HandleTypeDef *hspi)
+{
+  if (hspi == &SPI_HANDLE) dma_done();
+}
+
+/* Exchange a block through DMA. Without tx 0xFF is sent, without rx the
+   received bytes are dropped. The calling task sleeps until completion. */
+static
+int xfer_spi_dma (	/* 1:OK, 0:Error or timeout */
+	const BYTE *tx,	/* Data to send or NULL */
+	BYTE *rx,		/* Receive buffer or NULL */
+	UINT len		/* Number of bytes */
+)
+{
+  static BYTE dummyTx = 0xFF;
+  static BYTE dummyRx;
+
+  /* A constant source or sink must not advance the memory address */
+  if (tx) hdma_spi_tx.Instance->CCR |= DMA_CCR_MINC;
+  else    hdma_spi_tx.Instance->CCR &= ~DMA_CCR_MINC;
+  if (rx) hdma_spi_rx.Instance->CCR |= DMA_CCR_MINC;
+  else    hdma_spi_rx.Instance->CCR &= ~DMA_CCR_MINC;
+
+  int sleep = (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING);
+  if (sleep) {
+    ulTaskNotifyTake(pdTRUE, 0);      /* drop a stale notification */
+    dmaWaiter = xTaskGetCurrentTaskHandle();
+  }
+
+  if (HAL_SPI_TransmitReceive_DMA(&SPI_HANDLE, tx ? (BYTE *)tx : &dummyTx, rx ? rx : &dummyRx, len) != HAL_OK) {
+    dmaWaiter = NULL;
+    return 0;
+  }
+
+  if (sleep) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(DMA_TIMEOUT_MS));
+    dmaWaiter = NULL;
+  }
+  else {
+    uint32_t start = HAL_GetTick();
+    while (HAL_SPI_GetState(&SPI_HANDLE) != HAL_SPI_STATE_READY && HAL_GetTick() - start < DMA_TIMEOUT_MS) ;
+  }
+
+  if (HAL_SPI_GetState(&SPI_HANDLE) != HAL_SPI_STATE_READY) {
+    /* Timed out, take the channels back */
+    HAL_DMA_Abort(&hdma_spi_tx);
+    HAL_DMA_Abort(&hdma_spi_rx);
+    CLEAR_BIT(SPI_HANDLE.Instance->CR2, SPI_CR2_TXDMAEN | SPI_CR2_RXDMAEN);
+    SPI_HANDLE.State = HAL_SPI_STATE_READY;
+    return 0;
+  }
+  return (SPI_HANDLE.ErrorCode == HAL_SPI_ERROR_NONE) ? 1 : 0;
+}
+
+
 /* Receive multiple byte */
 static
-void rcvr_spi_multi (
+int rcvr_spi_multi (	/* 1:OK, 0:Error */
 	BYTE *buff,		/* Pointer to data buffer */
 	UINT btr		/* Number of bytes to receive (even number) */
 )
 {
+  if (btr >= DMA_MIN_LENGTH) return xfer_spi_dma(NULL, buff, btr);
+
   while (btr > 0) {
     *buff++ = xchg_spi(0xFF);
     btr--;
   }
+  return 1;
 }
 
 
 #if _USE_WRITE
 /* Send multiple byte */
 static
-void xmit_spi_multi (
+int xmit_spi_multi (	/* 1:OK, 0:Error */
 	const BYTE *buff,	/* Pointer to the data */
 	UINT btx			/* Number of bytes to send (even number) */
 )
 {
+  if (btx >= DMA_MIN_LENGTH) return xfer_spi_dma(buff, NULL, btx);
+
   while (btx > 0) {
     xchg_spi(*buff++);
     btx--;
   }
+  return 1;
 }
 #endif
 
 
+/*-----------------------------------------------------------------------*/
+/* Card wait pacing and statistics                                       */
+/*-----------------------------------------------------------------------*/
+
+static
+uint32_t cycles_to_us (uint32_t cycles)
+{
+	return cycles / (SystemCoreClock / 1000000);
+}
+
+/* Called between polls of a card wait started at the given cycle count.
+   Short waits are polled back to back, long ones (write programming,
+   erase) sleep a tick between polls so equal priority tasks can run. */
+static
+void wait_pause (
+	uint32_t start	/* DWT cycle count when the wait started */
+)
+{
+	if (cycles_to_us(DWT->CYCCNT - start) < WAIT_SPIN_US) return;
+	if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING) vTaskDelay(1);
+}
+
+static
+void wait_record (
+	SD_WaitOp op,	/* Kind of wait */
+	uint32_t start,	/* DWT cycle count when the wait started */
+	int ok			/* 0 if it timed out */
+)
+{
+	SD_WaitStats *stats = &waitStats[op];
+	uint32_t us = cycles_to_us(DWT->CYCCNT - start);
+	UINT n = 0;
+
+	while (n < SD_WAIT_BUCKETS - 1 && us >= (64UL << n)) n++;
+	stats->buckets[n]++;
+	stats->count++;
+	stats->totalUs += us;
+	if (us > stats->maxUs) stats->maxUs = us;
+	if (!ok) stats->timeouts++;
+}
+
+const SD_WaitStats * SD_GetWaitStats (SD_WaitOp op)
+{
+	return &waitStats[op];
+}
+
+void SD_ResetWaitStats (void)
+{
+	memset(waitStats, 0, sizeof(waitStats));
+}
+
 /*-----------------------------------------------------------------------*/
 /* Wait for card ready                                                   */
 /*-----------------------------------------------------------------------*/
 
 static
 int wait_ready (	/* 1:Ready, 0:Timeout */
-	UINT wt			/* Timeout [ms] */
+	UINT wt,		/* Timeout [ms] */
+	SD_WaitOp op	/* Statistics to record the wait in */
 )
 {
 	BYTE d;
+	uint32_t start = DWT->CYCCNT;
 
 
 	Timer2 = wt;
-	do {
+	for (;;) {
 		d = xchg_spi(0xFF);
-		/* This loop takes a time. Insert rot_rdq() here for multitask envilonment. */
-	} while (d != 0xFF && Timer2);	/* Wait for card goes ready or timeout */
+		if (d == 0xFF || !Timer2) break;	/* Wait for card goes ready or timeout */
+		wait_pause(start);
+	}
 
+	wait_record(op, start, d == 0xFF);
 	return (d == 0xFF) ? 1 : 0;
 }
 
@@ -218,7 +441,7 @@ int select_spi (void)	/* 1:OK, 0:Timeout */
 {
 	CS_LOW;		/* Set CS# low */
 	xchg_spi(0xFF);	/* Dummy clock (force DO enabled) */
-	if (wait_ready(500)) return 1;	/* Wait for card ready */
+	if (wait_ready(500, SD_WAIT_SELECT)) return 1;	/* Wait for card ready */
 
 	deselect_spi();
 	return 0;	/* Timeout */
@@ -282,16 +505,19 @@ int rcvr_datablock (	/* 1:OK, 0:Error */
 )
 {
 	BYTE token;
+	uint32_t start = DWT->CYCCNT;
 
 
 	Timer1 = 200;
-	do {							/* Wait for DataStart token in timeout of 200ms */
+	for (;;) {						/* Wait for DataStart token in timeout of 200ms */
 		token = xchg_spi(0xFF);
-		/* This loop will take a time. Insert rot_rdq() here for multitask envilonment. */
-	} while ((token == 0xFF) && Timer1);
+		if (token != 0xFF || !Timer1) break;
+		wait_pause(start);
+	}
+	wait_record(SD_WAIT_READ, start, token != 0xFF);
 	if(token != 0xFE) return 0;		/* Function fails if invalid DataStart token or timeout */
 
-	rcvr_spi_multi(buff, btr);		/* Store trailing data to the buffer */
+	if (!rcvr_spi_multi(buff, btr)) return 0;	/* Store trailing data to the buffer */
 	xchg_spi(0xFF); xchg_spi(0xFF);			/* Discard CRC */
 
 	return 1;						/* Function succeeded */
@@ -312,11 +538,11 @@ int xmit_datablock (	/* 1:OK, 0:Failed */
 	BYTE resp;
 
 
-	if (!wait_ready(500)) return 0;		/* Wait for card ready */
+	if (!wait_ready(500, SD_WAIT_WRITE)) return 0;		/* Wait for card ready */
 
 	xchg_spi(token);					/* Send token */
 	if (token != 0xFD) {				/* Send data if token is other than StopTran */
-		xmit_spi_multi(buff, 512);		/* Data */
+		if (!xmit_spi_multi(buff, 512)) return 0;	/* Data */
 		xchg_spi(0xFF); xchg_spi(0xFF);	/* Dummy CRC */
 
 		resp = xchg_spi(0xFF);				/* Receive data resp */
@@ -329,6 +555,367 @@ int xmit_datablock (	/* 1:OK, 0:Failed */
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Streaming write                                                       */
+/*-----------------------------------------------------------------------*/
+
+/* Finish the multiple block write of the stream if one is open */
+static
+int stream_close (void)	/* 1:OK, 0:Error */
+{
+	int ok = 1;
+
+#if _USE_WRITE
+	if (StreamOpen) {
+		if (!xmit_datablock(0, 0xFD)) ok = 0;	/* STOP_TRAN token */
+		deselect_spi();
+		StreamOpen = 0;
+	}
+#endif
+	return ok;
+}
+
+#if _USE_WRITE
+/* Write blocks continuing the stream at StreamNext. The first write starts
+   a CMD25 after pre-erasing the rest of the region with ACMD23; the card
+   stays selected between calls until the region is full or something
+   else needs the card. */
+static
+int stream_write (	/* 1:OK, 0:Error */
+	const BYTE *buff,	/* Data to be written */
+	UINT count			/* Number of sectors, within the region */
+)
+{
+	DWORD addr, left;
+
+
+	if (!StreamOpen) {
+		left = StreamEnd - StreamNext;
+		if (left > 0x7FFFFF) left = 0x7FFFFF;		/* ACMD23 takes 23 bits */
+		addr = StreamNext;
+		if (!(CardType & CT_BLOCK)) addr *= 512;	/* LBA ==> BA conversion (byte addressing cards) */
+
+		if (CardType & CT_SDC) send_cmd(ACMD23, left);	/* Pre-erase the rest of the region */
+		if (send_cmd(CMD25, addr) != 0) {	/* WRITE_MULTIPLE_BLOCK */
+			deselect_spi();
+			StreamEnd = 0;
+			return 0;
+		}
+		StreamOpen = 1;
+	}
+
+	do {
+		if (!xmit_datablock(buff, 0xFC)) {
+			stream_close();
+			StreamEnd = 0;			/* Give up streaming this region */
+			return 0;
+		}
+		buff += 512;
+		StreamNext++;
+	} while (--count);
+
+	if (StreamNext == StreamEnd) {	/* Region full */
+		StreamEnd = 0;
+		return stream_close();
+	}
+	return 1;
+}
+#endif
+
+/**
+  * @brief  Announce a region that is about to be written sequentially
+  * @param  sector: First sector of the region (LBA)
+  * @param  count: Number of sectors in the region
+  * @note   In order writes to the region go out as one multiple block write
+  *         that stays open across USER_write calls. Any other disk access
+  *         ends it. The ACMD23 pre-erase is only a hint to the card: sectors
+  *         of the region left unwritten keep undefined contents, old data or
+  *         the erase pattern.
+  */
+void SD_BeginStream (
+	DWORD sector,
+	DWORD count
+)
+{
+	stream_close();
+	StreamNext = sector;
+	StreamEnd = count ? sector + count : 0;
+}
+
+/**
+  * @brief  End the streaming region, finishing its multiple block write
+  * @retval DRESULT: Operation result
+  */
+DRESULT SD_EndStream (void)
+{
+	StreamEnd = 0;
+	return stream_close() ? RES_OK : RES_ERROR;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/* Sector transfers to the card                                          */
+/*-----------------------------------------------------------------------*/
+
+static
+DRESULT card_read (
+	BYTE *buff,		/* Data buffer to store read data */
+	DWORD sector,	/* Sector address in LBA */
+	UINT count		/* Number of sectors to read */
+)
+{
+	if (!stream_close()) return RES_ERROR;		/* The card is ours again */
+
+	if (!(CardType & CT_BLOCK)) sector *= 512;	/* LBA ot BA conversion (byte addressing cards) */
+
+	if (count == 1) {	/* Single sector read */
+		if ((send_cmd(CMD17, sector) == 0)	/* READ_SINGLE_BLOCK */
+			&& rcvr_datablock(buff, 512))
+			count = 0;
+	}
+	else {				/* Multiple sector read */
+		if (send_cmd(CMD18, sector) == 0) {	/* READ_MULTIPLE_BLOCK */
+			do {
+				if (!rcvr_datablock(buff, 512)) break;
+				buff += 512;
+			} while (--count);
+			send_cmd(CMD12, 0);				/* STOP_TRANSMISSION */
+		}
+	}
+	deselect_spi();
+
+	return count ? RES_ERROR : RES_OK;	/* Return result */
+}
+
+#if _USE_WRITE
+static
+DRESULT card_write (
+	const BYTE *buff,	/* Data to be written */
+	DWORD sector,		/* Sector address in LBA */
+	UINT count			/* Number of sectors to write */
+)
+{
+	if (!stream_close()) return RES_ERROR;
+
+	if (!(CardType & CT_BLOCK)) sector *= 512;	/* LBA ==> BA conversion (byte addressing cards) */
+
+	if (count == 1) {	/* Single sector write */
+		if ((send_cmd(CMD24, sector) == 0)	/* WRITE_BLOCK */
+			&& xmit_datablock(buff, 0xFE))
+			count = 0;
+	}
+	else {				/* Multiple sector write */
+		if (CardType & CT_SDC) send_cmd(ACMD23, count);	/* Predefine number of sectors */
+		if (send_cmd(CMD25, sector) == 0) {	/* WRITE_MULTIPLE_BLOCK */
+			do {
+				if (!xmit_datablock(buff, 0xFC)) break;
+				buff += 512;
+			} while (--count);
+			if (!xmit_datablock(0, 0xFD))	/* STOP_TRAN token */
+				count = 1;
+		}
+	}
+	deselect_spi();
+
+	return count ? RES_ERROR : RES_OK;	/* Return result */
+}
+#endif
+
+
+/*-----------------------------------------------------------------------*/
+/* Sector cache                                                          */
+/*-----------------------------------------------------------------------*/
+
+/* FatFs keeps one sector window for the FAT and directories, so allocating
+   clusters and updating directory entries in turn re-reads the same few
+   sectors. Single sector transfers go through a small write-back cache:
+   sector n maps to set n % SD_CACHE_SETS, and the least recently used way
+   of the set is evicted (written back first if dirty). Multiple sector
+   transfers (file data) go to the card and only keep the cache coherent.
+   Dirty sectors reach the card on eviction or CTRL_SYNC. */
+
+static
+CacheLine * cache_lookup (
+	DWORD sector
+)
+{
+	CacheLine *set = &CacheLines[(sector % SD_CACHE_SETS) * SD_CACHE_WAYS];
+	UINT w;
+
+	for (w = 0; w < SD_CACHE_WAYS; w++) {
+		if (set[w].valid && set[w].sector == sector) return &set[w];
+	}
+	return 0;
+}
+
+static
+DRESULT cache_writeback (
+	CacheLine *line
+)
+{
+#if _USE_WRITE
+	if (card_write(CacheData[line - CacheLines], line->sector, 1) != RES_OK) return RES_ERROR;
+	line->dirty = 0;
+	cacheStats.writebacks++;
+#endif
+	return RES_OK;
+}
+
+/* Free a line of the sector's set: an unused one, or else the least
+   recently used one after writing it back. 0 if the write-back failed. */
+static
+CacheLine * cache_alloc (
+	DWORD sector
+)
+{
+	CacheLine *set = &CacheLines[(sector % SD_CACHE_SETS) * SD_CACHE_WAYS];
+	CacheLine *victim = &set[0];
+	UINT w;
+
+	for (w = 0; w < SD_CACHE_WAYS; w++) {
+		if (!set[w].valid) {
+			victim = &set[w];
+			break;
+		}
+		if ((int32_t)(set[w].stamp - victim->stamp) < 0) victim = &set[w];
+	}
+
+	if (victim->valid && victim->dirty && cache_writeback(victim) != RES_OK) return 0;
+	victim->valid = 0;
+	return victim;
+}
+
+/* Write all dirty lines back, in ascending sector order */
+static
+DRESULT cache_flush (void)
+{
+	CacheLine *next;
+	UINT n;
+
+	for (;;) {
+		next = 0;
+		for (n = 0; n < CACHE_LINES; n++) {
+			if (CacheLines[n].valid && CacheLines[n].dirty && (!next || CacheLines[n].sector < next->sector))
+				next = &CacheLines[n];
+		}
+		if (!next) return RES_OK;
+		if (cache_writeback(next) != RES_OK) return RES_ERROR;
+	}
+}
+
+/* Forget the lines of a range written or erased behind the cache */
+static
+void cache_discard (
+	DWORD sector,
+	UINT count
+)
+{
+	UINT n;
+
+	for (n = 0; n < CACHE_LINES; n++) {
+		if (CacheLines[n].valid && CacheLines[n].sector - sector < count) {
+			CacheLines[n].valid = 0;
+			CacheLines[n].dirty = 0;
+		}
+	}
+}
+
+static
+DRESULT cache_read (
+	BYTE *buff,
+	DWORD sector,
+	UINT count
+)
+{
+	CacheLine *line;
+	UINT n;
+
+	if (!CacheEnabled || count > 1) {	/* Straight from the card, patched with newer cached data */
+		if (card_read(buff, sector, count) != RES_OK) return RES_ERROR;
+		for (n = 0; n < CACHE_LINES; n++) {
+			line = &CacheLines[n];
+			if (line->valid && line->dirty && line->sector - sector < count)
+				memcpy(buff + (line->sector - sector) * 512, CacheData[n], 512);
+		}
+		return RES_OK;
+	}
+
+	line = cache_lookup(sector);
+	if (line) {
+		cacheStats.hits++;
+	} else {
+		line = cache_alloc(sector);
+		if (!line || card_read(CacheData[line - CacheLines], sector, 1) != RES_OK) return RES_ERROR;
+		cacheStats.misses++;
+		line->sector = sector;
+		line->valid = 1;
+	}
+	line->stamp = ++CacheClock;
+	memcpy(buff, CacheData[line - CacheLines], 512);
+	return RES_OK;
+}
+
+#if _USE_WRITE
+static
+DRESULT cache_write (
+	const BYTE *buff,
+	DWORD sector,
+	UINT count
+)
+{
+	CacheLine *line;
+
+	if (!CacheEnabled || count > 1) {	/* Straight to the card, replacing cached copies */
+		cache_discard(sector, count);
+		return card_write(buff, sector, count);
+	}
+
+	line = cache_lookup(sector);
+	if (line) {
+		cacheStats.hits++;
+	} else {
+		line = cache_alloc(sector);
+		if (!line) return RES_ERROR;
+		cacheStats.misses++;
+		line->sector = sector;
+		line->valid = 1;
+	}
+	line->stamp = ++CacheClock;
+	line->dirty = 1;
+	memcpy(CacheData[line - CacheLines], buff, 512);
+	return RES_OK;
+}
+#endif
+
+const SD_CacheStats * SD_GetCacheStats (void)
+{
+	return &cacheStats;
+}
+
+void SD_ResetCacheStats (void)
+{
+	memset(&cacheStats, 0, sizeof(cacheStats));
+}
+
+/**
+  * @brief  Turn the sector cache on or off
+  * @param  enable: 0 to write back and drop all lines and go straight to the card
+  * @retval DRESULT: Operation result
+  */
+DRESULT SD_EnableCache (
+	BYTE enable
+)
+{
+	if (!enable && CacheEnabled) {
+		if (cache_flush() != RES_OK) return RES_ERROR;
+		cache_discard(0, 0xFFFFFFFF);
+	}
+	CacheEnabled = enable ? 1 : 0;
+	return RES_OK;
+}
+
+
+
 /* Public functions ---------------------------------------------------------*/
 
 /**
@@ -341,10 +928,13 @@ DSTATUS USER_initialize (
 )
 {
   BYTE n, cmd, ty, ocr[4];
+  uint32_t start;
   
   // Check drive number
   if (0 != pdrv) return STA_NOINIT;       // Support only drive 0
   
+  if (Stat & STA_NOINIT) cache_discard(0, 0xFFFFFFFF);	/* May be another card */
+
   init_spi();		
     
   // Check if card is in the socket
@@ -356,10 +946,11 @@ DSTATUS USER_initialize (
 	ty = 0;
 	if (send_cmd(CMD0, 0) == 1) {			/* Put the card SPI/Idle state */
 		Timer1 = 1000;						/* Initialization timeout = 1 sec */
+		start = DWT->CYCCNT;
 		if (send_cmd(CMD8, 0x1AA) == 1) {	/* SDv2? */
 			for (n = 0; n < 4; n++) ocr[n] = xchg_spi(0xFF);	/* Get 32 bit return value of R7 resp */
 			if (ocr[2] == 0x01 && ocr[3] == 0xAA) {				/* Is the card supports vcc of 2.7-3.6V? */
-				while (Timer1 && send_cmd(ACMD41, 1UL << 30)) ;	/* Wait for end of initialization with ACMD41(HCS) */
+				while (Timer1 && send_cmd(ACMD41, 1UL << 30)) wait_pause(start);	/* Wait for end of initialization with ACMD41(HCS) */
 				if (Timer1 && send_cmd(CMD58, 0) == 0) {		/* Check CCS bit in the OCR */
 					for (n = 0; n < 4; n++) ocr[n] = xchg_spi(0xFF);
 					ty = (ocr[0] & 0x40) ? CT_SD2 | CT_BLOCK : CT_SD2;	/* Card id SDv2 */
@@ -371,7 +962,7 @@ DSTATUS USER_initialize (
 			} else {
 				ty = CT_MMC; cmd = CMD1;	/* MMCv3 (CMD1(0)) */
 			}
-			while (Timer1 && send_cmd(cmd, 0)) ;		/* Wait for end of initialization */
+			while (Timer1 && send_cmd(cmd, 0)) wait_pause(start);	/* Wait for end of initialization */
 			if (!Timer1 || send_cmd(CMD16, 512) != 0)	/* Set block length: 512 */
 				ty = 0;
 		}
@@ -425,25 +1016,7 @@ DRESULT USER_read (
   
 	if (Stat & STA_NOINIT) return RES_NOTRDY;	/* Check if drive is ready */
 
-	if (!(CardType & CT_BLOCK)) sector *= 512;	/* LBA ot BA conversion (byte addressing cards) */
-
-	if (count == 1) {	/* Single sector read */
-		if ((send_cmd(CMD17, sector) == 0)	/* READ_SINGLE_BLOCK */
-			&& rcvr_datablock(buff, 512))
-			count = 0;
-	}
-	else {				/* Multiple sector read */
-		if (send_cmd(CMD18, sector) == 0) {	/* READ_MULTIPLE_BLOCK */
-			do {
-				if (!rcvr_datablock(buff, 512)) break;
-				buff += 512;
-			} while (--count);
-			send_cmd(CMD12, 0);				/* STOP_TRANSMISSION */
-		}
-	}
-	deselect_spi();
-
-	return count ? RES_ERROR : RES_OK;	/* Return result */
+	return cache_read(buff, sector, count);
 }
 
 /**
@@ -469,27 +1042,12 @@ DRESULT USER_write (
 	if (Stat & STA_NOINIT) return RES_NOTRDY;	/* Check drive status */
 	if (Stat & STA_PROTECT) return RES_WRPRT;	/* Check write protect */
 
-	if (!(CardType & CT_BLOCK)) sector *= 512;	/* LBA ==> BA conversion (byte addressing cards) */
-
-	if (count == 1) {	/* Single sector write */
-		if ((send_cmd(CMD24, sector) == 0)	/* WRITE_BLOCK */
-			&& xmit_datablock(buff, 0xFE))
-			count = 0;
-	}
-	else {				/* Multiple sector write */
-		if (CardType & CT_SDC) send_cmd(ACMD23, count);	/* Predefine number of sectors */
-		if (send_cmd(CMD25, sector) == 0) {	/* WRITE_MULTIPLE_BLOCK */
-			do {
-				if (!xmit_datablock(buff, 0xFC)) break;
-				buff += 512;
-			} while (--count);
-			if (!xmit_datablock(0, 0xFD))	/* STOP_TRAN token */
-				count = 1;
-		}
+	if (StreamEnd && sector == StreamNext && count <= StreamEnd - sector) {	/* Continues the stream */
+		cache_discard(sector, count);
+		return stream_write(buff, count) ? RES_OK : RES_ERROR;
 	}
-	deselect_spi();
 
-	return count ? RES_ERROR : RES_OK;	/* Return result */
+	return cache_write(buff, sector, count);
 }
 #endif /* _USE_WRITE == 1 */
 
@@ -514,12 +1072,13 @@ DRESULT USER_ioctl (
 
 	if (0 != pdrv) return RES_PARERR;					/* Check parameter */
 	if (Stat & STA_NOINIT) return RES_NOTRDY;	/* Check if drive is ready */
+	if (!stream_close()) return RES_ERROR;
 
 	res = RES_ERROR;
 
 	switch (cmd) {
-	case CTRL_SYNC :		/* Wait for end of internal write process of the drive */
-		if (select_spi()) res = RES_OK;
+	case CTRL_SYNC :		/* Write back the cache, wait for end of internal write process of the drive */
+		if (cache_flush() == RES_OK && select_spi()) res = RES_OK;
 		break;
 
 	case GET_SECTOR_COUNT :	/* Get drive capacity in unit of sector (DWORD) */
@@ -563,10 +1122,11 @@ DRESULT USER_ioctl (
 		if (USER_ioctl(pdrv, MMC_GET_CSD, csd)) break;	/* Get CSD */
 		if (!(csd[0] >> 6) && !(csd[10] & 0x40)) break;	/* Check if sector erase can be applied to the card */
 		dp = buff; st = dp[0]; ed = dp[1];				/* Load sector block */
+		cache_discard(st, ed - st + 1);
 		if (!(CardType & CT_BLOCK)) {
 			st *= 512; ed *= 512;
 		}
-		if (send_cmd(CMD32, st) == 0 && send_cmd(CMD33, ed) == 0 && send_cmd(CMD38, 0) == 0 && wait_ready(30000))	/* Erase sector block */
+		if (send_cmd(CMD32, st) == 0 && send_cmd(CMD33, ed) == 0 && send_cmd(CMD38, 0) == 0 && wait_ready(30000, SD_WAIT_ERASE))	/* Erase sector block */
 			res = RES_OK;	/* FatFs does not check result of this command */
 		break;
 
@@ -0,0 +1,256 @@
+/*
+ * ATEngine against a scripted fake modem. Runs on the host:
+ *
+ *   g++ -std=gnu++11 -IApp -o atengine_script tests/atengine_script.cpp App/ATEngine.cc App/URC.cc && ./atengine_script
+ *
+ * (from the Cube directory). Each script lists the command lines the modem
+ * expects, in order, and the lines it answers with after a delay. The test
+ * drives the engine with a millisecond clock the way SIM808::process does:
+ * poll() every tick and onLine() for each line that is due.
+ */
+#include "ATEngine.hh"
+
+#include <cstdio>
+#include <cstring>
+
+struct ScriptStep {
+  const char *command;        // expected, with "AT" and CR LF
+  uint32_t    delayMs;        // before the first reply line
+  const char *replies[6];     // answered one per millisecond, 0 terminated
+};
+
+struct Completion {
+  int         count;
+  ATEngine::Result result;
+  char        response[ATEngine::kResponseSize];
+  uint32_t    at;
+};
+
+static int failures = 0;
+
+static void check(bool condition, const char *what) {
+  if (!condition) {
+    std::printf("%s\n", what);
+    failures++;
+  }
+}
+
+/* Fake modem --------------------------------------------------------------*/
+
+class FakeModem {
+public:
+  FakeModem(const ScriptStep *steps, int nSteps)
+    : steps(steps), nSteps(nSteps), next(0), nPending(0), now(0) {}
+
+  static void send(void *context, const char *data) {
+    FakeModem *self = (FakeModem *)context;
+    if (self->next >= self->nSteps) {
+      std::printf("unexpected command %s", data);
+      failures++;
+      return;
+    }
+    const ScriptStep &step = self->steps[self->next++];
+    if (std::strcmp(data, step.command) != 0) {
+      std::printf("expected %s got %s", step.command, data);
+      failures++;
+    }
+    uint32_t due = self->now + step.delayMs;
+    for (int idx = 0; step.replies[idx]; idx++) {
+      self->pending[self->nPending].line = step.replies[idx];
+      self->pending[self->nPending].due = due + idx;
+      self->nPending++;
+    }
+  }
+
+  /// Feed the due lines to the engine, returns false once nothing is left
+  bool deliver(ATEngine &at) {
+    while (nPending > 0 && pending[0].due <= now) {
+      const char *line = pending[0].line;
+      nPending--;
+      std::memmove(pending, pending + 1, nPending * sizeof(pending[0]));
+      at.onLine(line, now);
+    }
+    return nPending > 0;
+  }
+
+  bool done() const { return next == nSteps && nPending == 0; }
+
+  const ScriptStep *steps;
+  int nSteps;
+  int next;
+
+  struct Pending {
+    const char *line;
+    uint32_t due;
+  } pending[32];
+  int nPending;
+
+  uint32_t now;
+};
+
+static void run(FakeModem &modem, ATEngine &at, uint32_t untilMs) {
+  for (modem.now = 0; modem.now < untilMs; modem.now++) {
+    at.poll(modem.now);
+    modem.deliver(at);
+    if (at.idle() && modem.done()) return;
+  }
+}
+
+/* Callbacks ---------------------------------------------------------------*/
+
+static uint32_t *testClock = 0;
+
+static void onComplete(void *context, ATEngine::Result result, const char *response) {
+  Completion *completion = (Completion *)context;
+  completion->count++;
+  completion->result = result;
+  std::strncpy(completion->response, response, sizeof(completion->response) - 1);
+  completion->at = testClock ? *testClock : 0;
+}
+
+static int urcCount[kURCCount];
+static char lastUnsolicited[64];
+
+static void onURC(void *context, URCType type, const char *line) {
+  urcCount[type]++;
+}
+
+static void onUnsolicited(void *context, const char *line) {
+  std::strncpy(lastUnsolicited, line, sizeof(lastUnsolicited) - 1);
+}
+
+/* Tests -------------------------------------------------------------------*/
+
+static void testResponses() {
+  static const ScriptStep script[] = {
+    { "AT+CBC\r\n",  20, { "AT+CBC", "+CBC: 0,80,4100", "", "OK", 0 } },
+    { "AT+CREG?;+CGATT?\r\n", 5, { "+CREG: 0,1", "+CGATT: 1", "OK", 0 } },
+  };
+  FakeModem modem(script, 2);
+  ATEngine at(FakeModem::send, &modem);
+  testClock = &modem.now;
+
+  Completion battery = Completion(), status = Completion();
+  check(at.submit("+CBC", "+CBC:", 1000, onComplete, &battery), "submit +CBC");
+  check(at.submit("+CREG?;+CGATT?", "+CREG:|+CGATT:", 1000, onComplete, &status), "submit +CREG");
+  run(modem, at, 5000);
+
+  check(modem.done(), "responses: script not finished");
+  check(battery.count == 1 && battery.result == ATEngine::kOK, "+CBC not OK");
+  check(std::strcmp(battery.response, "+CBC: 0,80,4100") == 0, "+CBC response");
+  check(status.count == 1 && status.result == ATEngine::kOK, "+CREG not OK");
+  check(std::strcmp(status.response, "+CREG: 0,1\n+CGATT: 1") == 0, "+CREG|+CGATT response");
+  // Pipelined: the second command went out when the first completed
+  check(status.at == battery.at + 5 + 2, "second command not sent right after the first");
+}
+
+static void testInterleavedURCs() {
+  static const ScriptStep script[] = {
+    { "AT+CREG?\r\n", 10, { "+CREG: 0,5", "RING", "+CMTI: \"SM\",3", "+PDP: DEACT", "OK", 0 } },
+    { "AT+CGNSINF\r\n", 10, { "+UGNSINF: 1,1,20160101000000.000", "+CGNSINF: 1,1,20160101000001.000", "OK", 0 } },
+    { "AT+CSQ\r\n", 10, { "+CSQ: 20,0", "stray line", "OK", 0 } },
+  };
+  FakeModem modem(script, 3);
+  ATEngine at(FakeModem::send, &modem);
+  URCDispatcher urc;
+  std::memset(urcCount, 0, sizeof(urcCount));
+  lastUnsolicited[0] = '\0';
+  for (int type = 0; type < kURCCount; type++) {
+    urc.setHandler((URCType)type, onURC, 0);
+  }
+  at.setURCDispatcher(&urc);
+  at.setUnsolicitedHandler(onUnsolicited, 0);
+
+  Completion creg = Completion(), gnss = Completion(), csq = Completion();
+  at.submit("+CREG?", "+CREG:", 1000, onComplete, &creg);
+  at.submit("+CGNSINF", "+CGNSINF:", 1000, onComplete, &gnss);
+  at.submit("+CSQ", "+CSQ:", 1000, onComplete, &csq);
+  run(modem, at, 5000);
+
+  check(std::strcmp(creg.response, "+CREG: 0,5") == 0, "URCs leaked into +CREG response");
+  check(urcCount[kURCRing] == 1 && urcCount[kURCNewSMS] == 1 && urcCount[kURCPDPDeact] == 1,
+        "URCs during +CREG not dispatched");
+  // A URC prefix the command asked for is part of its response
+  check(std::strcmp(gnss.response, "+CGNSINF: 1,1,20160101000001.000") == 0, "+CGNSINF response");
+  check(urcCount[kURCGNSSInfo] == 1, "+UGNSINF during +CGNSINF not dispatched");
+  check(std::strcmp(csq.response, "+CSQ: 20,0") == 0, "+CSQ response");
+  check(std::strcmp(lastUnsolicited, "stray line") == 0, "other line not passed on");
+}
+
+static void testErrorFinals() {
+  static const ScriptStep script[] = {
+    { "AT+CPIN=1234\r\n", 10, { "ERROR", 0 } },
+    { "AT+CMGS=\"123\"\r\n", 10, { "+CMS ERROR: 304", 0 } },
+    { "AT+CGATT=1\r\n", 10, { "+CME ERROR: 30", 0 } },
+    { "AT+CIPSEND=5\r\n", 10, { ">", "SEND OK", 0 } },
+  };
+  FakeModem modem(script, 4);
+  ATEngine at(FakeModem::send, &modem);
+
+  Completion pin = Completion(), sms = Completion(), attach = Completion(), send = Completion();
+  at.submit("+CPIN=1234", 0, 1000, onComplete, &pin);
+  at.submit("+CMGS=\"123\"", 0, 1000, onComplete, &sms);
+  at.submit("+CGATT=1", 0, 1000, onComplete, &attach);
+  at.submit("+CIPSEND=5", 0, 1000, onComplete, &send, "SEND OK");
+  run(modem, at, 5000);
+
+  check(pin.count == 1 && pin.result == ATEngine::kError, "ERROR not final");
+  check(sms.result == ATEngine::kCMEError && std::strcmp(sms.response, "+CMS ERROR: 304") == 0,
+        "+CMS ERROR not final");
+  check(attach.result == ATEngine::kCMEError && std::strcmp(attach.response, "+CME ERROR: 30") == 0,
+        "+CME ERROR not final");
+  check(send.result == ATEngine::kOK && std::strcmp(send.response, ">\nSEND OK") == 0,
+        "command specific final");
+  check(at.idle(), "engine not idle after errors");
+}
+
+static void testTimeouts() {
+  static const ScriptStep script[] = {
+    { "AT+CGNSPWR=1\r\n", 10, { 0 } },          // never answers
+    { "AT+CBC\r\n", 10, { "+CBC: 0,79,4090", "OK", 0 } },
+  };
+  FakeModem modem(script, 2);
+  ATEngine at(FakeModem::send, &modem);
+  testClock = &modem.now;
+
+  Completion power = Completion(), battery = Completion();
+  at.submit("+CGNSPWR=1", 0, 500, onComplete, &power);
+  at.submit("+CBC", "+CBC:", 1000, onComplete, &battery);
+
+  at.poll(0);
+  check(at.timeUntilDeadline(0) == 500 && at.timeUntilDeadline(200) == 300, "time until deadline");
+  check(at.timeUntilDeadline(700) == 0, "deadline not clamped");
+  run(modem, at, 5000);
+
+  check(power.count == 1 && power.result == ATEngine::kTimeout, "no timeout");
+  check(power.at == 500, "timed out at the wrong time");
+  check(battery.result == ATEngine::kOK && std::strcmp(battery.response, "+CBC: 0,79,4090") == 0,
+        "command after a timeout");
+  check(at.timeUntilDeadline(modem.now) == UINT32_MAX, "deadline while idle");
+}
+
+static void testQueueFull() {
+  FakeModem modem(0, 0);
+  ATEngine at(FakeModem::send, &modem);
+  for (int idx = 0; idx < ATEngine::kQueueSize; idx++) {
+    check(at.submit("+CSQ", 0, 1000), "queue rejected a command");
+  }
+  check(!at.submit("+CSQ", 0, 1000), "queue accepted one command too many");
+
+  char tooLong[ATEngine::kCommandSize];
+  std::memset(tooLong, 'A', sizeof(tooLong) - 1);
+  tooLong[sizeof(tooLong) - 1] = '\0';
+  ATEngine empty(FakeModem::send, &modem);
+  check(!empty.submit(tooLong, 0, 1000), "command too long accepted");
+}
+
+int main() {
+  testResponses();
+  testInterleavedURCs();
+  testErrorFinals();
+  testTimeouts();
+  testQueueFull();
+
+  std::printf("%s\n", failures ? "FAILED" : "OK");
+  return failures ? 1 : 0;
+}
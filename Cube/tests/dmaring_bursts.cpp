@@ -0,0 +1,182 @@
+/*
+ * DMARxRing fed by a simulated circular DMA channel. Runs on the host:
+ *
+ *   g++ -std=gnu++11 -IApp -o dmaring_bursts tests/dmaring_bursts.cpp && ./dmaring_bursts
+ *
+ * (from the Cube directory). The simulated channel writes a numbered byte
+ * sequence into the ring memory and commits the way the UART interrupts
+ * do: at the half and full transfer events (HT/TC, optionally late) and
+ * on the IDLE line after each burst. The reader checks that the sequence
+ * arrives complete and in order, and that overruns are reported exactly
+ * when the DMA gets a whole buffer ahead.
+ */
+#include "DMARing.hh"
+
+#include <cstdio>
+
+static const uint16_t kSize = 64;
+
+static int failures = 0;
+
+static void check(bool condition, const char *what) {
+  if (!condition) {
+    std::printf("%s\n", what);
+    failures++;
+  }
+}
+
+class DMAChannel {
+public:
+  DMAChannel(DMARxRing<kSize> &ring) : ring(ring), pos(0), next(0), late(0), pendingHalf(false), pendingFull(false) {}
+
+  /// Receive n bytes, commit at HT/TC (late bytes after the event) and IDLE
+  void burst(uint16_t n, bool idle = true) {
+    for (uint16_t idx = 0; idx < n; idx++) {
+      ring.data()[pos] = (uint8_t)next++;
+      pos++;
+      if (pos == kSize / 2) {
+        pendingHalf = true;
+        delay = late;
+      }
+      if (pos == kSize) {
+        // NDTR reloads, the channel continues at the start
+        pos = 0;
+        pendingFull = true;
+        delay = late;
+      }
+      if ((pendingHalf || pendingFull) && delay-- == 0) events();
+    }
+    events();
+    if (idle) ring.commit(pos, false);
+  }
+
+  /// Bytes between an event and its interrupt handler
+  void setLatency(uint16_t bytes) { late = bytes; }
+
+  uint8_t sent() const { return next; }
+
+private:
+  DMARxRing<kSize> &ring;
+  uint16_t pos;
+  uint8_t  next;
+  uint16_t late, delay;
+  bool     pendingHalf, pendingFull;
+
+  void events() {
+    if (pendingHalf) {
+      pendingHalf = false;
+      ring.commit(pos, true);
+    }
+    if (pendingFull) {
+      pendingFull = false;
+      ring.commit(pos, true);
+    }
+  }
+};
+
+/// Read everything and check it continues the sequence at expected
+static bool drain(DMARxRing<kSize> &ring, uint8_t &expected) {
+  uint8_t buf[kSize];
+  bool ordered = true;
+  uint16_t n;
+  while ((n = ring.read(buf, 7)) > 0) {
+    for (uint16_t idx = 0; idx < n; idx++) {
+      if (buf[idx] != expected++) ordered = false;
+    }
+  }
+  return ordered;
+}
+
+static void testSmallBursts() {
+  DMARxRing<kSize> ring;
+  DMAChannel dma(ring);
+  uint8_t expected = 0;
+
+  for (int idx = 0; idx < 100; idx++) {
+    uint32_t last = ring.committed();
+    dma.burst(1 + idx % 13);
+    check(ring.committed() - last == (uint32_t)(1 + idx % 13), "IDLE commit size");
+    check(ring.contains(last, (uint8_t)(dma.sent() - 1)), "contains() missed the last byte");
+    check(drain(ring, expected), "small bursts out of order");
+  }
+  check(ring.getOverruns() == 0 && !ring.takeLost(), "overrun on small bursts");
+}
+
+static void testBoundaries() {
+  // Bursts spanning HT, TC and the wrap, with the reader a burst behind
+  for (uint16_t latency = 0; latency < 8; latency += 7) {
+    DMARxRing<kSize> ring;
+    DMAChannel dma(ring);
+    dma.setLatency(latency);
+    uint8_t expected = 0;
+
+    for (int idx = 0; idx < 50; idx++) {
+      dma.burst(17 + idx % 29);
+      check(drain(ring, expected), "boundary bursts out of order");
+    }
+    check(expected == dma.sent(), "boundary bursts incomplete");
+    check(ring.getOverruns() == 0, "overrun on boundary bursts");
+  }
+
+  // One long burst without an IDLE in between: only HT/TC commit
+  DMARxRing<kSize> ring;
+  DMAChannel dma(ring);
+  uint8_t expected = 0;
+  for (int idx = 0; idx < 10; idx++) {
+    dma.burst(kSize / 2, false);
+    check(ring.available() == kSize / 2, "HT/TC commit size");
+    check(drain(ring, expected), "HT/TC data out of order");
+  }
+}
+
+static void testOverrunAtSize() {
+  // One byte short of a full buffer unread: everything is still there
+  {
+    DMARxRing<kSize> ring;
+    DMAChannel dma(ring);
+    dma.burst(10);
+    dma.burst(kSize - 11);
+    uint8_t expected = 0;
+    check(ring.available() == kSize - 1, "size - 1 bytes not available");
+    check(ring.getOverruns() == 0 && !ring.takeLost(), "overrun at size - 1");
+    check(drain(ring, expected) && expected == kSize - 1, "size - 1 bytes damaged");
+  }
+
+  // Exactly a full buffer unread: the DMA position meets the reader and
+  // its next byte overwrites unread data, so this already counts
+  {
+    DMARxRing<kSize> ring;
+    DMAChannel dma(ring);
+    dma.burst(10);
+    dma.burst(kSize - 10);
+    check(ring.committed() == kSize, "full lap not committed");
+    check(ring.getOverruns() == 1, "no overrun at exactly size");
+    check(ring.takeLost() && ring.available() == 0, "full buffer not skipped");
+    check(!ring.takeLost(), "lost flag not cleared");
+
+    // The reader picks up with the next burst
+    dma.burst(5);
+    uint8_t expected = kSize;
+    check(drain(ring, expected) && expected == kSize + 5, "data after the overrun");
+  }
+
+  // More than two laps in one burst: the HT/TC count keeps the total
+  {
+    DMARxRing<kSize> ring;
+    DMAChannel dma(ring);
+    dma.burst(3);
+    dma.burst(2 * kSize + 20);
+    check(ring.committed() == 2 * kSize + 23, "laps lost from the total");
+    check(ring.getOverruns() == 1 && ring.takeLost(), "overrun not counted once over two laps");
+    check(ring.available() == 0, "overwritten data still available");
+  }
+}
+
+int main() {
+  testSmallBursts();
+  testBoundaries();
+  testOverrunAtSize();
+
+  std::printf("%s\n", failures ? "FAILED" : "OK");
+  return failures ? 1 : 0;
+}
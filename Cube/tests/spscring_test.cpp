@@ -0,0 +1,157 @@
+/*
+ * SPSCRing unit tests. Runs on the host:
+ *
+ *   g++ -std=gnu++11 -O2 -pthread -IApp -o spscring_test tests/spscring_test.cpp && ./spscring_test
+ *
+ * (from the Cube directory). Covers the single item and bulk interfaces,
+ * the contiguous reserve/commit and peek/consume regions at the wrap,
+ * the free running 16-bit indices rolling over, and a producer and a
+ * consumer thread sharing a ring without locks.
+ */
+#include "Ring.hh"
+
+#include <cstdio>
+#include <thread>
+
+static int failures = 0;
+
+static void check(bool condition, const char *what) {
+  if (!condition) {
+    std::printf("%s\n", what);
+    failures++;
+  }
+}
+
+static void testSingle() {
+  SPSCRing<uint8_t, 8> ring;
+  uint8_t b;
+  check(ring.empty() && !ring.full() && ring.capacity() == 8, "new ring not empty");
+  check(!ring.pop(b), "pop from empty ring");
+
+  for (uint8_t idx = 0; idx < 8; idx++) {
+    check(ring.push(idx), "push into ring with space");
+  }
+  check(ring.full() && ring.count() == 8 && ring.space() == 0, "ring not full");
+  check(!ring.push(99), "push into full ring");
+
+  for (uint8_t idx = 0; idx < 8; idx++) {
+    check(ring.pop(b) && b == idx, "pop order");
+  }
+  check(ring.empty(), "ring not empty after popping all");
+
+  ring.push(1);
+  ring.reset();
+  check(ring.empty(), "reset left data");
+}
+
+static void testBulk() {
+  SPSCRing<uint16_t, 16> ring;
+  uint16_t src[40], dst[40];
+  for (uint16_t idx = 0; idx < 40; idx++) src[idx] = 1000 + idx;
+
+  // Offset the indices so every bulk transfer crosses the wrap
+  for (int idx = 0; idx < 11; idx++) {
+    uint16_t v;
+    ring.push(idx);
+    ring.pop(v);
+  }
+  check(ring.push(src, 40) == 16, "bulk push past capacity");
+  check(ring.pop(dst, 10) == 10, "bulk pop");
+  check(ring.push(src + 16, 24) == 10, "bulk push into the freed space");
+  check(ring.pop(dst + 10, 40) == 16, "bulk pop of the rest");
+  bool ordered = true;
+  for (uint16_t idx = 0; idx < 26; idx++) {
+    if (dst[idx] != 1000 + idx) ordered = false;
+  }
+  check(ordered, "bulk data out of order");
+}
+
+static void testRegions() {
+  SPSCRing<uint8_t, 16> ring;
+  for (int idx = 0; idx < 12; idx++) {
+    uint8_t b;
+    ring.push(0);
+    ring.pop(b);
+  }
+
+  // Free space is 16, contiguous only up to the end of the buffer
+  uint16_t n;
+  uint8_t *dst = ring.reserve(n);
+  check(n == 4, "reserve not clipped at the wrap");
+  for (uint16_t idx = 0; idx < n; idx++) dst[idx] = 'a' + idx;
+  ring.commit(n);
+  dst = ring.reserve(n);
+  check(n == 12, "reserve after the wrap");
+  for (uint16_t idx = 0; idx < 3; idx++) dst[idx] = 'e' + idx;
+  ring.commit(3);
+  check(ring.count() == 7, "commit count");
+
+  const uint8_t *src = ring.peek(n);
+  check(n == 4 && src[0] == 'a' && src[3] == 'd', "peek not clipped at the wrap");
+  ring.consume(n);
+  src = ring.peek(n);
+  check(n == 3 && src[0] == 'e' && src[2] == 'g', "peek after the wrap");
+  ring.consume(n);
+  src = ring.peek(n);
+  check(n == 0 && ring.empty(), "peek on empty ring");
+}
+
+static void testIndexRollover() {
+  // 16-bit indices roll over after 65536 items, the count must not notice
+  SPSCRing<uint32_t, 4> ring;
+  uint32_t next = 0, expected = 0;
+  bool ordered = true;
+  for (uint32_t round = 0; round < 70000; round++) {
+    while (ring.push(next)) next++;
+    if (!ring.full()) ordered = false;
+    uint32_t v;
+    for (int idx = 0; idx < 3; idx++) {
+      if (!ring.pop(v) || v != expected++) ordered = false;
+    }
+  }
+  check(ordered, "order or count lost at the index rollover");
+}
+
+static void testThreads() {
+  static SPSCRing<uint32_t, 64> ring;
+  const uint32_t kItems = 200000;
+  bool ordered = true;
+
+  std::thread producer([&]() {
+    uint32_t next = 0;
+    while (next < kItems) {
+      uint16_t n;
+      uint32_t *dst = ring.reserve(n);
+      if (n == 0) {
+        std::this_thread::yield();
+        continue;
+      }
+      if (n > kItems - next) n = kItems - next;
+      for (uint16_t idx = 0; idx < n; idx++) dst[idx] = next++;
+      ring.commit(n);
+    }
+  });
+
+  uint32_t expected = 0;
+  while (expected < kItems) {
+    uint32_t v;
+    if (!ring.pop(v)) {
+      std::this_thread::yield();
+      continue;
+    }
+    if (v != expected++) ordered = false;
+  }
+  producer.join();
+  check(ordered && ring.empty(), "items lost or reordered between threads");
+}
+
+int main() {
+  testSingle();
+  testBulk();
+  testRegions();
+  testIndexRollover();
+  testThreads();
+
+  std::printf("%s\n", failures ? "FAILED" : "OK");
+  return failures ? 1 : 0;
+}
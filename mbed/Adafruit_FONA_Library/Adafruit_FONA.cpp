@@ -123,9 +123,35 @@ void Adafruit_FONA::onSerialDataReceived() {
             }
             
             currentReceivedLineSize = 0;
+            
+            if (strncmp(currentReceivedLine, "+UGNSINF: ", 10) == 0) {
+                onGPSReport();
+                continue;
+            }
         }
         
         incrementRxBufferInIndex();
+        
+        if (data == '\n') {
+            currentLineStartIndex = rxBufferInIndex;
+        }
+    }
+}
+
+void Adafruit_FONA::onGPSReport() {
+    strncpy(gpsReport, currentReceivedLine + 10, sizeof(gpsReport) - 1);
+    gpsReport[sizeof(gpsReport) - 1] = 0;
+    gpsReportCount++;
+    
+    // Drop the report from the rx buffer so that it is never mistaken for a
+    // command reply, unless the reader has already started consuming it
+    int lineLength = (rxBufferInIndex - currentLineStartIndex + RX_BUFFER_SIZE) % RX_BUFFER_SIZE;
+    int consumed = (rxBufferOutIndex - currentLineStartIndex + RX_BUFFER_SIZE) % RX_BUFFER_SIZE;
+    if (consumed == 0 || consumed > lineLength) {
+        rxBufferInIndex = currentLineStartIndex;
+    } else {
+        incrementRxBufferInIndex();
+        currentLineStartIndex = rxBufferInIndex;
     }
 }
 
@@ -680,6 +706,66 @@ bool Adafruit_FONA::getGPS(float *lat, float *lon, float *altitude) {
     return true;
 }
 
+bool Adafruit_FONA::enableGPSReports(uint8_t period) {
+    // period = number of fixes between +UGNSINF reports, 0 = off
+    return sendCheckReply("AT+CGNSURC=", period, "OK");
+}
+
+uint32_t Adafruit_FONA::getGPSReport(char *buffer, uint8_t maxbuff) {
+    __disable_irq(); // The report is rewritten from the rx interrupt
+    
+    uint32_t count = gpsReportCount;
+    strncpy(buffer, gpsReport, maxbuff - 1);
+    buffer[maxbuff - 1] = 0;
+    
+    __enable_irq();
+    
+    return count;
+}
+
+bool Adafruit_FONA::getStatus(Status *status, char *gpsbuffer, uint8_t maxbuff) {
+    status->networkStatus = 0;
+    status->gpsStatus = -1;
+    status->gprsState = 0;
+    status->battVoltage = 0;
+    status->battPercent = 0;
+    
+    // The queries are concatenated into a single line, the module answers
+    // each of them in order followed by one final OK
+    getReply(gpsbuffer ? "AT+CBC;+CREG?;+CGATT?;+CGNSINF" : "AT+CBC;+CREG?;+CGATT?");
+    
+    while (true) {
+        if (replybuffer[0] == 0) return false;  // timeout
+        if (strcmp(replybuffer, "OK") == 0) break;
+        if (strcmp(replybuffer, "ERROR") == 0) return false;
+        
+        uint16_t value;
+        if (parseReply("+CBC: ", &value, ',', 1)) {
+            status->battPercent = value;
+            parseReply("+CBC: ", &status->battVoltage, ',', 2);
+        }
+        else if (parseReply("+CREG: ", &value, ',', 1)) {
+            status->networkStatus = value;
+        }
+        else if (parseReply("+CGATT: ", &value)) {
+            status->gprsState = value;
+        }
+        else if (gpsbuffer && strncmp(replybuffer, "+CGNSINF: ", 10) == 0) {
+            char *p = replybuffer + 10;
+            // same interpretation as GPSstatus()
+            if (p[0] == '0') status->gpsStatus = 0;
+            else status->gpsStatus = (p[2] == '1') ? 3 : 1;
+            
+            strncpy(gpsbuffer, p, maxbuff - 1);
+            gpsbuffer[maxbuff - 1] = 0;
+        }
+        
+        readline();
+    }
+    
+    return true;
+}
+
 bool Adafruit_FONA::enableGPSNMEA(uint8_t i) {
     char sendbuff[15] = "AT+CGPSOUT=000";
     sendbuff[11] = (i / 100) + '0';
@@ -860,6 +946,9 @@ bool Adafruit_FONA::TCPconnect(char *server, uint16_t port) {
     // single connection at a time
     if (! sendCheckReply("AT+CIPMUX=0", "OK") ) return false;
     
+    // in quick send mode CIPSEND returns as soon as the data is buffered
+    if (! sendCheckReply("AT+CIPQSEND=", _quickSend ? 1 : 0, "OK") ) return false;
+    
     // manually read data
     if (! sendCheckReply("AT+CIPRXGET=1", "OK") ) return false;
     
@@ -887,7 +976,20 @@ bool Adafruit_FONA::TCPconnected(void) {
     return (strcmp(replybuffer, "STATE: CONNECT OK") == 0);
 }
 
-bool Adafruit_FONA::TCPsend(char *packet, uint8_t len) {
+void Adafruit_FONA::TCPquickSend(bool onoff) {
+    _quickSend = onoff;
+}
+
+bool Adafruit_FONA::TCPunacked(uint16_t *sent, uint16_t *unacked) {
+    // +CIPACK: <txlen>,<acklen>,<nacklen>
+    getReply("AT+CIPACK");
+    if (! parseReply("+CIPACK: ", sent, ',', 0)) return false;
+    if (! parseReply("+CIPACK: ", unacked, ',', 2)) return false;
+    readline(); // eat 'OK'
+    return true;
+}
+
+bool Adafruit_FONA::TCPsend(char *packet, uint16_t len) {
 #ifdef ADAFRUIT_FONA_DEBUG
     printf("AT+CIPSEND=%d\r\n", len);
     
@@ -913,6 +1015,9 @@ bool Adafruit_FONA::TCPsend(char *packet, uint8_t len) {
     printf("\t<--- %s\r\n", replybuffer);
 #endif
     
+    if (_quickSend) {
+        return (strncmp(replybuffer, "DATA ACCEPT:", 12) == 0);
+    }
     return (strcmp(replybuffer, "SEND OK") == 0);
 }
 
@@ -73,8 +73,8 @@ class Adafruit_FONA : public Stream {
         Adafruit_FONA(PinName tx, PinName rx, PinName rst, PinName ringIndicator) :
             _rstpin(rst, false), _ringIndicatorInterruptIn(ringIndicator),
             apn("FONAnet"), apnusername(NULL), apnpassword(NULL), httpsredirect(false), useragent("FONA"),
-            _incomingCall(false), eventListener(NULL), mySerial(tx, rx), rxBufferInIndex(0), rxBufferOutIndex(0), 
-            currentReceivedLineSize(0) {}
+            _incomingCall(false), _quickSend(false), eventListener(NULL), mySerial(tx, rx), rxBufferInIndex(0), rxBufferOutIndex(0), 
+            currentReceivedLineSize(0), currentLineStartIndex(0), gpsReportCount(0) {}
         bool begin(int baudrate);
         void setEventListener(EventListener *eventListener);
         
@@ -144,11 +144,27 @@ class Adafruit_FONA : public Stream {
         bool getGPS(float *lat, float *lon, float *altitude=0);
         bool enableGPSNMEA(uint8_t nmea);
         
+        // GPS reports pushed by the module (AT+CGNSURC), captured in the rx interrupt
+        bool enableGPSReports(uint8_t period);
+        uint32_t getGPSReport(char *buffer, uint8_t maxbuff);
+        
+        // Status snapshot (battery, network, GPRS and optionally GPS) in one command line
+        struct Status {
+            uint8_t networkStatus;  // as getNetworkStatus()
+            int8_t gpsStatus;       // as GPSstatus(), only if a GPS buffer is passed
+            uint8_t gprsState;      // as GPRSstate()
+            uint16_t battVoltage;   // mV
+            uint16_t battPercent;
+        };
+        bool getStatus(Status *status, char *gpsbuffer = 0, uint8_t maxbuff = 0);
+        
         // TCP raw connections
         bool TCPconnect(char *server, uint16_t port);
         bool TCPclose(void);
         bool TCPconnected(void);
-        bool TCPsend(char *packet, uint8_t len);
+        bool TCPsend(char *packet, uint16_t len);
+        void TCPquickSend(bool onoff); // takes effect on the next TCPconnect
+        bool TCPunacked(uint16_t *sent, uint16_t *unacked);
         uint16_t TCPavailable(void);
         uint16_t TCPread(uint8_t *buff, uint8_t len);
         
@@ -199,6 +215,7 @@ class Adafruit_FONA : public Stream {
         char* useragent;
         
         volatile bool _incomingCall;
+        bool _quickSend;
         EventListener *eventListener;
         Serial mySerial;
         
@@ -208,6 +225,11 @@ class Adafruit_FONA : public Stream {
         volatile int rxBufferOutIndex; // Index where data is removed from the buffer
         char currentReceivedLine[RX_BUFFER_SIZE]; // Array containing the current received line
         int currentReceivedLineSize;
+        int currentLineStartIndex; // Index in rxBuffer where the current line starts
+        
+        // Latest +UGNSINF payload and the number of reports received so far
+        char gpsReport[120];
+        volatile uint32_t gpsReportCount;
         
         inline bool isRxBufferFull() {
             return ((rxBufferInIndex + 1) % RX_BUFFER_SIZE) == rxBufferOutIndex;
@@ -230,6 +252,11 @@ class Adafruit_FONA : public Stream {
          */
         void onSerialDataReceived();
         
+        /**
+         * Store a +UGNSINF report and remove its line from the rx buffer (interrupt routine).
+         */
+        void onGPSReport();
+        
         // HTTP helpers
         bool HTTP_setup(char *url);
         
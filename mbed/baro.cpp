@@ -1,81 +1,114 @@
 #include "baro.h"
 
-MS5607::MS5607(I2C &bus, byte subAddress) : _bus(bus) {
+MS5607::MS5607(I2CBus &bus, byte subAddress) : _bus(bus) {
   _address = (0x76 | (subAddress & 1)) << 1;
 }
     
 bool MS5607::reset() {
-  char cmd = kCmdReset;
-  return 0 == _bus.write(_address, &cmd, 1);
+  I2CTransaction transaction(_address);
+  transaction.write[0] = kCmdReset;
+  transaction.writeLength = 1;
+  return _bus.transact(transaction);
 }
 
 bool MS5607::readPROM(byte address, word &result) {
-  byte cmd[1];
-  cmd[0] = kCmdReadPROM | ((address & 0x07) << 1);
-  if (0 != _bus.write(_address, (char *)cmd, 1)) {
-    return false;
-  }
-  
-  byte reply[2];
-  if (0 != _bus.read(_address, (char *)reply, 2)) {
+  I2CTransaction transaction(_address);
+  transaction.write[0] = kCmdReadPROM | ((address & 0x07) << 1);
+  transaction.writeLength = 1;
+  transaction.readLength = 2;
+  if (!_bus.transact(transaction)) {
     return false;
   }
 
-  result = ((word)reply[0] << 8) | reply[1];
+  result = ((word)transaction.read[0] << 8) | transaction.read[1];
   return true;
 }
 
 bool MS5607::startConversion(ConversionType type, OversamplingRate osr) {
-  byte cmd[1];
-  cmd[0] = kCmdConvert | ((byte)type << 4) | ((byte)osr << 1);
-  return 0 == _bus.write(_address, (char *)cmd, 1);
+  I2CTransaction transaction(_address);
+  transaction.write[0] = kCmdConvert | ((byte)type << 4) | ((byte)osr << 1);
+  transaction.writeLength = 1;
+  return _bus.transact(transaction);
 }
 
 bool MS5607::readResult24(long &result) {
-  byte cmd[1];
-  cmd[0] = kCmdReadADC;
-  if (0 != _bus.write(_address, (char *)cmd, 1)) {
-    return false;
-  }
-  
-  byte reply[3];
-  if (0 != _bus.read(_address, (char *)reply, 3)) {
+  I2CTransaction transaction(_address);
+  transaction.write[0] = kCmdReadADC;
+  transaction.writeLength = 1;
+  transaction.readLength = 3;
+  if (!_bus.transact(transaction)) {
     return false;
   }
  
-  result = ((long)reply[0] << 16) | ((word)reply[1] << 8) | reply[2];
+  result = toResult24(transaction);
   return true;
 }
 
 bool MS5607::readResult16(word &result) {
-  byte cmd[1];
-  cmd[0] = kCmdReadADC;
-  if (0 != _bus.write(_address, (char *)cmd, 1)) {
+  I2CTransaction transaction(_address);
+  transaction.write[0] = kCmdReadADC;
+  transaction.writeLength = 1;
+  transaction.readLength = 2;
+  if (!_bus.transact(transaction)) {
     return false;
   }
   
-  byte reply[2];
-  if (0 != _bus.read(_address, (char *)reply, 2)) {
-    return false;
-  }
-  
-  result = ((word)reply[0] << 8) | reply[1];
+  result = ((word)transaction.read[0] << 8) | transaction.read[1];
   return true;
 }
 
-Barometer::Barometer(I2C &bus, byte subaddress) 
+bool MS5607::queueConversion(ConversionType type, OversamplingRate osr) {
+  I2CTransaction transaction(_address);
+  transaction.write[0] = kCmdConvert | ((byte)type << 4) | ((byte)osr << 1);
+  transaction.writeLength = 1;
+  return _bus.submit(transaction);
+}
+
+bool MS5607::queueResult24(void (*callback)(const I2CTransaction &), void *context) {
+  I2CTransaction transaction(_address);
+  transaction.write[0] = kCmdReadADC;
+  transaction.writeLength = 1;
+  transaction.readLength = 3;
+  transaction.callback = callback;
+  transaction.context = context;
+  return _bus.submit(transaction);
+}
+
+// Maximum conversion time per oversampling rate in us (datasheet)
+static const uint16_t conversionTime[] = { 600, 1170, 2280, 4540, 9040 };
+
+Barometer::Barometer(I2CBus &bus, byte subaddress) 
   : MS5607(bus, subaddress) 
 {
-  
+  t = 0;
+  p = 0;
+  _timer = 0;
+  _callback = 0;
+  _osrPressure = kOSR4096;
+  _osrTemperature = kOSR1024;
+  _tempInterval = 8;
+  _sinceTemperature = 0;
+  _converting = false;
+  _conversion = kTemperature;
+  _haveTemperature = false;
+  _samples = 0;
 }
 
+Barometer::~Barometer()
+{
+  delete _timer;
+}
+
+/**
+ * Reads the calibration PROM, fails if it does not pass its CRC4
+ */
 bool Barometer::initialize() 
 {
-  for (byte idx = 0; idx < 7; idx++) {
+  for (byte idx = 0; idx < 8; idx++) {
     if (!readPROM(idx, PROM[idx])) 
       return false;
   }
-  return true;
+  return compensation.setPROM(PROM);
 }
 
 /**
@@ -87,34 +120,112 @@ bool Barometer::update() {
     return false;
   }
  
-  wait_ms(2);
+  wait_us(conversionTime[kOSR1024]);
   long d2;
   if (!readResult24(d2)) {
     return false;
   }
-  int32_t dt = d2 - ((int32_t)PROM[5] << 8);
-  t = 2000 + ((dt * PROM[6]) >> 23);
+  compensateTemperature(d2);
   
   if (!startConversion(kPressure, kOSR4096)) {
     return false;
   }
 
-  wait_ms(10);
+  wait_us(conversionTime[kOSR4096]);
   long d1;
   if (!readResult24(d1)) {
     return false;
   }
-  uint64_t off  = ((uint64_t)PROM[2] << 17) + ((PROM[4] * (int64_t)dt) >> 6);
-  uint64_t sens = ((uint64_t)PROM[1] << 16) + ((PROM[3] * (int64_t)dt) >> 7);
-  p = (((d1 * sens) >> 21) - off) >> 15;
-
-  //uint16_t off  = PROM[2] + ((PROM[4] * (int32_t)dt) >> 15);
-  //uint16_t sens = PROM[1] + ((PROM[3] * (int32_t)dt) >> 15);
-  //p = (((uint32_t)d1 * sens) >> 14) - off;
+  compensatePressure(d1);
 
   return true;
 }
 
+void Barometer::compensateTemperature(long d2) {
+  compensation.setTemperature(d2);
+  t = compensation.getTemperature();
+}
+
+void Barometer::compensatePressure(long d1) {
+  p = compensation.getPressure(d1);
+}
+
+bool Barometer::startSampling(uint32_t periodMs, uint8_t tempInterval) {
+  // Highest oversampling that finishes within the period, with timer jitter to spare
+  int osr = kOSR256;
+  while (osr < kOSR4096 && conversionTime[osr + 1] + 500 <= periodMs * 1000) {
+    osr++;
+  }
+  if (conversionTime[osr] + 500 > periodMs * 1000) return false;
+
+  _osrPressure = (OversamplingRate)osr;
+  _osrTemperature = (osr > kOSR1024) ? kOSR1024 : (OversamplingRate)osr;
+  _tempInterval = tempInterval;
+  _sinceTemperature = 0;
+  _converting = false;
+  _haveTemperature = false;
+
+  if (!_timer) {
+    _timer = new RtosTimer(onTimer, osTimerPeriodic, this);
+  }
+  return _timer->start(periodMs) == osOK;
+}
+
+void Barometer::stopSampling() {
+  if (_timer) {
+    _timer->stop();
+  }
+  _converting = false;
+}
+
+void Barometer::onTimer(void const *argument) {
+  ((Barometer *)argument)->sample();
+}
+
+void Barometer::onTemperature(const I2CTransaction &transaction) {
+  Barometer *barometer = (Barometer *)transaction.context;
+  long result = toResult24(transaction);
+  // The ADC reads 0 if the conversion was not finished
+  if (transaction.success && result != 0) {
+    barometer->compensateTemperature(result);
+    barometer->_haveTemperature = true;
+  }
+}
+
+void Barometer::onPressure(const I2CTransaction &transaction) {
+  Barometer *barometer = (Barometer *)transaction.context;
+  long result = toResult24(transaction);
+  if (transaction.success && result != 0 && barometer->_haveTemperature) {
+    barometer->compensatePressure(result);
+    barometer->_samples++;
+    if (barometer->_callback) barometer->_callback();
+  }
+}
+
+void Barometer::sample() {
+  // The conversion started on the previous tick is done by now, the bus
+  // runs the read before the next conversion start queued below
+  if (_converting) {
+    _converting = false;
+    queueResult24((_conversion == kTemperature) ? onTemperature : onPressure, this);
+  }
+
+  // Temperature first, then once per tempInterval pressure conversions
+  ConversionType next = kPressure;
+  if (!_haveTemperature || _sinceTemperature >= _tempInterval) {
+    next = kTemperature;
+    _sinceTemperature = 0;
+  }
+  else {
+    _sinceTemperature++;
+  }
+  
+  if (queueConversion(next, (next == kTemperature) ? _osrTemperature : _osrPressure)) {
+    _conversion = next;
+    _converting = true;
+  }
+}
+
 /// Returns temperature in Celsium x100 (2000 = 20.00 C)
 int16_t Barometer::getTemperature() {
   return t;
@@ -1,4 +1,8 @@
 #include "mbed.h"
+#include "rtos.h"
+
+#include "i2cbus.h"
+#include "ms5607comp.h"
 
 
 #define ARRAY_SIZE(x)      (sizeof(x) / sizeof(x[0]))
@@ -24,16 +28,27 @@ public:
 
 class MS5607 : public MS5607Base {
 public:
-  MS5607(I2C &bus, byte subAddress = 0);
+  MS5607(I2CBus &bus, byte subAddress = 0);
   
+  /// These wait for the bus, not to be called from a bus callback
   bool reset();
   bool readPROM(byte address, word &result);
   bool startConversion(ConversionType type, OversamplingRate osr = kOSR256);
   bool readResult24(long &result);
   bool readResult16(word &result);
+  
+  /// Queue a conversion start without waiting
+  bool queueConversion(ConversionType type, OversamplingRate osr = kOSR256);
+  
+  /// Queue an ADC read, callback gets the 3 result bytes in read[]
+  bool queueResult24(void (*callback)(const I2CTransaction &), void *context);
+  
+  static long toResult24(const I2CTransaction &transaction) {
+    return ((long)transaction.read[0] << 16) | ((word)transaction.read[1] << 8) | transaction.read[2];
+  }
     
 private:
-  I2C     _bus;
+  I2CBus &_bus;
   uint8_t _address;
   
   enum Commands {
@@ -47,15 +62,35 @@ private:
 class Barometer : public MS5607 {
 public:
 
-  Barometer(I2C &bus, byte subaddress = 0);
+  Barometer(I2CBus &bus, byte subaddress = 0);
+  ~Barometer();
 
   bool initialize();
   
   /**
-   * Measures and updates both temperature and pressure
+   * Measures and updates both temperature and pressure (blocks ~11.5 ms)
    */
   bool update();
   
+  /**
+   * Sample in the background instead of update(). Every period ms an RTOS
+   * timer callback queues the read of the conversion started on the
+   * previous tick and the start of the next one, a temperature conversion
+   * after every tempInterval pressure conversions. No thread waits for a
+   * conversion or the bus; results are compensated in the bus thread as
+   * the reads complete. The oversampling is
+   * the highest that completes within the period (OSR 4096 at 10 ms).
+   * Do not call update() while sampling.
+   */
+  bool startSampling(uint32_t periodMs = 10, uint8_t tempInterval = 8);
+  void stopSampling();
+  
+  /// Called from the bus thread after each new pressure value
+  void attach(void (*fptr)(void)) { _callback = fptr; }
+  
+  /// Pressure values produced by background sampling so far
+  uint32_t getSampleCount() { return _samples; }
+  
   /// Returns temperature in Celsium x100 (2000 = 20.00 C)
   int16_t getTemperature();
   
@@ -64,6 +99,26 @@ public:
     
 private:
   uint16_t PROM[8];
+  MS5607Compensation compensation;
   int16_t  t;        // temperature in Celsium x100 (2000 = 20.00 C)
   uint32_t p;        // pressure in Pascals (100000 = 100000 Pa = 1000 mbar)
+  
+  RtosTimer *       _timer;
+  void            (*_callback)(void);
+  OversamplingRate  _osrPressure;
+  OversamplingRate  _osrTemperature;
+  uint8_t           _tempInterval;
+  uint8_t           _sinceTemperature;
+  bool              _converting;
+  ConversionType    _conversion;
+  bool              _haveTemperature;
+  volatile uint32_t _samples;
+  
+  void compensateTemperature(long d2);
+  void compensatePressure(long d1);
+  
+  static void onTimer(void const *argument);
+  static void onTemperature(const I2CTransaction &transaction);
+  static void onPressure(const I2CTransaction &transaction);
+  void sample();
 };
@@ -0,0 +1,485 @@
+#include "binproto.h"
+#include "crc.h"
+
+#include <cstring>
+
+enum {
+  kStatusKeyframe   = 0x01,
+  kStatusFix        = 0x02,
+  kStatusBatteryLow = 0x04,
+  kStatusExtPower   = 0x08
+};
+
+static uint8_t putVarint(uint8_t *buf, uint32_t value) {
+  uint8_t n = 0;
+  while (value >= 0x80) {
+    buf[n++] = (value & 0x7F) | 0x80;
+    value >>= 7;
+  }
+  buf[n++] = value;
+  return n;
+}
+
+static uint8_t putSigned(uint8_t *buf, int32_t value) {
+  // zigzag: small magnitudes of either sign give short varints
+  return putVarint(buf, ((uint32_t)value << 1) ^ (uint32_t)(value >> 31));
+}
+
+static bool getVarint(const uint8_t *&ptr, const uint8_t *end, uint32_t &value) {
+  value = 0;
+  for (uint8_t shift = 0; shift < 35; shift += 7) {
+    if (ptr >= end) return false;
+    uint8_t b = *ptr++;
+    value |= (uint32_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) return true;
+  }
+  return false;
+}
+
+static bool getSigned(const uint8_t *&ptr, const uint8_t *end, int32_t &value) {
+  uint32_t raw;
+  if (!getVarint(ptr, end, raw)) return false;
+  value = (int32_t)(raw >> 1) ^ -(int32_t)(raw & 1);
+  return true;
+}
+
+static void packIMEI(uint8_t *bcd, const char *imei) {
+  // 15 digits, packed two per byte, high nibble first, padded with 0xF
+  memset(bcd, 0xFF, 8);
+  for (uint8_t idx = 0; idx < 16 && imei[idx] >= '0' && imei[idx] <= '9'; idx++) {
+    uint8_t digit = imei[idx] - '0';
+    if (idx & 1) {
+      bcd[idx / 2] = (bcd[idx / 2] & 0xF0) | digit;
+    }
+    else {
+      bcd[idx / 2] = (digit << 4) | 0x0F;
+    }
+  }
+}
+
+static void unpackIMEI(char *imei, const uint8_t *bcd) {
+  uint8_t n = 0;
+  for (uint8_t idx = 0; idx < 8; idx++) {
+    uint8_t hi = bcd[idx] >> 4;
+    uint8_t lo = bcd[idx] & 0x0F;
+    if (hi < 10) imei[n++] = '0' + hi;
+    if (lo < 10) imei[n++] = '0' + lo;
+  }
+  imei[n] = '\0';
+}
+
+static uint8_t packBattery(uint16_t mv) {
+  mv = (mv < 2000) ? 0 : (mv - 2000) / 10;
+  return (mv > 255) ? 255 : mv;
+}
+
+static uint16_t unpackBattery(uint8_t battery) {
+  return (battery == 0) ? 0 : 2000 + battery * 10;
+}
+
+static uint8_t packStatus(const PositionReport &report) {
+  uint8_t sats = (report.satCount > 15) ? 15 : report.satCount;
+  uint8_t status = sats << 4;
+  if (report.fix)           status |= kStatusFix;
+  if (report.batteryLow)    status |= kStatusBatteryLow;
+  if (report.externalPower) status |= kStatusExtPower;
+  return status;
+}
+
+static void unpackStatus(PositionReport &report, uint8_t status) {
+  report.satCount = status >> 4;
+  report.fix = (status & kStatusFix) != 0;
+  report.batteryLow = (status & kStatusBatteryLow) != 0;
+  report.externalPower = (status & kStatusExtPower) != 0;
+}
+
+/* Days since 2000-01-01 for a Gregorian date */
+static int32_t daysSince2000(int year, int month, int day) {
+  if (month <= 2) {
+    year--;
+    month += 12;
+  }
+  int32_t days = 365L * year + year / 4 - year / 100 + year / 400 + (153 * (month - 3) + 2) / 5 + day;
+  return days - 730426L;    // same formula for 2000-01-01
+}
+
+static int parseDigits(const char *str, uint8_t count) {
+  int value = 0;
+  while (count--) {
+    value = value * 10 + (*str++ - '0');
+  }
+  return value;
+}
+
+PositionReport::PositionReport()
+  : time(0), latitude(0), longitude(0), altitude(0), speed(0), course(0), satCount(0),
+    fix(false), batteryLow(false), externalPower(false), batteryVoltage(0)
+{
+}
+
+bool PositionReport::set(const GNSSFix &gnss) {
+  // yyyyMMddhhmmss.sss
+  const char *dt = gnss.datetime;
+  if (strlen(dt) < 14) return false;
+
+  int32_t days = daysSince2000(parseDigits(dt, 4), parseDigits(dt + 4, 2), parseDigits(dt + 6, 2));
+  time = days * 86400L + parseDigits(dt + 8, 2) * 3600L + parseDigits(dt + 10, 2) * 60 + parseDigits(dt + 12, 2);
+
+  // round to nearest
+  latitude = gnss.latitude;
+  longitude = gnss.longitude;
+  altitude = (gnss.altitude + (gnss.altitude < 0 ? -50 : 50)) / 100;
+  speed = (gnss.speed + 5) / 10;
+  course = ((gnss.course + 50) / 100) % 360;
+  satCount = gnss.satsUsed;
+  fix = gnss.valid;
+  return true;
+}
+
+BinaryEncoder::BinaryEncoder(uint8_t keyframeInterval) {
+  memset(_imei, 0, sizeof(_imei));
+  _keyframeInterval = keyframeInterval;
+  _sinceKeyframe = keyframeInterval;
+}
+
+void BinaryEncoder::setIMEI(const char *imei) {
+  packIMEI(_imei, imei);
+}
+
+uint16_t BinaryEncoder::encode(const PositionReport &report, uint8_t *buf, uint16_t bufSize) {
+  bool keyframe = (_sinceKeyframe >= _keyframeInterval);
+
+  uint16_t size = encodeFrame(report, keyframe, buf, bufSize);
+  if (size == 0) return 0;
+
+  if (keyframe) _sinceKeyframe = 0;
+  _sinceKeyframe++;
+  _last = report;
+  return size;
+}
+
+uint16_t BinaryEncoder::encodeKeyframe(const PositionReport &report, uint8_t *buf, uint16_t bufSize) {
+  return encodeFrame(report, true, buf, bufSize);
+}
+
+uint16_t BinaryEncoder::chain(const uint8_t *data, uint16_t length, uint8_t *buf, uint16_t bufSize) {
+  _sinceKeyframe = _keyframeInterval;
+
+  uint16_t used = 0;
+  uint16_t pos = 0;
+  while (pos < length) {
+    const uint8_t *frame = data + pos;
+    uint16_t left = length - pos;
+    uint16_t frameSize = 0;
+
+    if (frame[0] == kSync && left >= 4 && left >= 2 + frame[1] + 2) {
+      frameSize = 2 + frame[1] + 2;
+
+      PositionReport report;
+      bool valid;
+      BinaryDecoder decoder;
+      if (decoder.decode(frame, frameSize, report, valid) == frameSize) {
+        // A delta is only valid against the frame it was encoded after
+        if (valid && (frame[2] & kStatusKeyframe)) {
+          uint8_t out[kMaxFrameSize];
+          uint16_t size = encode(report, out, sizeof(out));
+          if (size > bufSize - used) break;
+          memcpy(buf + used, out, size);
+          used += size;
+        }
+        pos += frameSize;
+        continue;
+      }
+      frameSize = 0;
+    }
+    else if (frame[0] == BatchEncoder::kSync && left >= 5) {
+      frameSize = 3 + (frame[1] | (frame[2] << 8)) + 2;
+      CRC16<0xA001, true> crc;
+      if (frameSize > BatchEncoder::kMaxFrameSize || frameSize > left ||
+          crc.update(frame + 1, frameSize - 3) != (frame[frameSize - 2] | (frame[frameSize - 1] << 8))) {
+        frameSize = 0;
+      }
+    }
+
+    // Batch frame or a byte of text
+    if (frameSize == 0) frameSize = 1;
+    if (frameSize > bufSize - used) break;
+    memcpy(buf + used, frame, frameSize);
+    used += frameSize;
+    pos += frameSize;
+  }
+  return used;
+}
+
+uint16_t BinaryEncoder::encodeFrame(const PositionReport &report, bool keyframe, uint8_t *buf, uint16_t bufSize) {
+  if (bufSize < kMaxFrameSize) return 0;
+
+  uint8_t status = packStatus(report);
+  if (keyframe)             status |= kStatusKeyframe;
+
+  uint8_t *ptr = buf + 2;
+  *ptr++ = status;
+
+  if (keyframe) {
+    memcpy(ptr, _imei, sizeof(_imei));
+    ptr += sizeof(_imei);
+    ptr += putVarint(ptr, report.time);
+    ptr += putSigned(ptr, report.latitude);
+    ptr += putSigned(ptr, report.longitude);
+    ptr += putSigned(ptr, report.altitude);
+  }
+  else {
+    ptr += putVarint(ptr, report.time - _last.time);
+    ptr += putSigned(ptr, report.latitude - _last.latitude);
+    ptr += putSigned(ptr, report.longitude - _last.longitude);
+    ptr += putSigned(ptr, report.altitude - _last.altitude);
+  }
+
+  ptr += putVarint(ptr, report.speed);
+  ptr += putVarint(ptr, report.course);
+
+  *ptr++ = packBattery(report.batteryVoltage);
+
+  uint8_t length = ptr - (buf + 2);
+  buf[0] = kSync;
+  buf[1] = length;
+
+  CRC16<0xA001, true> crc;
+  uint16_t checksum = crc.update(buf + 1, length + 1);
+  *ptr++ = checksum & 0xFF;
+  *ptr++ = checksum >> 8;
+
+  return ptr - buf;
+}
+
+BinaryDecoder::BinaryDecoder() {
+  _imei[0] = '\0';
+  _haveBase = false;
+}
+
+uint16_t BinaryDecoder::decode(const uint8_t *data, uint16_t length, PositionReport &report, bool &valid) {
+  valid = false;
+
+  // Resynchronize on the sync byte
+  uint16_t skip = 0;
+  while (skip < length && data[skip] != BinaryEncoder::kSync) skip++;
+  if (skip > 0) return skip;
+
+  if (length < 2) return 0;
+  uint16_t frameSize = 2 + data[1] + 2;
+  if (length < frameSize) return 0;
+
+  CRC16<0xA001, true> crc;
+  uint16_t checksum = data[frameSize - 2] | (data[frameSize - 1] << 8);
+  if (crc.update(data + 1, data[1] + 1) != checksum) {
+    // A lost frame breaks the delta chain until the next keyframe
+    _haveBase = false;
+    return 1;   // skip the false sync byte
+  }
+
+  const uint8_t *ptr = data + 2;
+  const uint8_t *end = data + frameSize - 2;
+  uint8_t status = *ptr++;
+
+  unpackStatus(report, status);
+
+  // Until the frame is complete the chain has no base either
+  bool haveBase = _haveBase;
+  _haveBase = false;
+
+  uint32_t time;
+  int32_t latitude, longitude, altitude;
+  if (status & kStatusKeyframe) {
+    if (end - ptr < 8) return frameSize;
+    unpackIMEI(_imei, ptr);
+    ptr += 8;
+
+    if (!getVarint(ptr, end, time)) return frameSize;
+    if (!getSigned(ptr, end, latitude)) return frameSize;
+    if (!getSigned(ptr, end, longitude)) return frameSize;
+    if (!getSigned(ptr, end, altitude)) return frameSize;
+  }
+  else {
+    if (!haveBase) return frameSize;
+    if (!getVarint(ptr, end, time)) return frameSize;
+    if (!getSigned(ptr, end, latitude)) return frameSize;
+    if (!getSigned(ptr, end, longitude)) return frameSize;
+    if (!getSigned(ptr, end, altitude)) return frameSize;
+    time += _last.time;
+    latitude += _last.latitude;
+    longitude += _last.longitude;
+    altitude += _last.altitude;
+  }
+
+  uint32_t speed, course;
+  if (!getVarint(ptr, end, speed)) return frameSize;
+  if (!getVarint(ptr, end, course)) return frameSize;
+  if (ptr >= end) return frameSize;
+  uint8_t battery = *ptr++;
+
+  report.time = time;
+  report.latitude = latitude;
+  report.longitude = longitude;
+  report.altitude = altitude;
+  report.speed = speed;
+  report.course = course;
+  report.batteryVoltage = unpackBattery(battery);
+
+  _last = report;
+  _haveBase = true;
+  valid = true;
+  return frameSize;
+}
+
+uint16_t BinaryDecoder::decodeBatch(const uint8_t *data, uint16_t length, PositionReport *reports,
+                                    uint8_t maxReports, uint8_t &count)
+{
+  count = 0;
+
+  uint16_t skip = 0;
+  while (skip < length && data[skip] != BatchEncoder::kSync) skip++;
+  if (skip > 0) return skip;
+
+  if (length < 3) return 0;
+  uint16_t bodyLength = data[1] | (data[2] << 8);
+  uint16_t frameSize = 3 + bodyLength + 2;
+  if (frameSize > BatchEncoder::kMaxFrameSize) return 1;
+  if (length < frameSize) return 0;
+
+  CRC16<0xA001, true> crc;
+  uint16_t checksum = data[frameSize - 2] | (data[frameSize - 1] << 8);
+  if (crc.update(data + 1, bodyLength + 2) != checksum) {
+    return 1;
+  }
+
+  const uint8_t *ptr = data + 3;
+  const uint8_t *end = data + frameSize - 2;
+  if (end - ptr < 11) return frameSize;
+
+  uint8_t flags = *ptr++;
+  unpackIMEI(_imei, ptr);
+  ptr += 8;
+  uint16_t batteryVoltage = unpackBattery(*ptr++);
+  uint8_t total = *ptr++;
+
+  uint32_t time;
+  if (!getVarint(ptr, end, time)) return frameSize;
+
+  PositionReport last;
+  uint8_t decoded = 0;
+  for (uint8_t idx = 0; idx < total && decoded < maxReports; idx++) {
+    PositionReport report;
+    if (ptr >= end) break;
+    unpackStatus(report, *ptr++);
+    report.batteryLow = (flags & kStatusBatteryLow) != 0;
+    report.externalPower = (flags & kStatusExtPower) != 0;
+    report.batteryVoltage = batteryVoltage;
+
+    uint32_t dt = 0;
+    int32_t latitude, longitude, altitude;
+    if (idx > 0 && !getVarint(ptr, end, dt)) break;
+    if (!getSigned(ptr, end, latitude)) break;
+    if (!getSigned(ptr, end, longitude)) break;
+    if (!getSigned(ptr, end, altitude)) break;
+
+    uint32_t speed, course;
+    if (!getVarint(ptr, end, speed)) break;
+    if (!getVarint(ptr, end, course)) break;
+
+    if (idx == 0) {
+      report.time = time;
+      report.latitude = latitude;
+      report.longitude = longitude;
+      report.altitude = altitude;
+    }
+    else {
+      report.time = last.time + dt;
+      report.latitude = last.latitude + latitude;
+      report.longitude = last.longitude + longitude;
+      report.altitude = last.altitude + altitude;
+    }
+    report.speed = speed;
+    report.course = course;
+
+    reports[decoded++] = report;
+    last = report;
+  }
+
+  count = decoded;
+  return frameSize;
+}
+
+BatchEncoder::BatchEncoder() {
+  memset(_imei, 0, sizeof(_imei));
+  _count = 0;
+  _length = 0;
+}
+
+void BatchEncoder::setIMEI(const char *imei) {
+  packIMEI(_imei, imei);
+}
+
+bool BatchEncoder::add(const PositionReport &report) {
+  if (_count >= kMaxReports) return false;
+
+  // Worst case size of one report: status, 4 varints of 5 bytes, 2 of 3 bytes
+  uint8_t buf[1 + 4 * 5 + 2 * 3];
+  uint8_t *ptr = buf;
+
+  *ptr++ = packStatus(report);
+  if (_count == 0) {
+    ptr += putSigned(ptr, report.latitude);
+    ptr += putSigned(ptr, report.longitude);
+    ptr += putSigned(ptr, report.altitude);
+    _first = report;
+  }
+  else {
+    ptr += putVarint(ptr, report.time - _last.time);
+    ptr += putSigned(ptr, report.latitude - _last.latitude);
+    ptr += putSigned(ptr, report.longitude - _last.longitude);
+    ptr += putSigned(ptr, report.altitude - _last.altitude);
+  }
+  ptr += putVarint(ptr, report.speed);
+  ptr += putVarint(ptr, report.course);
+
+  uint8_t n = ptr - buf;
+  if (_length + n > kBodySize) return false;
+
+  memcpy(_body + _length, buf, n);
+  _length += n;
+  _count++;
+  _last = report;
+  return true;
+}
+
+uint16_t BatchEncoder::finish(uint8_t *buf, uint16_t bufSize) {
+  if (_count == 0 || bufSize < kMaxFrameSize) return 0;
+
+  uint8_t *ptr = buf + 3;
+  uint8_t flags = 0;
+  if (_last.batteryLow)    flags |= kStatusBatteryLow;
+  if (_last.externalPower) flags |= kStatusExtPower;
+  *ptr++ = flags;
+  memcpy(ptr, _imei, sizeof(_imei));
+  ptr += sizeof(_imei);
+  *ptr++ = packBattery(_last.batteryVoltage);
+  *ptr++ = _count;
+  ptr += putVarint(ptr, _first.time);
+
+  memcpy(ptr, _body, _length);
+  ptr += _length;
+
+  uint16_t bodyLength = ptr - (buf + 3);
+  buf[0] = kSync;
+  buf[1] = bodyLength & 0xFF;
+  buf[2] = bodyLength >> 8;
+
+  CRC16<0xA001, true> crc;
+  uint16_t checksum = crc.update(buf + 1, bodyLength + 2);
+  *ptr++ = checksum & 0xFF;
+  *ptr++ = checksum >> 8;
+
+  _count = 0;
+  _length = 0;
+  return ptr - buf;
+}
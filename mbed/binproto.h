@@ -0,0 +1,163 @@
+#ifndef BINPROTO_H
+#define BINPROTO_H
+
+#include <stdint.h>
+
+#include "gpsdata.h"
+
+/**
+ * Position report in fixed point, the unit of the binary protocol.
+ */
+struct PositionReport {
+  uint32_t time;            // seconds since 2000-01-01 00:00 UTC
+  int32_t  latitude;        // 1e-6 degrees
+  int32_t  longitude;       // 1e-6 degrees
+  int32_t  altitude;        // 0.1 m
+  uint16_t speed;           // 0.1 km/h
+  uint16_t course;          // degrees
+  uint8_t  satCount;
+  bool     fix;
+  bool     batteryLow;
+  bool     externalPower;
+  uint16_t batteryVoltage;  // mV
+
+  PositionReport();
+
+  /// Fill time and position fields from a GNSS fix
+  bool set(const GNSSFix &fix);
+};
+
+/*
+ * Binary frame:
+ *
+ *   0xA5 <length> <status> <body...> <CRC16 lo> <CRC16 hi>
+ *
+ * length counts status and body. status packs keyframe (bit 0), fix (1),
+ * battery low (2), external power (3) and min(satCount, 15) (bits 4-7).
+ * A keyframe body is the IMEI in 8 BCD bytes followed by time, latitude,
+ * longitude and altitude as absolute values; other frames carry the
+ * difference to the previous report instead. Then speed, course and
+ * battery ((mV - 2000) / 10) follow. All integers except battery are
+ * varints, signed ones zigzag encoded. The CRC16 (0xA001, reflected, as in
+ * the TK102 packet) covers length, status and body.
+ */
+class BinaryEncoder {
+public:
+  enum {
+    kSync           = 0xA5,
+    kMaxFrameSize   = 64
+  };
+
+  BinaryEncoder(uint8_t keyframeInterval = 10);
+
+  void setIMEI(const char *imei);
+
+  /// Make the next frame a keyframe (e.g. after the server connection changed)
+  void reset() { _sinceKeyframe = _keyframeInterval; }
+
+  /// Encode one report, returns the frame size (0 if it does not fit)
+  uint16_t encode(const PositionReport &report, uint8_t *buf, uint16_t bufSize);
+
+  /**
+   * Encode one report as a keyframe without touching the delta chain, for
+   * reports that are stored and sent later. Returns the frame size.
+   */
+  uint16_t encodeKeyframe(const PositionReport &report, uint8_t *buf, uint16_t bufSize);
+
+  /**
+   * Prepare stored data for one send: keyframes from encodeKeyframe()
+   * become a keyframe followed by deltas, so the send never depends on
+   * frames the server did not get. Delta frames are dropped, batch frames
+   * and text are copied unchanged. Returns the output size.
+   */
+  uint16_t chain(const uint8_t *data, uint16_t length, uint8_t *buf, uint16_t bufSize);
+
+private:
+  uint8_t         _imei[8];
+  uint8_t         _keyframeInterval;
+  uint8_t         _sinceKeyframe;
+  PositionReport  _last;
+
+  uint16_t encodeFrame(const PositionReport &report, bool keyframe, uint8_t *buf, uint16_t bufSize);
+};
+
+/*
+ * Batch frame, several reports sharing one header:
+ *
+ *   0xA6 <length lo> <length hi> <flags> <IMEI, 8 BCD bytes> <battery>
+ *   <count> <base time> <report>... <CRC16 lo> <CRC16 hi>
+ *
+ * flags hold battery low (bit 2) and external power (bit 3) of the latest
+ * report. Each report starts with a status byte (fix, satellites as
+ * above). The first report has absolute latitude, longitude and altitude
+ * at the base time, the others the time, latitude, longitude and altitude
+ * differences to the previous report. Speed and course follow in each.
+ */
+class BatchEncoder {
+public:
+  enum {
+    kSync           = 0xA6,
+    kMaxReports     = 32,
+    kMaxFrameSize   = 188     // fits one PositionQueue record
+  };
+
+  BatchEncoder();
+
+  void setIMEI(const char *imei);
+
+  /// Append a report, false if the frame is full (finish() it and retry)
+  bool add(const PositionReport &report);
+
+  uint8_t size()  { return _count; }
+  bool    empty() { return _count == 0; }
+
+  /// Write the batch frame into buf and start a new batch, returns its size
+  uint16_t finish(uint8_t *buf, uint16_t bufSize);
+
+private:
+  enum {
+    kHeaderSize     = 3 + 1 + 8 + 1 + 1 + 5,
+    kBodySize       = kMaxFrameSize - kHeaderSize - 2
+  };
+
+  uint8_t         _imei[8];
+  uint8_t         _count;
+  uint16_t        _length;
+  uint8_t         _body[kBodySize];
+  PositionReport  _first;
+  PositionReport  _last;
+};
+
+/**
+ * Decoder for the frames above, meant for the server side and host tools.
+ */
+class BinaryDecoder {
+public:
+  BinaryDecoder();
+
+  /**
+   * Decode one frame from data. Returns the number of bytes consumed, 0 if
+   * more data is needed. Corrupt frames and delta frames without a
+   * preceding keyframe are consumed but leave valid false; after a corrupt
+   * frame the deltas up to the next keyframe are dropped as well.
+   */
+  uint16_t decode(const uint8_t *data, uint16_t length, PositionReport &report, bool &valid);
+
+  /**
+   * Decode one batch frame into reports (at most maxReports). Returns the
+   * number of bytes consumed as decode() does, count is set to the number
+   * of reports decoded (0 for a corrupt frame).
+   */
+  uint16_t decodeBatch(const uint8_t *data, uint16_t length, PositionReport *reports,
+                       uint8_t maxReports, uint8_t &count);
+
+  /// IMEI from the last keyframe
+  const char * getIMEI() { return _imei; }
+
+private:
+  char            _imei[17];
+  bool            _haveBase;
+  PositionReport  _last;
+};
+
+#endif
@@ -1,3 +1,6 @@
+#ifndef CRC_H
+#define CRC_H
+
 #include <stdint.h>
 
 template<uint8_t polynomial>
@@ -27,6 +30,7 @@ public:
   
   uint16_t update(uint8_t value);
   uint16_t update(char *string);
+  uint16_t update(const uint8_t *data, uint16_t length);
   
   static void makeTable();
 
@@ -229,3 +233,16 @@ uint16_t CRC16<polynomial, reverse>::update(char *string)
   }
   return remainder;
 }
+
+template<uint16_t polynomial, bool reverse>
+uint16_t CRC16<polynomial, reverse>::update(const uint8_t *data, uint16_t length)
+{
+  while (length > 0) {
+    update(*data);
+    data++;
+    length--;
+  }
+  return remainder;
+}
+
+#endif
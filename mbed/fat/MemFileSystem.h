@@ -7,18 +7,24 @@
 #define MBED_MEMFILESYSTEM_H
 
 #include "FATFileSystem.h"
+#include "SectorCache.h"
 
 namespace mbed
 {
 
-    class MemFileSystem : public FATFileSystem
+    class MemFileSystem : public FATFileSystem, private SectorCache::Device
     {
     public:
     
         // 2000 sectors, each 512 bytes (malloced as required)
         char *sectors[2000];
+
+        // sector transfers that reached the sectors above
+        uint32_t reads, writes;
     
-        MemFileSystem(const char* name) : FATFileSystem(name) {
+        // no sector cache by default, RAM is as fast as the cache
+        MemFileSystem(const char* name, int cacheSets = 0, int cacheWays = 0)
+            : FATFileSystem(name), reads(0), writes(0), _cache(*this, cacheSets, cacheWays) {
             memset(sectors, 0, sizeof(sectors));
         }
     
@@ -30,8 +36,58 @@ namespace mbed
             }
         }
     
+        // read sectors in to the buffer, return 0 if ok
+        virtual int disk_read(uint8_t *buffer, uint32_t sector, uint32_t count) {
+            return _cache.read(buffer, sector, count);
+        }
+
+        // write sectors from the buffer, return 0 if ok
+        virtual int disk_write(const uint8_t *buffer, uint32_t sector, uint32_t count) {
+            return _cache.write(buffer, sector, count);
+        }
+
+        virtual int disk_sync() {
+            return _cache.flush();
+        }
+
+        // return the number of sectors
+        virtual uint32_t disk_sectors() {
+            return sizeof(sectors)/sizeof(sectors[0]);
+        }
+
+        SectorCache& cache() {
+            return _cache;
+        }
+
+    private:
+
+        SectorCache _cache;
+
+        virtual int cache_read(uint8_t *buffer, uint32_t sector, uint32_t count) {
+            for(uint32_t i = 0; i < count; i++) {
+                if(readSector((char*)buffer + i*512, sector + i)) {
+                    return 1;
+                }
+            }
+            reads += count;
+            return 0;
+        }
+
+        virtual int cache_write(const uint8_t *buffer, uint32_t sector, uint32_t count) {
+            for(uint32_t i = 0; i < count; i++) {
+                if(writeSector((const char*)buffer + i*512, sector + i)) {
+                    return 1;
+                }
+            }
+            writes += count;
+            return 0;
+        }
+
         // read a sector in to the buffer, return 0 if ok
-        virtual int disk_read(char *buffer, int sector) {
+        int readSector(char *buffer, uint32_t sector) {
+            if(sector >= disk_sectors()) {
+                return 1;
+            }
             if(sectors[sector] == 0) {
                 // nothing allocated means sector is empty
                 memset(buffer, 0, 512);
@@ -42,7 +98,10 @@ namespace mbed
         }
     
         // write a sector from the buffer, return 0 if ok
-        virtual int disk_write(const char *buffer, int sector) {
+        int writeSector(const char *buffer, uint32_t sector) {
+            if(sector >= disk_sectors()) {
+                return 1;
+            }
             // if buffer is zero deallocate sector
             char zero[512];
             memset(zero, 0, 512);
@@ -65,11 +124,6 @@ namespace mbed
             return 0;
         }
     
-        // return the number of sectors
-        virtual int disk_sectors() {
-            return sizeof(sectors)/sizeof(sectors[0]);
-        }
-    
     };
 
 }
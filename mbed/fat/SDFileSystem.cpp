@@ -25,7 +25,8 @@ SDFileSystem::SDFileSystem(PinName mosi, PinName miso, PinName sclk, PinName cs,
       m_Spi(mosi, miso, sclk),
       m_Cs(cs, 1),
       m_Cd(cd),
-      m_FREQ(hz)
+      m_FREQ(hz),
+      m_Cache(*this)
 {
     //Initialize the member variables
     m_CardType = CARD_NONE;
@@ -33,6 +34,9 @@ SDFileSystem::SDFileSystem(PinName mosi, PinName miso, PinName sclk, PinName cs,
     m_LargeFrames = false;
     m_WriteValidation = true;
     m_Status = STA_NOINIT;
+    m_StreamNext = 0;
+    m_StreamEnd = 0;
+    m_StreamOpen = false;
 
     //Enable the internal pull-up resistor on MISO
     pin_mode(miso, PullUp);
@@ -133,8 +137,31 @@ void SDFileSystem::write_validation(bool enabled)
     m_WriteValidation = enabled;
 }
 
+void SDFileSystem::stream_begin(uint32_t sector, uint32_t count)
+{
+    //Finish any previous stream, and remember the new region
+    streamClose();
+    m_StreamNext = sector;
+    m_StreamEnd = (count > 0) ? sector + count : 0;
+}
+
+bool SDFileSystem::stream_end()
+{
+    //Forget the region, and finish its multiple block write
+    m_StreamEnd = 0;
+    return streamClose();
+}
+
+SectorCache& SDFileSystem::cache()
+{
+    return m_Cache;
+}
+
 int SDFileSystem::unmount()
 {
+    //Finish any streaming write
+    stream_end();
+
     //Unmount the filesystem
     FATFileSystem::unmount();
 
@@ -325,6 +352,9 @@ int SDFileSystem::disk_initialize()
         }
     }
 
+    //Anything still cached belonged to the previous card
+    m_Cache.invalidate();
+
     //The card is now initialized
     m_Status &= ~STA_NOINIT;
 
@@ -347,6 +377,16 @@ int SDFileSystem::disk_read(uint8_t* buffer, uint32_t sector, uint32_t count)
     if (m_Status & STA_NOINIT)
         return RES_NOTRDY;
 
+    //Single sectors (FAT and directory) are served from the cache
+    return m_Cache.read(buffer, sector, count);
+}
+
+int SDFileSystem::cache_read(uint8_t* buffer, uint32_t sector, uint32_t count)
+{
+    //Finish any streaming write so the card takes commands again
+    if (!streamClose())
+        return RES_ERROR;
+
     //Read a single block, or multiple blocks
     if (count > 1) {
         return readBlocks((char*)buffer, sector, count) ? RES_OK : RES_ERROR;
@@ -365,6 +405,22 @@ int SDFileSystem::disk_write(const uint8_t* buffer, uint32_t sector, uint32_t co
     if (m_Status & STA_PROTECT)
         return RES_WRPRT;
 
+    //Continue the streaming write if this is the next part of its region
+    if (m_StreamEnd != 0 && sector == m_StreamNext && count <= m_StreamEnd - sector) {
+        m_Cache.discard(sector, count);
+        return streamWrite((const char*)buffer, count) ? RES_OK : RES_ERROR;
+    }
+
+    //Otherwise single sectors stay in the cache until evicted or synced
+    return m_Cache.write(buffer, sector, count);
+}
+
+int SDFileSystem::cache_write(const uint8_t* buffer, uint32_t sector, uint32_t count)
+{
+    //Finish any streaming write first
+    if (!streamClose())
+        return RES_ERROR;
+
     //Write a single block, or multiple blocks
     if (count > 1) {
         return writeBlocks((const char*)buffer, sector, count) ? RES_OK : RES_ERROR;
@@ -375,6 +431,14 @@ int SDFileSystem::disk_write(const uint8_t* buffer, uint32_t sector, uint32_t co
 
 int SDFileSystem::disk_sync()
 {
+    //Write back the cached sectors
+    if (m_Cache.flush() != RES_OK)
+        return RES_ERROR;
+
+    //Finish any streaming write
+    if (!streamClose())
+        return RES_ERROR;
+
     //Select the card so we're forced to wait for the end of any internal write processes
     if (select()) {
         deselect();
@@ -390,6 +454,10 @@ uint32_t SDFileSystem::disk_sectors()
     if (m_Status & STA_NOINIT)
         return 0;
 
+    //Finish any streaming write so the card takes commands again
+    if (!streamClose())
+        return 0;
+
     //Try to read the CSD register up to 3 times
     for (int f = 0; f < 3; f++) {
         //Select the card, and wait for ready
@@ -905,6 +973,85 @@ inline bool SDFileSystem::writeBlocks(const char* buffer, unsigned int lba, unsi
     return false;
 }
 
+bool SDFileSystem::streamWrite(const char* buffer, unsigned int count)
+{
+    //Start the multiple block write on the first write to the region
+    if (!m_StreamOpen) {
+        //If this is an SD card, send ACMD23 to pre-erase the rest of the region (23 bits at most)
+        if (m_CardType != CARD_MMC) {
+            unsigned int left = m_StreamEnd - m_StreamNext;
+            if (commandTransaction(ACMD23, (left > 0x7FFFFF) ? 0x7FFFFF : left) != 0x00) {
+                //The command failed, give up streaming this region
+                m_StreamEnd = 0;
+                return false;
+            }
+        }
+
+        //Select the card, and wait for ready
+        if (!select()) {
+            m_StreamEnd = 0;
+            return false;
+        }
+
+        //Send CMD25(block) to write multiple blocks, the card stays selected until streamClose()
+        if (writeCommand(CMD25, (m_CardType == CARD_SDHC) ? m_StreamNext : m_StreamNext << 9) != 0x00) {
+            deselect();
+            m_StreamEnd = 0;
+            return false;
+        }
+        m_StreamOpen = true;
+    }
+
+    //Write the data blocks
+    do {
+        if (writeData(buffer, 0xFC) != 0x05) {
+            //Send CMD12(0x00000000) to abort the transmission, and give up streaming this region
+            writeCommand(CMD12, 0x00000000);
+            deselect();
+            m_StreamOpen = false;
+            m_StreamEnd = 0;
+            return false;
+        }
+
+        //Update the variables
+        buffer += 512;
+        m_StreamNext++;
+    } while (--count);
+
+    //Finish the stream once the region is full
+    if (m_StreamNext == m_StreamEnd)
+        return stream_end();
+
+    return true;
+}
+
+bool SDFileSystem::streamClose()
+{
+    //Nothing to do unless a multiple block write is open
+    if (!m_StreamOpen)
+        return true;
+    m_StreamOpen = false;
+
+    //Wait for up to 500ms for the card to finish processing the last block
+    if (!waitReady(500)) {
+        deselect();
+        return false;
+    }
+
+    //Send the stop tran token, and deselect the card
+    m_Spi.write(0xFD);
+    deselect();
+
+    //Send CMD13(0x00000000) to verify that the programming was successful if enabled
+    if (m_WriteValidation) {
+        unsigned int resp;
+        if (commandTransaction(CMD13, 0x00000000, &resp) != 0x00 || resp != 0x00)
+            return false;
+    }
+
+    return true;
+}
+
 bool SDFileSystem::enableHighSpeedMode()
 {
     //Try to issue CMD6 up to 3 times
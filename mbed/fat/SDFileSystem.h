@@ -19,6 +19,7 @@
 
 #include "mbed.h"
 #include "FATFileSystem.h"
+#include "SectorCache.h"
 
 /** SDFileSystem class.
  *  Used for creating a virtual file system for accessing SD/MMC cards via SPI.
@@ -66,7 +67,7 @@
  * }
  * @endcode
  */
-class SDFileSystem : public FATFileSystem
+class SDFileSystem : public FATFileSystem, private SectorCache::Device
 {
 public:
     /** Represents the different card detect switch types
@@ -160,6 +161,36 @@ public:
      */
     void write_validation(bool enabled);
 
+    /** Announce a region that is about to be written sequentially
+     *
+     * In order writes to the region are sent as one multiple block write
+     * (CMD25, after an ACMD23 pre-erase of the region) that stays open across
+     * disk_write() calls, instead of one command per FatFs call. Any other
+     * disk access ends the stream. The pre-erase is only a hint to the card,
+     * sectors of the region that are never written have undefined contents
+     * (old data or the erase pattern).
+     *
+     * @param sector The first sector of the region.
+     * @param count The number of sectors in the region.
+     */
+    void stream_begin(uint32_t sector, uint32_t count);
+
+    /** End the streaming region, finishing its multiple block write
+     *
+     * @returns
+     *   'true' if the stream was closed successfully,
+     *   'false' if the card reported an error.
+     */
+    bool stream_end();
+
+    /** Get the sector cache in front of the card
+     *
+     * @returns The cache, for its hit, miss and write-back counters.
+     *
+     * @note Dirty sectors are written to the card on disk_sync().
+     */
+    SectorCache& cache();
+
     virtual int unmount();
     virtual int disk_initialize();
     virtual int disk_status();
@@ -204,6 +235,10 @@ private:
     bool m_LargeFrames;
     bool m_WriteValidation;
     int m_Status;
+    uint32_t m_StreamNext;
+    uint32_t m_StreamEnd;
+    bool m_StreamOpen;
+    SectorCache m_Cache;
 
     //Internal methods
     void onCardRemoval();
@@ -219,7 +254,11 @@ private:
     bool readBlocks(char* buffer, unsigned int lba, unsigned int count);
     bool writeBlock(const char* buffer, unsigned int lba);
     bool writeBlocks(const char* buffer, unsigned int lba, unsigned int count);
+    bool streamWrite(const char* buffer, unsigned int count);
+    bool streamClose();
     bool enableHighSpeedMode();
+    virtual int cache_read(uint8_t* buffer, uint32_t sector, uint32_t count);
+    virtual int cache_write(const uint8_t* buffer, uint32_t sector, uint32_t count);
 };
 
 #endif
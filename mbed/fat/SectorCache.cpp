@@ -0,0 +1,204 @@
+#include <string.h>
+#include "SectorCache.h"
+
+#define SECTOR_SIZE 512
+
+SectorCache::SectorCache(Device& device, int sets, int ways)
+    : m_Device(device),
+      m_Sets((sets > 0 && ways > 0) ? sets : 0),
+      m_Ways((sets > 0 && ways > 0) ? ways : 0)
+{
+    //Allocate the lines, none at all if the cache is disabled
+    m_Lines = NULL;
+    m_Data = NULL;
+    if (m_Sets > 0) {
+        m_Lines = new Line[m_Sets * m_Ways];
+        m_Data = new uint8_t[m_Sets * m_Ways * SECTOR_SIZE];
+    }
+
+    m_Clock = 0;
+    invalidate();
+    reset_stats();
+}
+
+SectorCache::~SectorCache()
+{
+    delete[] m_Lines;
+    delete[] m_Data;
+}
+
+int SectorCache::read(uint8_t* buffer, uint32_t sector, uint32_t count)
+{
+    //Multiple sectors go straight to the device, patched with newer cached data
+    if (m_Lines == NULL || count > 1) {
+        int res = m_Device.cache_read(buffer, sector, count);
+        if (res != 0)
+            return res;
+
+        for (int i = 0; i < m_Sets * m_Ways; i++) {
+            Line* line = &m_Lines[i];
+            if (line->valid && line->dirty && line->sector - sector < count)
+                memcpy(buffer + (line->sector - sector) * SECTOR_SIZE, data(line), SECTOR_SIZE);
+        }
+        return 0;
+    }
+
+    //Serve a single sector from the cache, filling a line on a miss
+    Line* line = lookup(sector);
+    if (line != NULL) {
+        m_Hits++;
+    } else {
+        int res;
+        line = allocate(sector, &res);
+        if (line == NULL)
+            return res;
+
+        res = m_Device.cache_read(data(line), sector, 1);
+        if (res != 0)
+            return res;
+
+        m_Misses++;
+        line->sector = sector;
+        line->valid = true;
+    }
+    line->stamp = ++m_Clock;
+    memcpy(buffer, data(line), SECTOR_SIZE);
+    return 0;
+}
+
+int SectorCache::write(const uint8_t* buffer, uint32_t sector, uint32_t count)
+{
+    //Multiple sectors go straight to the device, replacing any cached copies
+    if (m_Lines == NULL || count > 1) {
+        discard(sector, count);
+        return m_Device.cache_write(buffer, sector, count);
+    }
+
+    //Keep a single sector in the cache until it's evicted or flushed
+    Line* line = lookup(sector);
+    if (line != NULL) {
+        m_Hits++;
+    } else {
+        int res;
+        line = allocate(sector, &res);
+        if (line == NULL)
+            return res;
+
+        m_Misses++;
+        line->sector = sector;
+        line->valid = true;
+    }
+    line->stamp = ++m_Clock;
+    line->dirty = true;
+    memcpy(data(line), buffer, SECTOR_SIZE);
+    return 0;
+}
+
+int SectorCache::flush()
+{
+    //Write the dirty lines back in ascending sector order
+    for (;;) {
+        Line* next = NULL;
+        for (int i = 0; i < m_Sets * m_Ways; i++) {
+            Line* line = &m_Lines[i];
+            if (line->valid && line->dirty && (next == NULL || line->sector < next->sector))
+                next = line;
+        }
+        if (next == NULL)
+            return 0;
+
+        int res = writeBack(next);
+        if (res != 0)
+            return res;
+    }
+}
+
+void SectorCache::discard(uint32_t sector, uint32_t count)
+{
+    for (int i = 0; i < m_Sets * m_Ways; i++) {
+        Line* line = &m_Lines[i];
+        if (line->valid && line->sector - sector < count) {
+            line->valid = false;
+            line->dirty = false;
+        }
+    }
+}
+
+void SectorCache::invalidate()
+{
+    for (int i = 0; i < m_Sets * m_Ways; i++) {
+        m_Lines[i].valid = false;
+        m_Lines[i].dirty = false;
+    }
+}
+
+uint32_t SectorCache::hits()
+{
+    return m_Hits;
+}
+
+uint32_t SectorCache::misses()
+{
+    return m_Misses;
+}
+
+uint32_t SectorCache::writebacks()
+{
+    return m_Writebacks;
+}
+
+void SectorCache::reset_stats()
+{
+    m_Hits = 0;
+    m_Misses = 0;
+    m_Writebacks = 0;
+}
+
+SectorCache::Line* SectorCache::lookup(uint32_t sector)
+{
+    Line* set = &m_Lines[(sector % m_Sets) * m_Ways];
+    for (int w = 0; w < m_Ways; w++) {
+        if (set[w].valid && set[w].sector == sector)
+            return &set[w];
+    }
+    return NULL;
+}
+
+SectorCache::Line* SectorCache::allocate(uint32_t sector, int* error)
+{
+    //Take a free way, or else the least recently used one
+    Line* set = &m_Lines[(sector % m_Sets) * m_Ways];
+    Line* victim = &set[0];
+    for (int w = 0; w < m_Ways; w++) {
+        if (!set[w].valid) {
+            victim = &set[w];
+            break;
+        }
+        if ((int32_t)(set[w].stamp - victim->stamp) < 0)
+            victim = &set[w];
+    }
+
+    //Write it back before reusing it
+    if (victim->valid && victim->dirty) {
+        *error = writeBack(victim);
+        if (*error != 0)
+            return NULL;
+    }
+    victim->valid = false;
+    return victim;
+}
+
+int SectorCache::writeBack(Line* line)
+{
+    int res = m_Device.cache_write(data(line), line->sector, 1);
+    if (res == 0) {
+        line->dirty = false;
+        m_Writebacks++;
+    }
+    return res;
+}
+
+uint8_t* SectorCache::data(Line* line)
+{
+    return m_Data + (line - m_Lines) * SECTOR_SIZE;
+}
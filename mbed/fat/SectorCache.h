@@ -0,0 +1,127 @@
+#ifndef SECTOR_CACHE_H
+#define SECTOR_CACHE_H
+
+#include <stdint.h>
+
+//Default geometry, can be overridden in mbed_config.h (0 disables the cache)
+#ifndef SECTOR_CACHE_SETS
+#define SECTOR_CACHE_SETS   1
+#endif
+#ifndef SECTOR_CACHE_WAYS
+#define SECTOR_CACHE_WAYS   4
+#endif
+
+/** SectorCache class.
+ *  A small set associative write-back cache of 512B sectors between FatFs
+ *  and a block device.
+ *
+ *  FatFs keeps a single sector window for the FAT and directories, so
+ *  allocating clusters and updating a directory entry in turn reads the
+ *  same few sectors again and again. Single sector reads and writes go
+ *  through the cache; a sector maps to set (sector % sets) and the least
+ *  recently used of its ways is evicted, written back first if dirty.
+ *  Multiple sector transfers (file data) bypass the cache and only keep it
+ *  coherent. Dirty sectors reach the device on eviction or flush(), which
+ *  the owner calls from disk_sync().
+ */
+class SectorCache
+{
+public:
+    /** The block device behind the cache
+     */
+    class Device
+    {
+    public:
+        /** Read sectors from the device, returns 0 on success */
+        virtual int cache_read(uint8_t* buffer, uint32_t sector, uint32_t count) = 0;
+
+        /** Write sectors to the device, returns 0 on success */
+        virtual int cache_write(const uint8_t* buffer, uint32_t sector, uint32_t count) = 0;
+
+    protected:
+        ~Device() {}
+    };
+
+    /** Create a cache in front of a device
+     *
+     * @param device The device to read from and write back to.
+     * @param sets The number of sets.
+     * @param ways The number of sectors per set.
+     */
+    SectorCache(Device& device, int sets = SECTOR_CACHE_SETS, int ways = SECTOR_CACHE_WAYS);
+    ~SectorCache();
+
+    /** Read sectors through the cache
+     *
+     * @returns 0 on success, or the error of the device.
+     */
+    int read(uint8_t* buffer, uint32_t sector, uint32_t count);
+
+    /** Write sectors through the cache
+     *
+     * @returns 0 on success, or the error of the device.
+     */
+    int write(const uint8_t* buffer, uint32_t sector, uint32_t count);
+
+    /** Write all dirty sectors back to the device
+     *
+     * @returns 0 on success, or the error of the device.
+     */
+    int flush();
+
+    /** Forget the cached sectors in a range, dirty ones included
+     *
+     * @param sector The first sector of the range.
+     * @param count The number of sectors in the range.
+     *
+     * @note For sectors that were written to the device behind the cache.
+     */
+    void discard(uint32_t sector, uint32_t count);
+
+    /** Forget all cached sectors (new medium), dirty ones included
+     */
+    void invalidate();
+
+    /** Get the number of single sector accesses served from the cache
+     */
+    uint32_t hits();
+
+    /** Get the number of single sector accesses that had to allocate a line
+     */
+    uint32_t misses();
+
+    /** Get the number of dirty sectors written back to the device
+     */
+    uint32_t writebacks();
+
+    /** Reset the hit, miss and write-back counters
+     */
+    void reset_stats();
+
+private:
+    struct Line {
+        uint32_t sector;
+        uint32_t stamp;     //Value of m_Clock when last used
+        bool valid;
+        bool dirty;
+    };
+
+    //Member variables
+    Device& m_Device;
+    const int m_Sets;
+    const int m_Ways;
+    Line* m_Lines;
+    uint8_t* m_Data;
+    uint32_t m_Clock;
+    uint32_t m_Hits;
+    uint32_t m_Misses;
+    uint32_t m_Writebacks;
+
+    //Internal methods
+    Line* lookup(uint32_t sector);
+    Line* allocate(uint32_t sector, int* error);
+    int writeBack(Line* line);
+    uint8_t* data(Line* line);
+};
+
+#endif
@@ -0,0 +1,235 @@
+#include "geofence.h"
+#include "gpsdata.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+
+static int32_t toMicroDegrees(double degrees) {
+  return (int32_t)floor(degrees * 1e6 + 0.5);
+}
+
+Geofence::Geofence() {
+  clear();
+  _haveHome = false;
+  _homeLat = 0;
+  _homeLon = 0;
+  _scaleX = metersPerMicroDegree;
+  _scaleY = metersPerMicroDegree;
+  _margin = 10;
+}
+
+void Geofence::clear() {
+  _zoneCount = 0;
+  _vertexCount = 0;
+  _inPolygon = false;
+  _inside = true;
+}
+
+bool Geofence::load(const char *path) {
+  FILE *fp = fopen(path, "r");
+  if (fp == 0) return false;
+
+  clear();
+
+  char line[100];
+  while (fgets(line, sizeof(line), fp)) {
+    char *comment = strchr(line, '#');
+    if (comment) *comment = '\0';
+
+    double latitude, longitude;
+    int value;
+    char word[8];
+    if (sscanf(line, "circle %lf %lf %d", &latitude, &longitude, &value) == 3) {
+      addCircle(toMicroDegrees(latitude), toMicroDegrees(longitude), value);
+    }
+    else if (sscanf(line, "margin %d", &value) == 1) {
+      setMargin(value);
+    }
+    else if (sscanf(line, "%lf %lf", &latitude, &longitude) == 2) {
+      addVertex(toMicroDegrees(latitude), toMicroDegrees(longitude));
+    }
+    else if (sscanf(line, "%7s", word) == 1) {
+      if (strcmp(word, "polygon") == 0) beginPolygon();
+      else if (strcmp(word, "end") == 0) endPolygon();
+    }
+  }
+  fclose(fp);
+
+  // An unterminated polygon at the end of the file still counts
+  if (_inPolygon) endPolygon();
+
+  return _zoneCount > 0;
+}
+
+bool Geofence::addCircle(int32_t latitude, int32_t longitude, uint32_t radius) {
+  if (_inPolygon || _zoneCount >= kMaxZones) return false;
+
+  Zone &zone = _zones[_zoneCount++];
+  zone.type = kCircle;
+  zone.latitude = latitude;
+  zone.longitude = longitude;
+  zone.radius = radius;
+  zone.first = 0;
+  zone.count = 0;
+  projectZone(zone);
+  return true;
+}
+
+bool Geofence::beginPolygon() {
+  if (_inPolygon || _zoneCount >= kMaxZones) return false;
+
+  Zone &zone = _zones[_zoneCount];
+  zone.type = kPolygon;
+  zone.latitude = 0;
+  zone.longitude = 0;
+  zone.radius = 0;
+  zone.first = _vertexCount;
+  zone.count = 0;
+  _inPolygon = true;
+  return true;
+}
+
+bool Geofence::addVertex(int32_t latitude, int32_t longitude) {
+  if (!_inPolygon || _vertexCount >= kMaxVertices) return false;
+
+  _vertexLat[_vertexCount] = latitude;
+  _vertexLon[_vertexCount] = longitude;
+  _vertexCount++;
+  _zones[_zoneCount].count++;
+  return true;
+}
+
+bool Geofence::endPolygon() {
+  if (!_inPolygon) return false;
+  _inPolygon = false;
+
+  Zone &zone = _zones[_zoneCount];
+  if (zone.count < 3) {
+    // Not an area, drop its vertices
+    _vertexCount = zone.first;
+    return false;
+  }
+
+  projectZone(zone);
+  _zoneCount++;
+  return true;
+}
+
+void Geofence::setMargin(uint16_t meters) {
+  _margin = meters;
+}
+
+void Geofence::setHome(int32_t latitude, int32_t longitude) {
+  _haveHome = true;
+  _homeLat = latitude;
+  _homeLon = longitude;
+  _scaleY = metersPerMicroDegree;
+  _scaleX = metersPerMicroDegree * cosf(latitude / 180e6f * (float)M_PI);
+
+  for (uint8_t idx = 0; idx < _zoneCount; idx++) {
+    projectZone(_zones[idx]);
+  }
+}
+
+void Geofence::project(int32_t latitude, int32_t longitude, float &x, float &y) {
+  x = (longitude - _homeLon) * _scaleX;
+  y = (latitude - _homeLat) * _scaleY;
+}
+
+void Geofence::projectZone(Zone &zone) {
+  if (zone.type == kCircle) {
+    project(zone.latitude, zone.longitude, zone.x, zone.y);
+    zone.minX = zone.x - zone.radius;
+    zone.maxX = zone.x + zone.radius;
+    zone.minY = zone.y - zone.radius;
+    zone.maxY = zone.y + zone.radius;
+    return;
+  }
+
+  for (uint8_t idx = zone.first; idx < zone.first + zone.count; idx++) {
+    float x, y;
+    project(_vertexLat[idx], _vertexLon[idx], x, y);
+    _vertexX[idx] = x;
+    _vertexY[idx] = y;
+    if (idx == zone.first || x < zone.minX) zone.minX = x;
+    if (idx == zone.first || x > zone.maxX) zone.maxX = x;
+    if (idx == zone.first || y < zone.minY) zone.minY = y;
+    if (idx == zone.first || y > zone.maxY) zone.maxY = y;
+  }
+}
+
+Geofence::Position Geofence::locate(const Zone &zone, float x, float y) {
+  // Bounding box first, most fixes are nowhere near most zones
+  if (x < zone.minX - _margin || x > zone.maxX + _margin ||
+      y < zone.minY - _margin || y > zone.maxY + _margin)
+  {
+    return kOutsideFar;
+  }
+
+  if (zone.type == kCircle) {
+    float dx = x - zone.x;
+    float dy = y - zone.y;
+    float distance2 = dx * dx + dy * dy;
+    float inner = (zone.radius > _margin) ? zone.radius - _margin : 0;
+    float outer = zone.radius + _margin;
+    if (distance2 <= inner * inner) return kInsideDeep;
+    if (distance2 >= outer * outer) return kOutsideFar;
+    return kBoundary;
+  }
+
+  // Crossing test for containment, nearest edge for the margin
+  const float *vx = _vertexX + zone.first;
+  const float *vy = _vertexY + zone.first;
+  bool inside = false;
+  float nearest2 = -1;
+  for (uint8_t i = 0, j = zone.count - 1; i < zone.count; j = i++) {
+    if ((vy[i] > y) != (vy[j] > y) &&
+        x < vx[i] + (vx[j] - vx[i]) * (y - vy[i]) / (vy[j] - vy[i]))
+    {
+      inside = !inside;
+    }
+
+    if (_margin > 0) {
+      float ex = vx[j] - vx[i];
+      float ey = vy[j] - vy[i];
+      float px = x - vx[i];
+      float py = y - vy[i];
+      float length2 = ex * ex + ey * ey;
+      float t = (length2 > 0) ? (px * ex + py * ey) / length2 : 0;
+      if (t < 0) t = 0;
+      if (t > 1) t = 1;
+      float dx = px - t * ex;
+      float dy = py - t * ey;
+      float distance2 = dx * dx + dy * dy;
+      if (nearest2 < 0 || distance2 < nearest2) nearest2 = distance2;
+    }
+  }
+
+  if (_margin > 0 && nearest2 < _margin * _margin) return kBoundary;
+  return inside ? kInsideDeep : kOutsideFar;
+}
+
+bool Geofence::update(int32_t latitude, int32_t longitude) {
+  if (!_haveHome || _zoneCount == 0) return false;
+
+  float x, y;
+  project(latitude, longitude, x, y);
+
+  bool deep = false;
+  bool far = true;
+  for (uint8_t idx = 0; idx < _zoneCount && !deep; idx++) {
+    Position position = locate(_zones[idx], x, y);
+    if (position == kInsideDeep) deep = true;
+    if (position != kOutsideFar) far = false;
+  }
+
+  // Leave only when clear of every zone, enter only when well inside one
+  bool inside = _inside;
+  if (_inside && far) inside = false;
+  if (!_inside && deep) inside = true;
+
+  if (inside == _inside) return false;
+  _inside = inside;
+  return true;
+}
@@ -0,0 +1,114 @@
+#ifndef GEOFENCE_H
+#define GEOFENCE_H
+
+#include <stdint.h>
+
+/**
+ * Allowed area made of circles and polygons; the tracker is inside when it
+ * is inside any of them.
+ *
+ * Zones are given in micro-degrees and projected once, when the home point
+ * is set, onto a local equirectangular plane in meters around it. A check
+ * then costs one projection of the fix and plain single precision
+ * arithmetic per zone, without any trigonometry. Over the few kilometres a
+ * fence spans the projection error is well below GNSS noise.
+ *
+ * The inside/outside state only changes once the fix is past a zone
+ * boundary by more than the margin, so a fix wandering along the boundary
+ * does not flap between the two.
+ */
+class Geofence {
+public:
+  enum {
+    kMaxZones       = 8,
+    kMaxVertices    = 64      // shared by all polygons
+  };
+
+  Geofence();
+
+  /**
+   * Load zones from a text file, one item per line ('#' starts a comment):
+   *
+   *   circle <latitude> <longitude> <radius m>
+   *   polygon                  (followed by the vertices)
+   *   <latitude> <longitude>
+   *   ...
+   *   end
+   *   margin <m>
+   *
+   * Returns false if the file cannot be read or defines no zones.
+   */
+  bool load(const char *path);
+
+  void clear();
+
+  bool addCircle(int32_t latitude, int32_t longitude, uint32_t radius);
+
+  /// Start a polygon, add its vertices in order, then end it
+  bool beginPolygon();
+  bool addVertex(int32_t latitude, int32_t longitude);
+  bool endPolygon();
+
+  void setMargin(uint16_t meters);
+
+  /// Set the projection origin (usually the first fix), reprojects all zones
+  void setHome(int32_t latitude, int32_t longitude);
+
+  /**
+   * Check a fix (micro-degrees). Returns true if the inside/outside state
+   * changed. Without a home point or zones the state stays inside.
+   */
+  bool update(int32_t latitude, int32_t longitude);
+
+  bool isInside()     { return _inside; }
+  uint8_t size()      { return _zoneCount; }
+
+private:
+  enum ZoneType {
+    kCircle,
+    kPolygon
+  };
+
+  /// Where a fix is relative to a zone, boundary margin taken into account
+  enum Position {
+    kInsideDeep,            // inside by more than the margin
+    kBoundary,
+    kOutsideFar             // outside by more than the margin
+  };
+
+  struct Zone {
+    uint8_t   type;
+    int32_t   latitude;       // circle center, micro-degrees
+    int32_t   longitude;
+    uint32_t  radius;         // m
+    uint8_t   first;          // polygon vertices
+    uint8_t   count;
+
+    // Projected, in meters around home
+    float     x, y;
+    float     minX, minY, maxX, maxY;
+  };
+
+  Zone      _zones[kMaxZones];
+  uint8_t   _zoneCount;
+  int32_t   _vertexLat[kMaxVertices];
+  int32_t   _vertexLon[kMaxVertices];
+  float     _vertexX[kMaxVertices];
+  float     _vertexY[kMaxVertices];
+  uint8_t   _vertexCount;
+  bool      _inPolygon;
+
+  bool      _haveHome;
+  int32_t   _homeLat;
+  int32_t   _homeLon;
+  float     _scaleX;          // m per micro-degree of longitude at home
+  float     _scaleY;          // m per micro-degree of latitude
+  float     _margin;
+  bool      _inside;
+
+  void project(int32_t latitude, int32_t longitude, float &x, float &y);
+  void projectZone(Zone &zone);
+  Position locate(const Zone &zone, float x, float y);
+};
+
+#endif
@@ -1,5 +1,4 @@
 #include "gpsdata.h"
-#include "debug.h"
 #include "crc.h"
 
 #include <cstring>
@@ -10,33 +9,6 @@
 const uint16_t batteryThreshold = 25;
 
 
-class SimpleTokenizer {
-public:
-  SimpleTokenizer(char *str, char delimiter) {
-    _str = str;
-    _del = delimiter;
-  }
-
-  char * next() {
-    if (_str == 0) return 0;
-    
-    char *result = _str;
-    char *nextPtr = strchr(_str, _del);
-    if (nextPtr == 0) {
-      _str = 0;
-    }
-    else {
-      *nextPtr = '\0';
-      _str = nextPtr + 1;
-    }
-    return result;
-  }
-  
-private:
-  char *_str;
-  char  _del;
-};
-
 class BufString {
 public:
   BufString(char *buffer, int bufSize, int length = 0) {
@@ -132,57 +104,204 @@ void TK102Packet::setIMEI(char *imei) {
   }  
 }
 
-uint8_t TK102Packet::getNMEAChecksum(char *nmea) {
-  if (!nmea) return 0;
-  
-  uint8_t checksum = 0;
-  while (*nmea) {
-    checksum ^= *nmea;
-    nmea++;
-  }
-  return checksum;
+/*
+ * Splits a coordinate in 1e-6 degrees into whole degrees and minutes in
+ * 1e-4 (the NMEA ddmm.mmmm digits), rounding half up. Returns the degrees.
+ * 0.999999 degrees is 59.99994', so the minutes never round up to 60.
+ */
+static uint32_t toDegreesMinutes(int32_t microDegrees, uint32_t &minutes) {
+  uint32_t value = (microDegrees < 0) ? -(uint32_t)microDegrees : microDegrees;
+  // 1e-6 degrees * 60 = 1e-4 minutes * 0.6
+  minutes = ((value % 1000000) * 6 + 5) / 10;
+  return value / 1000000;
 }
 
-void TK102Packet::buildPacket(char *buf, int bufSize)
-{  
-  float latitudeAbs = fabsf(latitude);
-  float latitudeDeg = floorf(latitudeAbs);
-  float latitudeMin = 60 * (latitudeAbs - latitudeDeg);
-  char  latitudeSign = (latitude >= 0) ? 'N' : 'S';
+/// value / divisor rounded half up
+static uint32_t divRound(uint64_t value, uint32_t divisor) {
+  return (value + divisor / 2) / divisor;
+}
 
-  float longitudeAbs = fabsf(longitude);
-  float longitudeDeg = floorf(longitudeAbs);
-  float longitudeMin = 60 * (longitudeAbs - longitudeDeg);
-  char  longitudeSign = (longitude >= 0) ? 'E' : 'W';
+/*
+ * Single pass writer for TK102 sentences. Numbers are formatted from
+ * integers, and the NMEA checksum (between beginNMEA() and endNMEA()) and
+ * the CRC16 (until checksum() is called) follow the bytes as they are
+ * written, so the output is never scanned again.
+ */
+class SentenceWriter {
+public:
+  SentenceWriter(char *buffer, int bufSize) {
+    _buffer = buffer;
+    _capacity = bufSize - 1;
+    _length = 0;
+    _inNMEA = false;
+    _nmeaChecksum = 0;
+    _inCRC = true;
+    _checksum = 0;
+  }
 
-  //dbg.printf("Lat deg/min: %.0f %.4f\n", latitudeDeg, latitudeMin);
-  //dbg.printf("Lon deg/min: %.0f %.4f\n", longitudeDeg, longitudeMin);
-  
-  // GPRMC,201120.000,A,5657.5108,N,02410.6618,E,0.00,67.76,110716,,,A*5D
-  char nmea[100];
-  snprintf(nmea, 100, 
-    "GPRMC,%.10s,A,%02.0f%07.4f,%c,%03.0f%07.4f,%c,"  
-    "%.1f,%.1f,%.6s,%s,%s,A",
-    gpsTime, latitudeDeg, latitudeMin, latitudeSign, longitudeDeg, longitudeMin, longitudeSign,
-    speedKnots, course, gpsDate, "", ""
-  );
-  uint8_t nmeaChecksum = getNMEAChecksum(nmea);
-  
-	uint16_t packetSize = snprintf(buf, bufSize, 
-		"%.12s,%.20s,%s*%02X," 
-		"%c,%.8s,imei:%.16s,%d,%.1f,"
-		"%c:%.2fV,%c",
-		datetime, allowedNumber, nmea, nmeaChecksum,
-		fix, status, imei, satCount, altitude, 
-		batteryStatus, batteryVoltage, externalPower ? '1' : '0'
-	);
- 
-	CRC16<0xA001, true> crc;
-	uint16_t checksum = crc.update(buf);
-
-	snprintf(buf + packetSize, bufSize - packetSize, 
-		",%d,%d,%s,%s,%s,%s", packetSize, checksum, mcc, mnc, lac, cellID
-	);
+  void put(char c) {
+    if (_length < _capacity) {
+      _buffer[_length++] = c;
+    }
+    if (_inNMEA) _nmeaChecksum ^= c;
+    if (_inCRC) _checksum = _crc.update(c);
+  }
+
+  void put(const char *str, int maxLength = 0x7FFF) {
+    while (maxLength-- > 0 && *str) {
+      put(*str++);
+    }
+  }
+
+  void putUnsigned(uint32_t value, uint8_t minDigits = 1) {
+    char digits[10];
+    uint8_t count = 0;
+    do {
+      digits[count++] = '0' + value % 10;
+      value /= 10;
+    } while (value > 0);
+    while (count < minDigits) digits[count++] = '0';
+    while (count > 0) put(digits[--count]);
+  }
+
+  void putInt(int32_t value) {
+    if (value < 0) {
+      put('-');
+      putUnsigned(-(uint32_t)value);
+    }
+    else {
+      putUnsigned(value);
+    }
+  }
+
+  /// Write scaled / 10^decimals with a fixed number of decimals ("12.4")
+  void putFixed(uint32_t scaled, uint8_t decimals, bool negative = false) {
+    uint32_t scale = 1;
+    for (uint8_t idx = 0; idx < decimals; idx++) scale *= 10;
+
+    if (negative) put('-');
+    putUnsigned(scaled / scale);
+    put('.');
+    putUnsigned(scaled % scale, decimals);
+  }
+
+  void putHex(uint8_t value) {
+    const char *hex = "0123456789ABCDEF";
+    put(hex[value >> 4]);
+    put(hex[value & 0x0F]);
+  }
+
+  void beginNMEA() { _inNMEA = true; _nmeaChecksum = 0; }
+  uint8_t endNMEA() { _inNMEA = false; return _nmeaChecksum; }
+
+  /// CRC16 of everything written so far, later bytes are not included
+  uint16_t checksum() { _inCRC = false; return _checksum; }
+
+  /// Terminate the string, returns its length
+  int finish() {
+    _buffer[_length] = '\0';
+    return _length;
+  }
+
+  int length() { return _length; }
+
+private:
+  char *  _buffer;
+  int     _capacity;
+  int     _length;
+  bool    _inNMEA;
+  uint8_t _nmeaChecksum;
+  bool    _inCRC;
+  uint16_t _checksum;
+  CRC16<0xA001, true> _crc;
+};
+
+int TK102Packet::buildPacket(char *buf, int bufSize)
+{
+  if (bufSize < 1) return 0;
+
+  uint32_t latitudeMin;
+  uint32_t latitudeDeg = toDegreesMinutes(latitude, latitudeMin);
+  char     latitudeSign = (latitude >= 0) ? 'N' : 'S';
+
+  uint32_t longitudeMin;
+  uint32_t longitudeDeg = toDegreesMinutes(longitude, longitudeMin);
+  char     longitudeSign = (longitude >= 0) ? 'E' : 'W';
+
+  // 0.01 km/h to 0.1 knots (1.852 km/h each), mm to 0.1 m, mV to 0.01 V
+  uint32_t altitudeAbs = (altitude < 0) ? -(uint32_t)altitude : altitude;
+
+  SentenceWriter out(buf, bufSize);
+
+  // 160711201120,,GPRMC,201120.000,A,5657.5108,N,02410.6618,E,0.0,67.8,110716,,,A*5D,
+  out.put(datetime, 12);
+  out.put(',');
+  out.put(allowedNumber, 20);
+  out.put(',');
+
+  out.beginNMEA();
+  out.put("GPRMC,");
+  out.put(gpsTime, 10);
+  out.put(",A,");
+  out.putUnsigned(latitudeDeg, 2);
+  out.putUnsigned(latitudeMin / 10000, 2);
+  out.put('.');
+  out.putUnsigned(latitudeMin % 10000, 4);
+  out.put(',');
+  out.put(latitudeSign);
+  out.put(',');
+  out.putUnsigned(longitudeDeg, 3);
+  out.putUnsigned(longitudeMin / 10000, 2);
+  out.put('.');
+  out.putUnsigned(longitudeMin % 10000, 4);
+  out.put(',');
+  out.put(longitudeSign);
+  out.put(',');
+  out.putFixed(divRound((uint64_t)speed * 100, 1852), 1);
+  out.put(',');
+  out.putFixed(divRound(course, 10), 1);
+  out.put(',');
+  out.put(gpsDate, 6);
+  out.put(",,,A");
+  uint8_t nmeaChecksum = out.endNMEA();
+  out.put('*');
+  out.putHex(nmeaChecksum);
+  out.put(',');
+
+  // F,,imei:123456789012345,10,12.4,F:4.24V,0
+  out.put(fix);
+  out.put(',');
+  out.put(status, 8);
+  out.put(",imei:");
+  out.put(imei, 16);
+  out.put(',');
+  out.putInt(satCount);
+  out.put(',');
+  out.putFixed(divRound(altitudeAbs, 100), 1, altitude < 0);
+  out.put(',');
+  out.put(batteryStatus);
+  out.put(':');
+  out.putFixed(divRound(batteryVoltage, 10), 2);
+  out.put("V,");
+  out.put(externalPower ? '1' : '0');
+
+  // ,<size>,<CRC16>,mcc,mnc,lac,cellID (size and CRC16 cover the part above)
+  int packetSize = out.length();
+  uint16_t checksum = out.checksum();
+  out.put(',');
+  out.putInt(packetSize);
+  out.put(',');
+  out.putUnsigned(checksum);
+  out.put(',');
+  out.put(mcc, sizeof(mcc));
+  out.put(',');
+  out.put(mnc, sizeof(mnc));
+  out.put(',');
+  out.put(lac, sizeof(lac));
+  out.put(',');
+  out.put(cellID, sizeof(cellID));
+
+  return out.finish();
 }
 
 
@@ -212,88 +331,170 @@ void TK102Packet::buildPacket(char *buf, int bufSize)
  *  <VPA> 
  */
 
-bool TK102Packet::update(char *str) {
-  SimpleTokenizer tokenizer(str, ',');
-  char *tok;
-  
-  // <GNSS run status>,     1   0-1
-  tok = tokenizer.next();
-  if (! tok) return false;
-  
-  // <Fix status>,          1   0-1
-  tok = tokenizer.next();
-  if (! tok) return false;
-  if (strcmp(tok, "1") == 0) {
-    fix = 'F';
+static bool isFieldEnd(char c) {
+  return c == ',' || c == '\0' || c == '\r' || c == '\n';
+}
+
+/*
+ * Read the decimal number at str ("-12.3456") as an integer scaled by
+ * 10^decimals, rounding half away from zero on the first dropped digit.
+ * str is left at the end of the field. Returns false, with value 0, for an
+ * empty, malformed or out of range field.
+ */
+static bool parseFixed(const char *&str, uint8_t decimals, int32_t &value) {
+  value = 0;
+
+  bool negative = (*str == '-');
+  if (*str == '-' || *str == '+') str++;
+
+  uint32_t result = 0;
+  uint8_t digits = 0;
+  uint8_t fraction = 0;
+  bool inFraction = false;
+  bool dropped = false;
+  bool roundUp = false;
+  bool valid = true;
+
+  for (;; str++) {
+    char c = *str;
+    if (c >= '0' && c <= '9') {
+      digits++;
+      if (!inFraction || fraction < decimals) {
+        if (result > 200000000) valid = false;    // keeps result * 10 + 9 < 2^31
+        result = result * 10 + (c - '0');
+        if (inFraction) fraction++;
+      }
+      else if (!dropped) {
+        // First dropped digit decides the rounding, the rest are ignored
+        roundUp = (c >= '5');
+        dropped = true;
+      }
+    }
+    else if (c == '.' && !inFraction) {
+      inFraction = true;
+    }
+    else {
+      break;
+    }
   }
-  else {
-    fix = 'L';
+
+  // Trailing garbage invalidates the field
+  if (!isFieldEnd(*str)) {
+    valid = false;
+    while (!isFieldEnd(*str)) str++;
   }
-    
-  // <UTC date & Time>,     18  yyyyMMddhhmmss.sss
-  tok = tokenizer.next();
-  if (! tok) return false;  
+  if (!valid || digits == 0) return false;
+
+  for (; fraction < decimals; fraction++) {
+    if (result > 200000000) return false;
+    result *= 10;
+  }
+  if (roundUp) result++;
+
+  value = negative ? -(int32_t)result : (int32_t)result;
+  return true;
+}
+
+bool GNSSFix::parse(const char *str) {
+  *this = GNSSFix();
+  while (*str == ' ') str++;
+
+  // Decimals kept per field, see the field list above
+  static const uint8_t decimals[21] = {
+    0, 0, 0, 6, 6, 3, 2, 2, 0, 0, 2, 2, 2, 0, 0, 0, 0, 0, 0, 0, 0
+  };
+
+  for (uint8_t field = 0; field < 21; field++) {
+    int32_t value = 0;
+    if (field == 2) {
+      // <UTC date & Time> is kept as text
+      uint8_t length = 0;
+      while (!isFieldEnd(*str)) {
+        if (length < sizeof(datetime) - 1) datetime[length++] = *str;
+        str++;
+      }
+      datetime[length] = '\0';
+    }
+    else {
+      parseFixed(str, decimals[field], value);
+      // Only latitude, longitude and altitude can be negative
+      if (value < 0 && (field < 3 || field > 5)) value = 0;
+    }
+
+    switch (field) {
+      case 0:   running = (value == 1); break;
+      case 1:   valid = (value == 1); break;
+      case 3:   latitude = value; break;
+      case 4:   longitude = value; break;
+      case 5:   altitude = value; break;
+      case 6:   speed = value; break;
+      case 7:   course = value % 36000; break;
+      case 8:   fixMode = value; break;
+      case 10:  hdop = value; break;
+      case 11:  pdop = value; break;
+      case 12:  vdop = value; break;
+      case 14:  satsInView = value; break;
+      case 15:  satsUsed = value; break;
+      case 16:  glonassUsed = value; break;
+      case 18:  cn0Max = value; break;
+    }
+
+    if (*str != ',') {
+      // End of line, everything up to <GNSS Satellites Used> is required
+      return field >= 15;
+    }
+    str++;
+  }
+
+  return true;
+}
+
+bool TK102Packet::update(char *str) {
+  GNSSFix fix;
+  if (!fix.parse(str)) return false;
+  return update(fix);
+}
+
+bool TK102Packet::update(const GNSSFix &gnss) {
+  fix = gnss.valid ? 'F' : 'L';
+  
+  const char *tok = gnss.datetime;
   if (strlen(tok) < 14) return false;
   memcpy(datetime, tok + 2, 12);    // Convert to yyMMddhhmmss
   // Convert to ddMMyy
   memcpy(gpsDate, tok + 6, 2);     	// Copy dd
   memcpy(gpsDate + 2, tok + 4, 2); 	// Copy MM
   memcpy(gpsDate + 4, tok + 2, 2); 	// Copy yy
+  memset(gpsTime, 0, sizeof(gpsTime));           // a shorter time must not keep old digits
   memcpy(gpsTime, tok + 8, strlen(tok) - 8);     // Convert to hhmmss[.sss]
-  
-  // <Latitude>,            10  +dd.dddddd
-  tok = tokenizer.next();
-  if (! tok) return false;
-  sscanf(tok, "%f", &latitude);
-
-  // <Longitude>,           11  +ddd.dddddd
-  tok = tokenizer.next();
-  if (! tok) return false;
-  sscanf(tok, "%f", &longitude);
-  
-  //dbg.printf("Lat/long: %.6f %.6f\n", latitude, longitude);
-
-  // <MSL Altitude>,        8
-  tok = tokenizer.next();
-  if (! tok) return false;
-  sscanf(tok, "%f", &altitude);  
-
-  // <Speed Over Ground>,   6
-  tok = tokenizer.next();
-  if (! tok) return false;
-  float speedKMH;
-  sscanf(tok, "%f", &speedKMH);    
-  speedKnots = speedKMH / 1.852;    // Convert km/h to knots
-  
-  // <Course Over Ground>,  6
-  tok = tokenizer.next();
-  if (! tok) return false;
-  sscanf(tok, "%f", &course);  
-  
-  // Skip 7 fields
-  for (int index = 0; index < 7; index++) {
-    tok = tokenizer.next();
-    if (! tok) return false;
-  }
-  
-  // <GNSS Satellites Used>
-  tok = tokenizer.next();
-  if (! tok) return false;
-  sscanf(tok, "%d", &satCount);  
+
+  latitude = gnss.latitude;
+  longitude = gnss.longitude;
+  altitude = gnss.altitude;
+  speed = gnss.speed;
+  course = gnss.course;
+  satCount = gnss.satsUsed;
   
   return true;
 }
 
-bool TK102Packet::update(Adafruit_FONA &fona) {  
+void TK102Packet::updateBattery(Adafruit_FONA &fona) {
   uint16_t millivolts;
   fona.getBattVoltage(&millivolts);
-  batteryVoltage = millivolts * 0.001f;
   uint16_t percent;
   fona.getBattPercent(&percent);
+  updateBattery(millivolts, percent);
+}
+
+void TK102Packet::updateBattery(uint16_t millivolts, uint16_t percent) {
+  batteryVoltage = millivolts;
   batteryStatus = (percent > batteryThreshold) ? 'F' : 'L';
+}
+
+bool TK102Packet::update(Adafruit_FONA &fona) {  
+  updateBattery(fona);
   
   char gpsStatus[120];
   fona.getGPS(0, gpsStatus, 120);
-  //dbg.printf("GPS  : %s\n", gpsStatus);
   return update(gpsStatus);
 }
@@ -1,3 +1,6 @@
+#ifndef GPSDATA_H
+#define GPSDATA_H
+
 #include <stdint.h>
 #include <cmath>
 
@@ -18,12 +21,12 @@ struct Location2D {
   float metersTo(const Location2D &other) {
     float phi1 = latitude / 180.0f * M_PI;
     float phi2 = other.latitude / 180.0f * M_PI;
-    float dphi = phi1 - phi1;
+    float dphi = phi2 - phi1;
     float dlam = (other.longitude - longitude) / 180.0f * M_PI;
 
     float a = sinf(dphi/2) * sinf(dphi/2) +
             cosf(phi1) * cosf(phi2) *
-            sinf(dlam/2) * sin(dlam/2);
+            sinf(dlam/2) * sinf(dlam/2);
     float c = 2 * atan2f(sqrtf(a), sqrtf(1-a));
 
     float R = 6371e3; // metres (radius)
@@ -31,6 +34,46 @@ struct Location2D {
   }
 };
 
+// Meters per 1e-6 degree of latitude (and of longitude at the equator), on
+// the sphere of Location2D::metersTo(), for the micro-degrees of GNSSFix
+const float metersPerMicroDegree = 0.111195f;
+
+/// One +CGNSINF / +UGNSINF report in fixed point, parsed once and shared by all users
+struct GNSSFix {
+  bool     running;       // <GNSS run status>
+  bool     valid;         // <Fix status>
+  char     datetime[19];  // yyyyMMddhhmmss.sss
+  int32_t  latitude;      // 1e-6 degrees
+  int32_t  longitude;     // 1e-6 degrees
+  int32_t  altitude;      // MSL, mm
+  uint32_t speed;         // 0.01 km/h
+  uint16_t course;        // 0.01 degrees
+  uint8_t  fixMode;
+  uint16_t hdop;          // 0.01
+  uint16_t pdop;          // 0.01
+  uint16_t vdop;          // 0.01
+  uint8_t  satsInView;
+  uint8_t  satsUsed;      // GNSS satellites used
+  uint8_t  glonassUsed;
+  uint8_t  cn0Max;        // dBHz
+  
+  GNSSFix() : running(false), valid(false), latitude(0), longitude(0), 
+    altitude(0), speed(0), course(0), fixMode(0), hdop(0), pdop(0), vdop(0),
+    satsInView(0), satsUsed(0), glonassUsed(0), cn0Max(0) {
+    datetime[0] = '\0';
+  }
+  
+  /**
+   * Parse the payload following "+CGNSINF: " or "+UGNSINF: " in one pass,
+   * without modifying str. Empty fields read as 0. Fails if the line ends
+   * before <GNSS Satellites Used>.
+   */
+  bool parse(const char *str);
+  
+  /// GPS status as returned by Adafruit_FONA::GPSstatus()
+  int status() const { return !running ? 0 : (valid ? 3 : 1); }
+};
+
 class TK102Packet {
 public:
   /// Initialize with reasonable defaults
@@ -40,18 +83,23 @@ public:
   
   /// Update packet fields from GPSINF data 
   bool update(char *str);
+  bool update(const GNSSFix &fix);
   bool update(Adafruit_FONA &fona);
   
-  /// Build TK102 sentence (packet)
-  void buildPacket(char *buf, int bufSize);
+  /// Update battery fields only (position comes from a GNSSFix)
+  void updateBattery(Adafruit_FONA &fona);
+  void updateBattery(uint16_t millivolts, uint16_t percent);
+  
+  /// Build TK102 sentence (packet), returns its length
+  int buildPacket(char *buf, int bufSize);
   
   // GPRMC fields
   char  gpsDate[6];
   char  gpsTime[10];
-  float latitude;
-  float longitude;
-  float speedKnots;
-  float course;
+  int32_t  latitude;         // 1e-6 degrees, sent as 5657.5108,N
+  int32_t  longitude;        // 1e-6 degrees, sent as 02410.6618,E
+  uint32_t speed;            // 0.01 km/h, sent in knots (0.0)
+  uint16_t course;           // 0.01 degrees, sent as 67.8
   
   // Other data fields
   char  datetime[12];        // 160711201120
@@ -60,9 +108,9 @@ public:
   char  status[8];           // START
   char  imei[16];            // 123456789012345
   int   satCount;            // 10
-  float altitude;           // 12.4
+  int32_t  altitude;        // mm, sent as 12.4
   char  batteryStatus;      // (F)ull / (L)ow
-  float batteryVoltage;     // 4.24
+  uint16_t batteryVoltage;  // mV, sent as 4.24
   bool  externalPower;
   int   lastPacketSize;     // 160
   
@@ -71,8 +119,6 @@ public:
   char  mnc[5];
   char  lac[8];
   char  cellID[6];
-
-private:
-
-  uint8_t getNMEAChecksum(char *nmea);
 };
+
+#endif
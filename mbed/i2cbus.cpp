@@ -0,0 +1,107 @@
+#include "i2cbus.h"
+
+#include <cstring>
+
+I2CBus::I2CBus(I2C &bus)
+  : _bus(bus), _thread(osPriorityAboveNormal, 1024), _queued(0), _lastBusyUs(0), _lastTimeUs(0)
+{
+  memset(&_counters, 0, sizeof(_counters));
+}
+
+bool I2CBus::start() {
+  _timer.start();
+  return _thread.start(this, &I2CBus::run) == osOK;
+}
+
+bool I2CBus::submit(const I2CTransaction &transaction) {
+  if (transaction.writeLength > I2CTransaction::kMaxWrite ||
+      transaction.readLength > I2CTransaction::kMaxRead)
+  {
+    return false;
+  }
+
+  I2CTransaction *slot = _mail.alloc();
+  if (!slot) {
+    _counters.rejected++;
+    return false;
+  }
+  *slot = transaction;
+
+  uint8_t queued = core_util_atomic_incr_u8(&_queued, 1);
+  if (queued > _counters.maxQueued) _counters.maxQueued = queued;
+  _mail.put(slot);
+  return true;
+}
+
+struct Waiter {
+  Semaphore         done;
+  I2CTransaction *  result;
+
+  Waiter(I2CTransaction *result) : done(0), result(result) {}
+};
+
+static void onTransactionDone(const I2CTransaction &transaction) {
+  Waiter *waiter = (Waiter *)transaction.context;
+  memcpy(waiter->result->read, transaction.read, transaction.readLength);
+  waiter->result->success = transaction.success;
+  waiter->done.release();
+}
+
+bool I2CBus::transact(I2CTransaction &transaction) {
+  Waiter waiter(&transaction);
+
+  I2CTransaction request = transaction;
+  request.callback = onTransactionDone;
+  request.context = &waiter;
+  if (!submit(request)) return false;
+
+  waiter.done.wait();
+  return transaction.success;
+}
+
+uint8_t I2CBus::getUtilization() {
+  uint32_t now = _timer.read_us();
+  uint32_t busy = _counters.busyUs;
+  uint32_t elapsed = now - _lastTimeUs;
+  uint32_t used = busy - _lastBusyUs;
+  _lastTimeUs = now;
+  _lastBusyUs = busy;
+  return (elapsed > 0) ? (uint64_t)used * 100 / elapsed : 0;
+}
+
+void I2CBus::run() {
+  while (true) {
+    osEvent event = _mail.get();
+    if (event.status != osEventMail) continue;
+
+    I2CTransaction *transaction = (I2CTransaction *)event.value.p;
+    execute(*transaction);
+    core_util_atomic_decr_u8(&_queued, 1);
+    if (transaction->callback) {
+      transaction->callback(*transaction);
+    }
+    _mail.free(transaction);
+  }
+}
+
+void I2CBus::execute(I2CTransaction &transaction) {
+  uint32_t start = _timer.read_us();
+
+  bool success = true;
+  if (transaction.writeLength > 0) {
+    success = (0 == _bus.write(transaction.address, (const char *)transaction.write, transaction.writeLength));
+  }
+  if (success && transaction.readLength > 0) {
+    success = (0 == _bus.read(transaction.address, (char *)transaction.read, transaction.readLength));
+  }
+  transaction.success = success;
+
+  _counters.busyUs += _timer.read_us() - start;
+  _counters.transactions++;
+  if (success) {
+    _counters.bytes += transaction.writeLength + transaction.readLength;
+  }
+  else {
+    _counters.failures++;
+  }
+}
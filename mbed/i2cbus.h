@@ -0,0 +1,89 @@
+#ifndef I2CBUS_H
+#define I2CBUS_H
+
+#include <stdint.h>
+
+#include "mbed.h"
+#include "rtos.h"
+
+/**
+ * One write-then-read transfer on an I2C bus. Either part may be empty.
+ * The read data is in read[] when the callback runs.
+ */
+struct I2CTransaction {
+  enum {
+    kMaxWrite       = 4,
+    kMaxRead        = 8
+  };
+
+  uint8_t   address;              // 8 bit (shifted) address
+  uint8_t   writeLength;
+  uint8_t   write[kMaxWrite];
+  uint8_t   readLength;
+  uint8_t   read[kMaxRead];
+  bool      success;
+
+  /// Runs in the bus thread, keep it short and do not wait on the bus from it
+  void    (*callback)(const I2CTransaction &transaction);
+  void *    context;
+
+  I2CTransaction(uint8_t address = 0)
+    : address(address), writeLength(0), readLength(0), success(false), callback(0), context(0) {}
+};
+
+/**
+ * Transaction queue for an I2C bus shared by several drivers.
+ *
+ * Drivers submit transactions from any thread and return right away; a
+ * bus thread runs them in order and reports each one through its
+ * callback. Threads never wait for the bus unless they use transact().
+ */
+class I2CBus {
+public:
+  enum {
+    kQueueSize      = 8
+  };
+
+  I2CBus(I2C &bus);
+
+  /// Start the bus thread, call once before submitting
+  bool start();
+
+  /// Queue a transaction (copied), false if the queue is full
+  bool submit(const I2CTransaction &transaction);
+
+  /**
+   * Queue a transaction and wait for it, the results are copied back.
+   * Not from the bus thread (i.e. not from a transaction callback).
+   */
+  bool transact(I2CTransaction &transaction);
+
+  struct Counters {
+    uint32_t transactions;    // completed
+    uint32_t failures;        // NACK or timeout
+    uint32_t rejected;        // queue full
+    uint32_t bytes;           // written and read
+    uint32_t busyUs;          // time spent in transfers
+    uint8_t  maxQueued;       // queue high-water mark
+  };
+
+  const Counters & getCounters() { return _counters; }
+
+  /// Percent of the time the bus was busy since the last call
+  uint8_t getUtilization();
+
+private:
+  I2C &         _bus;
+  Thread        _thread;
+  Mail<I2CTransaction, kQueueSize> _mail;
+  uint8_t       _queued;
+  Counters      _counters;
+  Timer         _timer;
+  uint32_t      _lastBusyUs;
+  uint32_t      _lastTimeUs;
+
+  void run();
+  void execute(I2CTransaction &transaction);
+};
+
+#endif
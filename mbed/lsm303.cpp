@@ -0,0 +1,40 @@
+#include "lsm303.h"
+
+// Output is 12 bit left aligned, 2 mg per LSB at +-4 g
+static const float kMetersPerLSB = 0.002f * 9.80665f / 16;
+
+LSM303Accel::LSM303Accel(I2CBus &bus) : _bus(bus) {
+  _address = 0x19 << 1;
+}
+
+bool LSM303Accel::writeRegister(uint8_t reg, uint8_t value) {
+  I2CTransaction transaction(_address);
+  transaction.write[0] = reg;
+  transaction.write[1] = value;
+  transaction.writeLength = 2;
+  return _bus.transact(transaction);
+}
+
+bool LSM303Accel::initialize() {
+  // 100 Hz, X, Y and Z enabled
+  if (!writeRegister(kRegCtrl1, 0x57)) return false;
+  // Block data update, +-4 g, high resolution
+  return writeRegister(kRegCtrl4, 0x98);
+}
+
+bool LSM303Accel::queueRead(void (*callback)(const I2CTransaction &), void *context) {
+  I2CTransaction transaction(_address);
+  transaction.write[0] = kRegOutX | kAutoIncrement;
+  transaction.writeLength = 1;
+  transaction.readLength = 6;
+  transaction.callback = callback;
+  transaction.context = context;
+  return _bus.submit(transaction);
+}
+
+void LSM303Accel::toAcceleration(const I2CTransaction &transaction, float &x, float &y, float &z) {
+  const uint8_t *data = transaction.read;
+  x = (int16_t)(data[0] | (data[1] << 8)) * kMetersPerLSB;
+  y = (int16_t)(data[2] | (data[3] << 8)) * kMetersPerLSB;
+  z = (int16_t)(data[4] | (data[5] << 8)) * kMetersPerLSB;
+}
@@ -0,0 +1,39 @@
+#ifndef LSM303_H
+#define LSM303_H
+
+#include <stdint.h>
+
+#include "i2cbus.h"
+
+/**
+ * Accelerometer half of the LSM303DLHC (on the STM32F3-Discovery, sharing
+ * I2C1 with the barometer). Runs at 100 Hz, +-4 g, high resolution.
+ */
+class LSM303Accel {
+public:
+  LSM303Accel(I2CBus &bus);
+
+  /// Configure the sensor, waits for the bus
+  bool initialize();
+
+  /// Queue a read of the X, Y and Z outputs, callback gets the 6 bytes in read[]
+  bool queueRead(void (*callback)(const I2CTransaction &), void *context);
+
+  /// Acceleration in m/s^2 from a completed read, in sensor axes
+  static void toAcceleration(const I2CTransaction &transaction, float &x, float &y, float &z);
+
+private:
+  I2CBus &_bus;
+  uint8_t _address;
+
+  enum Registers {
+    kRegCtrl1       = 0x20,
+    kRegCtrl4       = 0x23,
+    kRegOutX        = 0x28,
+    kAutoIncrement  = 0x80
+  };
+
+  bool writeRegister(uint8_t reg, uint8_t value);
+};
+
+#endif
@@ -7,8 +7,14 @@
 #include "gpsdata.h"
 #include "pubnub.h"
 #include "vario.h"
+#include "lsm303.h"
 #include "baro.h"
 #include "crc.h"
+#include "uplink.h"
+#include "posqueue.h"
+#include "binproto.h"
+#include "schedule.h"
+#include "geofence.h"
 
 const PinName I2CSDAPin = PB_7;
 const PinName I2CSCLPin = PB_6;
@@ -18,6 +24,11 @@ const PinName SD_MISO   = PC_11;
 const PinName SD_SCK    = PC_10;
 const PinName SD_NSS    = PD_1;
 
+enum Protocol {
+  kProtocolTK102  = 0,    // TK102 text sentences
+  kProtocolBinary = 1     // compact frames, see binproto.h
+};
+
 struct Settings {
   char pin[8];
   char gprsAPN[32];
@@ -26,6 +37,9 @@ struct Settings {
   int  rangeHor;
   int  rangeVert;
   char alertPhone[32];
+  int  protocol;          // optional 8th setting, "tk102" (default) or "binary"
+  int  batchSize;         // optional 9th setting, fixes per uplink batch (default 1)
+  int  batchInterval;     // optional 10th setting, max seconds a fix waits for its batch (default 30)
 };
 
 Settings gSettings;
@@ -44,6 +58,27 @@ Settings gSettings;
 #define TRACK_SERVER	"sns.lv"
 #define TRACK_PORT		9001
 
+// Fixes between +UGNSINF reports pushed by the module, 0 to poll +CGNSINF instead
+#define GNSS_REPORT_PERIOD  1
+
+// Tracking loop period in ms; which fixes get reported is up to ReportScheduler
+#define TRACK_LOOP_PERIOD   1000
+
+// Allowed area; without it a circle of rangeHor around the first fix
+#define GEOFENCE_FILE       "/sd/fence.txt"
+
+// Meters below rangeVert to come back down to before the altitude alert clears
+#define CEILING_MARGIN      5
+
+// Print cycles per geofence check at startup
+#define GEOFENCE_BENCHMARK  0
+
+// Print cycles per MS5607 compensation at startup
+#define BARO_BENCHMARK      0
+
+// Print encode time and size of the uplink formats at startup
+#define PROTOCOL_BENCHMARK  0
+
 DigitalOut led1(LED3);		// red		indicates GPRS connection status
 DigitalOut led2(LED4);		// blue		indicates GPS lock
 DigitalOut led3(LED5);		// orange	indicated GSM status
@@ -61,17 +96,34 @@ DigitalIn  fonaPstat(PA_4);
 // PinName tx, PinName rx, PinName rst, PinName ringIndicator
 Adafruit_FONA fona(PA_2, PA_3, PF_4, PA_0);
 
-I2C sensorBus(I2CSDAPin, I2CSCLPin);
+I2C sensorI2C(I2CSDAPin, I2CSCLPin);
+I2CBus sensorBus(sensorI2C);        // shared by the sensor drivers, see i2cbus.h
 Barometer barometer(sensorBus);
+LSM303Accel accelerometer(sensorBus);
 
-//Variometer vario;
+Variometer vario;
 
 SDFileSystem sd(SD_MOSI, SD_MISO, SD_SCK, SD_NSS, "sd");
 
 bool publishLocation(Adafruit_FONA &fona);
-bool publishLocation2(Adafruit_FONA &fona);
+bool queueReport(const GNSSFix &fix);
+bool flushReports();
+bool flushBacklog();
+void benchmarkProtocols();
+void benchmarkGeofence();
+void benchmarkBarometer();
 
 TK102Packet packet;
+BinaryEncoder binEncoder;
+BatchEncoder batchEncoder;
+UplinkSession uplink(fona, TRACK_SERVER, TRACK_PORT);
+ReportScheduler scheduler;
+Geofence geofence;
+PositionQueue backlog("/sd/backlog.bin", 4096);    // 4096 reports, 768 KB
+
+// Reports queued since the last uplink flush
+uint32_t pendingReports = 0;
+Timer    pendingTimer;
 
 volatile int  gpsStatus = 0;
 volatile int  gprsStatus = 0;
@@ -100,7 +152,12 @@ void ledTimerTask(void const *argument) {
   isOn = !isOn;
 }
 
+// Set while the beeps or the geofence alarm own the buzzer, the vario keeps quiet
+volatile bool beeping = false;
+volatile bool alarmOn = false;
+
 void beepTimes(uint8_t times) {
+	beeping = true;
 	int frequency = 880;
 	buzzer.period(1.0f / frequency);
 	for (; times > 0; times--) {
@@ -111,9 +168,11 @@ void beepTimes(uint8_t times) {
 			Thread::wait(400);
 		}
 	}
+	beeping = false;
 }
 
 void beepSuccess(bool success) {
+	beeping = true;
 	int frequency1 = 440;
 	int frequency2 = 660;
 	buzzer.period(1.0f / (success ? frequency1 : frequency2));
@@ -122,6 +181,131 @@ void beepSuccess(bool success) {
 	buzzer.period(1.0f / (success ? frequency2 : frequency1));
 	Thread::wait(success ? 100 : 400);
 	buzzer = 0;
+	beeping = false;
+}
+
+// ms between barometer samples
+const uint32_t varioPeriod = 10;
+
+bool haveAccelerometer = false;
+
+// Set once background sampling updates the vario
+volatile bool varioRunning = false;
+
+// Runs in the bus thread with each accelerometer sample
+void varioAccel(const I2CTransaction &transaction) {
+  if (!transaction.success) return;
+  float x, y, z;
+  LSM303Accel::toAcceleration(transaction, x, y, z);
+  vario.setAcceleration(x, y, z);
+}
+
+// Runs in the bus thread after each new pressure value
+void varioMeasure() {
+  static Timer timer;
+  static bool running = false;
+  
+  // Temperature conversions leave gaps, so use the actual interval
+  float dt = running ? timer.read() : varioPeriod * 0.001f;
+  timer.reset();
+  if (!running) {
+    timer.start();
+    running = true;
+  }
+  
+  vario.update(barometer.getPressure(), dt);
+  
+  // Fresh acceleration for the next update, the sensor runs at 100 Hz too
+  if (haveAccelerometer) {
+    accelerometer.queueRead(varioAccel, 0);
+  }
+}
+
+float climbThreshold = 0.10f;
+float sinkThreshold = -0.10f;
+
+void varioTask(void const *argument) {    
+    //sensorBus.frequency(100000);
+    if (barometer.reset()) {
+      dbg.printf("Barometer reset!\n");
+    }
+    else {
+      dbg.printf("Barometer not found!\n");
+    }
+    Thread::wait(50);
+    
+    if (!barometer.initialize()) {
+      dbg.printf("Failed to initialize!\n");
+      return;
+    }
+    
+    haveAccelerometer = accelerometer.initialize();
+    if (!haveAccelerometer) {
+      dbg.printf("Accelerometer not found, barometer only\n");
+    }
+    
+    // Calculate initial pressure by averaging measurements
+    int idx = 0;
+    float avgPressure = 0;
+    while (idx < 50) {
+      if (barometer.update()) {
+        avgPressure += barometer.getPressure();
+        idx++;
+      }
+    }
+    avgPressure /= idx;
+    vario.reset(avgPressure);
+
+    // Sample in the background, vario is updated with every new pressure
+    barometer.attach(varioMeasure);
+    if (!barometer.startSampling(varioPeriod)) {
+      dbg.printf("Barometer sampling failed to start!\n");
+      return;
+    }
+    varioRunning = true;
+    Thread::wait(1000);
+    dbg.printf("Barometer: %lu samples in the first second\n", barometer.getSampleCount());
+
+    // Keep checking vertical speed
+    idx = 0;
+    int period = 10;
+    bool phase = false;
+    while (true) {
+      if (beeping || alarmOn) {
+        idx = 0;
+        Thread::wait(15);
+        continue;
+      }
+      if (idx >= period) {
+        //if (fabsf(vertSpeed) > 0.1f) {
+        //  dbg.printf("Vertical speed: % .1f\tPressure: %.0f\n", vertSpeed, pFilt);
+        //}
+        
+        float vertSpeed = vario.getVerticalSpeed();
+        if (vertSpeed > climbThreshold) {
+          float frequency = 440 + 220 * vertSpeed;
+          buzzer.period(1.0f / frequency);
+          period = 20 - 7 * vertSpeed;
+          if (period < 3) period = 3;
+          buzzer = phase ? 0.5f : 0;
+        }
+        else if (vertSpeed < sinkThreshold) {
+          //float frequency = 440 + 220 * vertSpeed;
+          //buzzer.period(1.0f / frequency);
+          //buzzer = 0.5f;
+          buzzer = 0;
+        }
+        else {
+          buzzer = 0;
+        }
+        
+        phase = !phase;
+        idx = 0;
+      }
+        
+      idx++;
+      Thread::wait(15);
+    }
 }
 
 void testFonaTask(void const *argument) 
@@ -184,6 +368,8 @@ void trackingTask(void const *argument)
     if (fona.getIMEI(imei)) {
       dbg.printf("IMEI: %.16s\n", imei);
       packet.setIMEI(imei);
+      binEncoder.setIMEI(imei);
+      batchEncoder.setIMEI(imei);
     }
 
     dbg.printf("Unlocking SIM...\n");
@@ -191,6 +377,7 @@ void trackingTask(void const *argument)
             
     dbg.printf("Enabling GPS...\n");
     fona.enableGPS(true);
+    fona.enableGPSReports(GNSS_REPORT_PERIOD);
     
     dbg.printf("Enabling GPRS...\n");
     fona.enableTCPGPRS(false);                                      // Disable 
@@ -199,16 +386,38 @@ void trackingTask(void const *argument)
     
     bool startLocationValid = false;
     Location2D startLocation;
-    Location2D currentLocation;
     bool wasOutside = false;
     
+    GNSSFix gnss;
+    uint32_t gnssReportCount = 0;
+    
     //fona.sendSMS("0037129170012", "Test");
     //fona.sendSMS(gSettings.alertPhone, "Test");
     
     dbg.printf("Entering loop...\n");
     while(1) {
-      networkStatus = fona.getNetworkStatus();
-      int newGPSStatus = fona.GPSstatus();
+      // Battery, network, GPRS (and GPS when not streamed) in one round-trip
+      char report[120];
+      bool newReport = false;
+      Adafruit_FONA::Status status;
+      if (GNSS_REPORT_PERIOD > 0) {
+        fona.getStatus(&status);
+        uint32_t count = fona.getGPSReport(report, sizeof(report));
+        newReport = (count != gnssReportCount);
+        gnssReportCount = count;
+      }
+      else {
+        newReport = fona.getStatus(&status, report, sizeof(report)) && (status.gpsStatus >= 0);
+      }
+      networkStatus = status.networkStatus;
+      packet.updateBattery(status.battVoltage, status.battPercent);
+      
+      // Parse each GNSS report once, everything below works on the parsed fix
+      if (newReport) {
+        gnss.parse(report);
+      }
+      
+      int newGPSStatus = gnss.status();
       if (newGPSStatus != gpsStatus) {
         gpsStatus = newGPSStatus;
         dbg.printf("GPS status: %d\n", gpsStatus);
@@ -217,59 +426,105 @@ void trackingTask(void const *argument)
           beepTimes(times);
         }
       }
-      gprsStatus = fona.GPRSstate();
+      gprsStatus = status.gprsState;
           
-      if (!fona.TCPconnected()) {
+      if (!uplink.isConnected()) {
         dbg.printf("Establishing TCP/IP connection...");
-        bool success = fona.TCPconnect(TRACK_SERVER, TRACK_PORT);
+        bool success = uplink.connect();
         dbg.printf(success ? "SUCCESS\n" : "FAILED\n");
+        if (success) {
+          // New server session, start the delta chain over
+          binEncoder.reset();
+        }
+      }
+      
+      // Send reports stored while the uplink was down (a pending batch waits until it is due)
+      if (uplink.isConnected() && !backlog.empty() && pendingReports == 0) {
+        dbg.printf("Sending backlog (%u reports)...\n", backlog.size());
+        flushBacklog();
       }
           
+      bool geofenceEvent = false;
+      
       //if (userButton) 
-      if (gpsStatus == 3) 
+      if (gpsStatus == 3 && newReport) 
       {
-        float lat, lon, alt;
-        if (fona.getGPS(&lat, &lon, &alt)) {
-          if (!startLocationValid) {
-            dbg.printf("Setting starting location: (%.5f, %.5f, %.1f)\n", lat, lon, alt);
-            startLocation.latitude = lat;
-            startLocation.longitude = lon;
-            startLocation.altitude = alt;
-            startLocationValid = true;
+        float lat = gnss.latitude / 1e6f;
+        float lon = gnss.longitude / 1e6f;
+        float alt = gnss.altitude / 1000.0f;
+        if (!startLocationValid) {
+          dbg.printf("Setting starting location: (%.5f, %.5f, %.1f)\n", lat, lon, alt);
+          startLocation.latitude = lat;
+          startLocation.longitude = lon;
+          startLocation.altitude = alt;
+          startLocationValid = true;
+          
+          geofence.setHome(gnss.latitude, gnss.longitude);
+          if (geofence.size() == 0) {
+            geofence.addCircle(gnss.latitude, gnss.longitude, gSettings.rangeHor);
           }
-          else {
-            currentLocation.latitude = lat;
-            currentLocation.longitude = lon;
-            currentLocation.altitude = alt;
-            float range = currentLocation.metersTo(startLocation);
-            float vrange = alt - startLocation.altitude;
-            dbg.printf("Current location: (%.5f, %.5f, %.1f), range %.1fm, vrange %.1fm\n", lat, lon, alt, range, vrange);
-            
-            if (range > gSettings.rangeHor || vrange > gSettings.rangeVert) {
-              // Start continuous beeping
-              buzzer = 0.5f;
-              if (!wasOutside) {
-                wasOutside = true;
-                fona.sendSMS(gSettings.alertPhone, "Drone outside boundaries");
-              }
+        }
+        else {
+          geofence.update(gnss.latitude, gnss.longitude);
+          float vrange = alt - startLocation.altitude;
+          float ceiling = gSettings.rangeVert - (wasOutside ? CEILING_MARGIN : 0);
+          dbg.printf("Current location: (%.5f, %.5f, %.1f), %s, vrange %.1fm\n", lat, lon, alt, 
+            geofence.isInside() ? "inside" : "outside", vrange);
+          
+          if (!geofence.isInside() || vrange > ceiling) {
+            // Start continuous beeping
+            alarmOn = true;
+            buzzer = 0.5f;
+            if (!wasOutside) {
+              wasOutside = true;
+              geofenceEvent = true;
+              fona.sendSMS(gSettings.alertPhone, "Drone outside boundaries");
             }
-            else {
-              // Stop beeping
-              buzzer = 0;
-              if (wasOutside) {
-                wasOutside = false;
-                fona.sendSMS(gSettings.alertPhone, "Drone back inside boundaries");
-              }
+          }
+          else {
+            // Stop beeping
+            buzzer = 0;
+            alarmOn = false;
+            if (wasOutside) {
+              wasOutside = false;
+              geofenceEvent = true;
+              fona.sendSMS(gSettings.alertPhone, "Drone back inside boundaries");
             }
           }
         }
         
-        dbg.printf("Publishing location...");
+        // Dense track while moving, turning or climbing, sparse while parked
+        uint32_t now = time(NULL);
+        if (varioRunning) {
+          scheduler.setVerticalSpeed(vario.getVerticalSpeed());
+        }
+        else {
+          scheduler.clearVerticalSpeed();
+        }
+        ReportScheduler::Reason reason = scheduler.check(gnss, now);
+        if (reason != ReportScheduler::kNone || geofenceEvent) {
+          dbg.printf("Queueing location (reason %d)\n", reason);
+          queueReport(gnss);
+          scheduler.reported(gnss, now);
+        }
+      }
+      
+      // Send the batch when full, when its oldest fix has waited long enough,
+      // or right away on a boundary crossing
+      bool batchDue = (pendingReports >= (uint32_t)gSettings.batchSize) ||
+                      (pendingTimer.read_ms() >= gSettings.batchInterval * 1000) ||
+                      geofenceEvent;
+      if (pendingReports > 0 && batchDue) 
+      {
+        dbg.printf("Publishing %u locations...", pendingReports);
         led4 = 1;
-        bool success = publishLocation2(fona);
+        bool success = flushReports();
         beepSuccess(success);
         if (success) {
-          dbg.printf("SUCCESS\n");
+          uplink.updateInFlight();
+          const UplinkSession::Counters &counters = uplink.getCounters();
+          dbg.printf("SUCCESS (%u ms, max %u ms, %u bytes in flight)\n", 
+            counters.lastLatencyMs, counters.maxLatencyMs, counters.bytesInFlight);
           led5 = 1;
         }
         else {
@@ -281,7 +536,7 @@ void trackingTask(void const *argument)
       }
 
       //dbg.printf("Sleeping...\n");
-      Thread::wait(3000);
+      Thread::wait(TRACK_LOOP_PERIOD);
     }  
 }
 
@@ -294,6 +549,9 @@ bool readSettings() {
   else {
     char line[100];
     line[0] = 0;
+    
+    gSettings.batchSize = 1;
+    gSettings.batchInterval = 30;
 
     int idx = 0;
     while (true) {
@@ -311,6 +569,7 @@ bool readSettings() {
       
       if (line[0] != '#' && line[0] != '\0') {
         dbg.printf("SD Read: %s\n", line);
+        // idx counts setting lines from 0, comments and blank lines are skipped
         switch (idx) {
           case 0: strncpy(gSettings.pin, line, 8); break;
           case 1: sscanf(line, "%d", &gSettings.rangeVert); break;
@@ -319,12 +578,16 @@ bool readSettings() {
           case 4: strncpy(gSettings.gprsAPN, line, 32); break;
           case 5: strncpy(gSettings.gprsUser, line, 32); break;
           case 6: strncpy(gSettings.gprsPass, line, 32); break;
+          case 7: gSettings.protocol = (strcmp(line, "binary") == 0) ? kProtocolBinary : kProtocolTK102; break;
+          case 8: sscanf(line, "%d", &gSettings.batchSize); break;
+          case 9: sscanf(line, "%d", &gSettings.batchInterval); break;
         }
         idx++;
       }
     }
     
     fclose(fp);   
+    if (gSettings.batchSize < 1) gSettings.batchSize = 1;
     if (idx < 6) return false;
   }
   
@@ -357,9 +620,26 @@ int main()
       }
     }
 
+    sensorBus.start();
+
+    if (geofence.load(GEOFENCE_FILE)) {
+      dbg.printf("Geofence: %u zones\n", geofence.size());
+    }
+
+#if PROTOCOL_BENCHMARK
+    benchmarkProtocols();
+#endif
+#if GEOFENCE_BENCHMARK
+    benchmarkGeofence();
+#endif
+#if BARO_BENCHMARK
+    benchmarkBarometer();
+#endif
+
     RtosTimer ledTimer(ledTimerTask, osTimerPeriodic, NULL);  
     ledTimer.start(250);
 
+    Thread varioThread(varioTask, NULL, osPriorityNormal, STACK_SIZE);
     Thread trackingThread(trackingTask, NULL, osPriorityNormal, STACK_SIZE);
             
     while (true) 
@@ -554,15 +834,273 @@ bool publishLocation(Adafruit_FONA &fona)
   return false;
 }
 
-bool publishLocation2(Adafruit_FONA &fona) 
+PositionReport makeReport(const GNSSFix &fix)
 {
-	char data[180];
-	packet.update(fona);
-	packet.buildPacket(data, 180);
-  
+	PositionReport report;
+	report.set(fix);
+	report.batteryVoltage = packet.batteryVoltage;
+	report.batteryLow = (packet.batteryStatus == 'L');
+	report.externalPower = packet.externalPower;
+	return report;
+}
+
+// Encode one report in the configured protocol for storing
+uint16_t encodeReport(const GNSSFix &fix, char *data, uint16_t bufSize)
+{
+	// Stored binary reports are keyframes, sendReports() turns them into deltas
+	if (gSettings.protocol == kProtocolBinary) {
+		return binEncoder.encodeKeyframe(makeReport(fix), (uint8_t *)data, bufSize);
+	}
+	
+	packet.update(fix);
+	uint16_t length = packet.buildPacket(data, bufSize - 1);
+	
 	//dbg.printf("TK102: %s\n", data);
-  
-	if (false == fona.TCPsend(data, strlen(data)))
-		return false;
-	return fona.TCPsend("\n", 1);
+	
+	data[length++] = '\n';
+	return length;
+}
+
+// Send stored reports, binary ones chained into a keyframe and deltas for this send only
+bool sendReports(const char *data, uint16_t length)
+{
+	static char frames[UplinkSession::kMaxLineLength];
+	
+	uint16_t size = binEncoder.chain((const uint8_t *)data, length, (uint8_t *)frames, sizeof(frames));
+	return (size == 0) || uplink.send(frames, size);
+}
+
+// Store one encoded report or batch for sending
+bool storeReport(const char *data, uint16_t length)
+{
+	// Without a working SD card fall back to sending directly
+	if (!backlog.open()) {
+		return sendReports(data, length);
+	}
+	
+	// Every report goes through the backlog, so nothing is lost while offline
+	return backlog.push(data, length);
+}
+
+// Close the open binary batch frame and store it
+bool finishBatch()
+{
+	if (batchEncoder.empty()) return true;
+	
+	char frame[BatchEncoder::kMaxFrameSize];
+	uint16_t length = batchEncoder.finish((uint8_t *)frame, sizeof(frame));
+	return storeReport(frame, length);
+}
+
+/*
+ * Add a fix to the pending batch. Binary reports are collected into one
+ * batch frame; single reports (TK102, or a batch size of 1) are stored in
+ * the backlog right away and go out together with the next flush, which
+ * packs them into as few TCP sends as fit.
+ */
+bool queueReport(const GNSSFix &fix)
+{
+	bool success;
+	if (gSettings.protocol == kProtocolBinary && gSettings.batchSize > 1) {
+		PositionReport report = makeReport(fix);
+		success = batchEncoder.add(report);
+		if (!success) {
+			// Frame full, close it and start the next one
+			success = finishBatch();
+			batchEncoder.add(report);
+		}
+	}
+	else {
+		char data[180];
+		uint16_t length = encodeReport(fix, data, sizeof(data));
+		success = (length > 0) && storeReport(data, length);
+	}
+	
+	if (pendingReports++ == 0) {
+		pendingTimer.reset();
+		pendingTimer.start();
+	}
+	return success;
+}
+
+// Send the pending batch together with whatever else is in the backlog
+bool flushReports()
+{
+	pendingReports = 0;
+	pendingTimer.stop();
+	pendingTimer.reset();
+	
+	if (!finishBatch()) return false;
+	return !backlog.open() || flushBacklog();
+}
+
+#if PROTOCOL_BENCHMARK
+// Parse time per +CGNSINF line, encode time and size per report for the uplink formats
+void benchmarkProtocols()
+{
+	char line[] = "1,1,20160711201120.000,56.958513,24.177697,12.400,3.70,67.76,1,,0.9,1.2,0.8,,11,9,,,42,,";
+	char imei[] = "123456789012345";
+	const int kRuns = 100;
+	
+	GNSSFix fix;
+	fix.parse(line);
+	
+	TK102Packet tk102;
+	tk102.setIMEI(imei);
+	BinaryEncoder encoder;
+	encoder.setIMEI(imei);
+	
+	Timer timer;
+	timer.start();
+	
+	int start = timer.read_us();
+	for (int run = 0; run < kRuns; run++) {
+		fix.parse(line);
+	}
+	int parseTime = timer.read_us() - start;
+	
+	char text[180];
+	uint32_t textBytes = 0;
+	start = timer.read_us();
+	for (int run = 0; run < kRuns; run++) {
+		fix.latitude += 10;
+		tk102.update(fix);
+		textBytes += tk102.buildPacket(text, sizeof(text)) + 1;
+	}
+	int textTime = timer.read_us() - start;
+	
+	uint8_t frame[BinaryEncoder::kMaxFrameSize];
+	uint8_t frame2[BatchEncoder::kMaxFrameSize];
+	uint32_t binaryBytes = 0;
+	start = timer.read_us();
+	for (int run = 0; run < kRuns; run++) {
+		fix.latitude += 10;
+		PositionReport report;
+		report.set(fix);
+		binaryBytes += encoder.encode(report, frame, sizeof(frame));
+	}
+	int binaryTime = timer.read_us() - start;
+	
+	BatchEncoder batch;
+	batch.setIMEI(imei);
+	uint32_t batchBytes = 0;
+	start = timer.read_us();
+	for (int run = 0; run < kRuns; run++) {
+		fix.latitude += 10;
+		PositionReport report;
+		report.set(fix);
+		if (!batch.add(report)) {
+			batchBytes += batch.finish(frame2, sizeof(frame2));
+			batch.add(report);
+		}
+	}
+	batchBytes += batch.finish(frame2, sizeof(frame2));
+	int batchTime = timer.read_us() - start;
+	
+	dbg.printf("Parse:  %d us per line\n", parseTime / kRuns);
+	dbg.printf("TK102:  %d us, %lu bytes per report\n", textTime / kRuns, textBytes / kRuns);
+	dbg.printf("Binary: %d us, %lu bytes per report\n", binaryTime / kRuns, binaryBytes / kRuns);
+	dbg.printf("Batch:  %d us, %lu bytes per report\n", batchTime / kRuns, batchBytes / kRuns);
+}
+#endif
+
+#if GEOFENCE_BENCHMARK
+// Cycles per Geofence::update() for fixes crossing a 16 vertex polygon and a circle
+void benchmarkGeofence()
+{
+	const int kRuns = 1000;
+	const int32_t homeLat = 56950000;
+	const int32_t homeLon = 24100000;
+	
+	static Geofence fence;
+	fence.beginPolygon();
+	for (int idx = 0; idx < 16; idx++) {
+		float angle = idx * (2 * (float)M_PI / 16);
+		fence.addVertex(homeLat + (int32_t)(9000 * sinf(angle)), homeLon + (int32_t)(16000 * cosf(angle)));
+	}
+	fence.endPolygon();
+	fence.addCircle(homeLat, homeLon + 40000, 300);
+	fence.setHome(homeLat, homeLon);
+	
+	// DWT cycle counter
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	
+	uint32_t total = 0;
+	uint32_t worst = 0;
+	for (int run = 0; run < kRuns; run++) {
+		int32_t latitude = homeLat + (run % 40) * 500 - 10000;
+		int32_t longitude = homeLon + (run % 50) * 1000 - 5000;
+		uint32_t start = DWT->CYCCNT;
+		fence.update(latitude, longitude);
+		uint32_t cycles = DWT->CYCCNT - start;
+		total += cycles;
+		if (cycles > worst) worst = cycles;
+	}
+	
+	dbg.printf("Geofence: %lu cycles per check, %lu worst\n", total / kRuns, worst);
+}
+#endif
+
+#if BARO_BENCHMARK
+// Cycles per temperature and pressure compensation, datasheet example coefficients
+void benchmarkBarometer()
+{
+	const int kRuns = 1000;
+	uint16_t prom[8] = { 0, 46372, 43981, 29059, 27842, 31553, 28165, 0 };
+	prom[7] = MS5607Compensation::crc4(prom);
+	
+	MS5607Compensation compensation;
+	compensation.setPROM(prom);
+	
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	
+	// Alternate both sides of 20 C so the second order terms are included
+	volatile int32_t sink = 0;
+	uint32_t temperatureCycles = 0;
+	uint32_t pressureCycles = 0;
+	for (int run = 0; run < kRuns; run++) {
+		uint32_t start = DWT->CYCCNT;
+		compensation.setTemperature((run & 1) ? 8077636 : 7500000);
+		temperatureCycles += DWT->CYCCNT - start;
+		
+		start = DWT->CYCCNT;
+		sink = compensation.getPressure(6465444 + run);
+		pressureCycles += DWT->CYCCNT - start;
+	}
+	
+	dbg.printf("MS5607: %lu cycles per temperature, %lu per pressure (%ld Pa)\n", 
+		temperatureCycles / kRuns, pressureCycles / kRuns, (long)sink);
+}
+#endif
+
+// Batches per call, to keep the tracking loop going on a long backlog
+#define BACKLOG_BATCHES   8
+// Time the server has to acknowledge a batch before it is kept for a retry
+#define BACKLOG_ACK_TIMEOUT 10000
+
+bool flushBacklog()
+{
+	static char batch[UplinkSession::kMaxLineLength];
+	
+	if (!uplink.connect()) return false;
+	
+	for (int n = 0; n < BACKLOG_BATCHES && !backlog.empty(); n++) {
+		uint32_t count;
+		uint16_t length = backlog.readBatch(batch, sizeof(batch), count);
+		if (count == 0) return false;
+		
+		// Reports are only removed once the server has acknowledged them. In
+		// quick send mode DATA ACCEPT only means the module buffered the data,
+		// a batch lost after that is sent again (at least once delivery).
+		if (length > 0) {
+			if (!sendReports(batch, length)) return false;
+			if (!uplink.waitAcknowledged(BACKLOG_ACK_TIMEOUT)) return false;
+		}
+		backlog.pop(count);
+	}
+	return true;
 }
@@ -0,0 +1,73 @@
+#include "ms5607comp.h"
+
+MS5607Compensation::MS5607Compensation() {
+  for (uint8_t idx = 0; idx < 7; idx++) {
+    _c[idx] = 0;
+  }
+  _temperature = 2000;
+  _off = 0;
+  _sens = 0;
+}
+
+bool MS5607Compensation::setPROM(const uint16_t prom[8]) {
+  if (crc4(prom) != (prom[7] & 0x0F)) return false;
+
+  for (uint8_t idx = 1; idx < 7; idx++) {
+    _c[idx] = prom[idx];
+  }
+  return true;
+}
+
+uint8_t MS5607Compensation::crc4(const uint16_t prom[8]) {
+  uint16_t remainder = 0;
+  for (uint8_t idx = 0; idx < 16; idx++) {
+    uint16_t value = prom[idx >> 1];
+    if (idx == 15) value &= 0xFF00;           // CRC nibble itself is not covered
+    remainder ^= (idx & 1) ? (value & 0x00FF) : (value >> 8);
+
+    for (uint8_t bit = 8; bit > 0; bit--) {
+      if (remainder & 0x8000) {
+        remainder = (remainder << 1) ^ 0x3000;
+      }
+      else {
+        remainder = (remainder << 1);
+      }
+    }
+  }
+  return (remainder >> 12) & 0x0F;
+}
+
+void MS5607Compensation::setTemperature(uint32_t d2) {
+  // dT = D2 - C5 * 2^8, TEMP = 2000 + dT * C6 / 2^23
+  int32_t dT = (int32_t)d2 - ((int32_t)_c[5] << 8);
+  int32_t temperature = 2000 + (int32_t)(((int64_t)dT * _c[6]) >> 23);
+
+  // OFF = C2 * 2^17 + C4 * dT / 2^6, SENS = C1 * 2^16 + C3 * dT / 2^7
+  int64_t off  = ((int64_t)_c[2] << 17) + (((int64_t)_c[4] * dT) >> 6);
+  int64_t sens = ((int64_t)_c[1] << 16) + (((int64_t)_c[3] * dT) >> 7);
+
+  // Second order, low temperature
+  if (temperature < 2000) {
+    int32_t t2 = (int32_t)(((int64_t)dT * dT) >> 31);
+    int32_t low = temperature - 2000;
+    int64_t low2 = (int64_t)low * low;
+    int64_t off2 = (61 * low2) >> 4;
+    int64_t sens2 = 2 * low2;
+
+    // Very low temperature
+    if (temperature < -1500) {
+      int32_t veryLow = temperature + 1500;
+      int64_t veryLow2 = (int64_t)veryLow * veryLow;
+      off2 += 15 * veryLow2;
+      sens2 += 8 * veryLow2;
+    }
+
+    temperature -= t2;
+    off -= off2;
+    sens -= sens2;
+  }
+
+  _temperature = temperature;
+  _off = off;
+  _sens = sens;
+}
@@ -0,0 +1,43 @@
+#ifndef MS5607COMP_H
+#define MS5607COMP_H
+
+#include <stdint.h>
+
+/**
+ * MS5607 calibration and compensation as in the datasheet, including the
+ * second order correction below 20 C, in integer arithmetic only.
+ *
+ * Everything that depends on temperature (OFF, SENS with their second
+ * order terms) is computed once per temperature conversion, so a pressure
+ * conversion costs a single 32 x 64 bit multiply and two shifts. The
+ * remaining products are 32 x 32 -> 64 bit, one SMULL on the Cortex-M4.
+ */
+class MS5607Compensation {
+public:
+  MS5607Compensation();
+
+  /// Take the 8 PROM words (factory data C1..C6 in 1..6, CRC4 in 7), false on a CRC mismatch
+  bool setPROM(const uint16_t prom[8]);
+
+  /// CRC4 of the PROM words as in AN520
+  static uint8_t crc4(const uint16_t prom[8]);
+
+  /// Update from a temperature conversion result (D2)
+  void setTemperature(uint32_t d2);
+
+  /// Temperature in Celsius x100 (2007 = 20.07 C), second order corrected
+  int32_t getTemperature() { return _temperature; }
+
+  /// Pressure in Pascals from a pressure conversion result (D1)
+  int32_t getPressure(uint32_t d1) {
+    return (int32_t)(((((int64_t)d1 * _sens) >> 21) - _off) >> 15);
+  }
+
+private:
+  uint16_t  _c[7];            // C1..C6 at their datasheet index
+  int32_t   _temperature;
+  int64_t   _off;
+  int64_t   _sens;
+};
+
+#endif
@@ -0,0 +1,153 @@
+#include "posqueue.h"
+#include "crc.h"
+
+#include <cstring>
+
+PositionQueue::PositionQueue(const char *path, uint32_t capacity) {
+  _path = path;
+  _file = 0;
+  _capacity = capacity;
+  _head = 0;
+  _count = 0;
+  _dropped = 0;
+  _corrupted = 0;
+}
+
+PositionQueue::~PositionQueue() {
+  close();
+}
+
+bool PositionQueue::open() {
+  if (_file) return true;
+
+  _file = fopen(_path, "r+b");
+  if (_file) {
+    Header header;
+    if (fread(&header, sizeof(header), 1, _file) == 1 &&
+        header.magic == kMagic && header.capacity == _capacity &&
+        header.head < _capacity && header.count <= _capacity)
+    {
+      _head = header.head;
+      _count = header.count;
+      return true;
+    }
+    // Foreign or resized file, start over
+    fclose(_file);
+  }
+
+  _file = fopen(_path, "w+b");
+  if (!_file) return false;
+
+  _head = 0;
+  _count = 0;
+  return writeHeader(_head, _count);
+}
+
+void PositionQueue::close() {
+  if (_file) {
+    fclose(_file);
+    _file = 0;
+  }
+}
+
+bool PositionQueue::seekSlot(uint32_t slot) {
+  long offset = kHeaderSize + (long)slot * kRecordSize;
+  return fseek(_file, offset, SEEK_SET) == 0;
+}
+
+bool PositionQueue::writeHeader(uint32_t head, uint32_t count) {
+  Header header;
+  header.magic = kMagic;
+  header.capacity = _capacity;
+  header.head = head;
+  header.count = count;
+
+  if (fseek(_file, 0, SEEK_SET) != 0) return false;
+  if (fwrite(&header, sizeof(header), 1, _file) != 1) return false;
+  return fflush(_file) == 0;
+}
+
+bool PositionQueue::push(const char *data, uint16_t length) {
+  if (!_file) return false;
+  if (length > kMaxPayload) return false;
+
+  uint8_t record[kRecordSize];
+  CRC16<0xA001, true> crc;
+  uint16_t checksum = crc.update((const uint8_t *)data, length);
+  record[0] = length & 0xFF;
+  record[1] = length >> 8;
+  record[2] = checksum & 0xFF;
+  record[3] = checksum >> 8;
+  memcpy(record + 4, data, length);
+
+  // Only the used part of the slot is written. When full, the new report
+  // takes the slot of the oldest one.
+  bool full = (_count == _capacity);
+  uint32_t tail = (_head + _count) % _capacity;
+  if (!seekSlot(tail)) return false;
+  if (fwrite(record, 4 + length, 1, _file) != 1) return false;
+
+  // The index only moves once the record is written
+  uint32_t head = full ? (_head + 1) % _capacity : _head;
+  uint32_t count = full ? _count : _count + 1;
+  if (!writeHeader(head, count)) return false;
+
+  _head = head;
+  _count = count;
+  if (full) _dropped++;
+  return true;
+}
+
+uint16_t PositionQueue::readBatch(char *buffer, uint16_t bufSize, uint32_t &count) {
+  count = 0;
+  if (!_file || _count == 0) return 0;
+
+  uint16_t used = 0;
+  uint32_t slot = _head;
+
+  while (count < _count) {
+    if (!seekSlot(slot)) break;
+
+    uint8_t prefix[4];
+    if (fread(prefix, sizeof(prefix), 1, _file) != 1) break;
+    uint16_t length = prefix[0] | (prefix[1] << 8);
+    uint16_t checksum = prefix[2] | (prefix[3] << 8);
+
+    if (length > kMaxPayload) {
+      // Garbage slot, skip it
+      _corrupted++;
+      count++;
+      slot = (slot + 1) % _capacity;
+      continue;
+    }
+    if (used + length > bufSize) break;
+
+    if (length > 0 && fread(buffer + used, length, 1, _file) != 1) break;
+
+    CRC16<0xA001, true> crc;
+    if (crc.update((const uint8_t *)buffer + used, length) != checksum) {
+      _corrupted++;
+    }
+    else {
+      used += length;
+    }
+
+    count++;
+    slot = (slot + 1) % _capacity;
+  }
+
+  return used;
+}
+
+bool PositionQueue::pop(uint32_t count) {
+  if (!_file) return false;
+  if (count > _count) count = _count;
+  if (count == 0) return true;
+
+  uint32_t head = (_head + count) % _capacity;
+  if (!writeHeader(head, _count - count)) return false;
+
+  _head = head;
+  _count -= count;
+  return true;
+}
@@ -0,0 +1,78 @@
+#ifndef POSQUEUE_H
+#define POSQUEUE_H
+
+#include <stdint.h>
+#include <cstdio>
+
+/**
+ * Persistent FIFO of encoded position reports (store and forward).
+ *
+ * The file is a fixed number of fixed-size record slots used as a ring,
+ * preceded by a small header holding the ring index. The index is loaded
+ * once on open() and kept in RAM, so push and pop are a seek plus one
+ * record write and never scan the file. When the ring is full the oldest
+ * report is dropped.
+ *
+ * Works on any mounted mbed file system (SDFileSystem, MemFileSystem).
+ */
+class PositionQueue {
+public:
+  enum {
+    kRecordSize   = 192,
+    kMaxPayload   = kRecordSize - 4     // length and CRC16 precede the payload
+  };
+
+  PositionQueue(const char *path, uint32_t capacity);
+  ~PositionQueue();
+
+  /// Open the queue file (created if missing) and load its index
+  bool open();
+  void close();
+
+  /// Append one report, dropping the oldest if the queue is full
+  bool push(const char *data, uint16_t length);
+
+  /**
+   * Read reports from the front of the queue into buffer back to back, as
+   * many as fit. Reports are stored as sent (terminator or framing
+   * included). Returns the number of bytes; count is set to the number of
+   * records consumed (pass it to pop() once they are sent). bufSize should
+   * be at least kMaxPayload.
+   */
+  uint16_t readBatch(char *buffer, uint16_t bufSize, uint32_t &count);
+
+  /// Remove count reports from the front of the queue
+  bool pop(uint32_t count);
+
+  uint32_t size()     { return _count; }
+  bool     empty()    { return _count == 0; }
+
+  uint32_t getDropped()   { return _dropped; }
+  uint32_t getCorrupted() { return _corrupted; }
+
+private:
+  struct Header {
+    uint32_t magic;
+    uint32_t capacity;
+    uint32_t head;          // slot of the oldest record
+    uint32_t count;         // records in the queue
+  };
+
+  enum {
+    kMagic        = 0x51504B54,         // "TKPQ"
+    kHeaderSize   = 32
+  };
+
+  const char *  _path;
+  FILE *        _file;
+  uint32_t      _capacity;
+  uint32_t      _head;
+  uint32_t      _count;
+  uint32_t      _dropped;
+  uint32_t      _corrupted;
+
+  bool seekSlot(uint32_t slot);
+  bool writeHeader(uint32_t head, uint32_t count);
+};
+
+#endif
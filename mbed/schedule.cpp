@@ -0,0 +1,63 @@
+#include "schedule.h"
+
+#include <cmath>
+
+ReportScheduler::ReportScheduler() {
+  _haveLast = false;
+  _lastTime = 0;
+  _havePrev = false;
+  _prevAltitude = 0;
+  _prevTime = 0;
+  _gnssVertSpeed = 0;
+  _haveBaro = false;
+  _baroVertSpeed = 0;
+}
+
+ReportScheduler::Reason ReportScheduler::check(const GNSSFix &fix, uint32_t now) {
+  // Vertical speed between consecutive fixes (not only reported ones)
+  if (_havePrev && now > _prevTime) {
+    _gnssVertSpeed = (fix.altitude - _prevAltitude) / 1000.0f / (now - _prevTime);
+  }
+  _havePrev = true;
+  _prevAltitude = fix.altitude;
+  _prevTime = now;
+
+  if (!_haveLast) return kFirst;
+
+  uint32_t elapsed = now - _lastTime;
+  if (elapsed < _config.minInterval) return kNone;
+  if (elapsed >= _config.maxInterval) return kInterval;
+
+  // Short distances, an equirectangular projection is plenty
+  float dy = (fix.latitude - _last.latitude) * metersPerMicroDegree;
+  float dx = (fix.longitude - _last.longitude) * metersPerMicroDegree *
+             cosf(fix.latitude / 180e6f * (float)M_PI);
+  if (dx * dx + dy * dy >= (float)_config.distance * _config.distance) {
+    return kDistance;
+  }
+
+  uint32_t headingSpeed = _config.headingSpeed * 100;
+  if (fix.speed >= headingSpeed && _last.speed >= headingSpeed) {
+    int32_t turn = fix.course - _last.course;
+    if (turn < 0) turn = -turn;
+    if (turn > 18000) turn = 36000 - turn;
+    if (turn >= _config.heading * 100) return kHeading;
+  }
+
+  float vertSpeed = _haveBaro ? _baroVertSpeed : _gnssVertSpeed;
+  int32_t climb = fix.altitude - _last.altitude;
+  if (climb < 0) climb = -climb;
+  if (climb >= _config.altitude * 1000 ||
+      fabsf(vertSpeed) >= _config.climbRate)
+  {
+    return kClimb;
+  }
+
+  return kNone;
+}
+
+void ReportScheduler::reported(const GNSSFix &fix, uint32_t now) {
+  _haveLast = true;
+  _last = fix;
+  _lastTime = now;
+}
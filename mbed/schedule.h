@@ -0,0 +1,72 @@
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include <stdint.h>
+
+#include "gpsdata.h"
+
+/**
+ * Decides which GNSS fixes are worth reporting.
+ *
+ * A fix is reported once the tracker has moved, turned or climbed enough
+ * since the last report, but never sooner than the minimum interval after
+ * it. Without any of these a report still goes out after the maximum
+ * interval, so a parked unit sends one report per maximum interval and a
+ * fast or maneuvering one up to one per minimum interval.
+ */
+class ReportScheduler {
+public:
+  enum Reason {
+    kNone       = 0,    // not yet
+    kFirst,             // nothing reported so far
+    kDistance,
+    kHeading,
+    kClimb,
+    kInterval           // maximum interval elapsed
+  };
+
+  struct Config {
+    uint16_t minInterval;     // s
+    uint16_t maxInterval;     // s
+    uint16_t distance;        // m travelled
+    uint16_t heading;         // degrees of course change
+    uint16_t headingSpeed;    // km/h, course is noise below this
+    uint16_t altitude;        // m of altitude change
+    float    climbRate;       // m/s, vertical speed in either direction
+
+    Config() : minInterval(2), maxInterval(300), distance(100), heading(20),
+      headingSpeed(5), altitude(20), climbRate(2.0f) {}
+  };
+
+  ReportScheduler();
+
+  void setConfig(const Config &config) { _config = config; }
+  const Config & getConfig() { return _config; }
+
+  /**
+   * Vertical speed from a barometric source (Variometer), used instead of
+   * the one derived from consecutive GNSS altitudes until cleared.
+   */
+  void setVerticalSpeed(float vertSpeed) { _baroVertSpeed = vertSpeed; _haveBaro = true; }
+  void clearVerticalSpeed() { _haveBaro = false; }
+
+  /// Check a new fix taken at now (seconds), call reported() if it is sent
+  Reason check(const GNSSFix &fix, uint32_t now);
+
+  /// Record fix as the last reported one
+  void reported(const GNSSFix &fix, uint32_t now);
+
+private:
+  Config    _config;
+  bool      _haveLast;
+  GNSSFix   _last;            // last reported fix
+  uint32_t  _lastTime;
+  bool      _havePrev;
+  int32_t   _prevAltitude;    // previous fix, for the GNSS vertical speed
+  uint32_t  _prevTime;
+  float     _gnssVertSpeed;
+  bool      _haveBaro;
+  float     _baroVertSpeed;
+};
+
+#endif
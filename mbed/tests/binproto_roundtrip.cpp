@@ -0,0 +1,331 @@
+/*
+ * Binary protocol round trip and size/speed against TK102. Runs on the host:
+ *
+ *   g++ -std=gnu++98 -O2 -Itests/host -I. -o binproto_roundtrip tests/binproto_roundtrip.cpp binproto.cpp gpsdata.cpp && ./binproto_roundtrip
+ *
+ * (from this directory). Tracks are made of +CGNSINF lines, parsed into a
+ * GNSSFix and converted with PositionReport::set() as on the tracker.
+ * Every report encoded with BinaryEncoder (keyframes and delta chains),
+ * BatchEncoder and chain() must come back out of BinaryDecoder field for
+ * field. Corrupted frames must be dropped, along with the deltas that
+ * depend on them. Then prints the bytes per report and the encoding time
+ * of TK102 sentences, binary frames and batch frames for the same track.
+ */
+#include "binproto.h"
+#include "gpsdata.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+static const char kIMEI[] = "123456789012345";
+static const int kTrackLength = 200;
+
+static int failures = 0;
+
+static void check(bool condition, const char *what) {
+  if (!condition) {
+    printf("%s\n", what);
+    failures++;
+  }
+}
+
+/* Fields as they come out of the decoder, battery in 10 mV steps */
+static bool same(const PositionReport &a, const PositionReport &b) {
+  uint8_t satsA = (a.satCount > 15) ? 15 : a.satCount;
+  uint8_t satsB = (b.satCount > 15) ? 15 : b.satCount;
+  return a.time == b.time && a.latitude == b.latitude && a.longitude == b.longitude &&
+         a.altitude == b.altitude && a.speed == b.speed && a.course == b.course &&
+         satsA == satsB && a.fix == b.fix && a.batteryLow == b.batteryLow &&
+         a.externalPower == b.externalPower && a.batteryVoltage / 10 == b.batteryVoltage / 10;
+}
+
+/*
+ * A drive at about 50 km/h starting at latitude, longitude, one fix per
+ * second, turning slowly. Crosses zero when started near it.
+ */
+static void makeTrack(GNSSFix *fixes, PositionReport *reports, double latitude, double longitude) {
+  double heading = 30;
+  double altitude = 12.4;
+  for (int idx = 0; idx < kTrackLength; idx++) {
+    int seconds = 20 * 3600 + 11 * 60 + idx;
+    double speed = 50 + 10 * sin(idx / 15.0);
+    char line[160];
+    sprintf(line, "1,%d,20160711%02d%02d%02d.000,%.6f,%.6f,%.3f,%.2f,%.2f,1,,0.9,1.2,0.8,,%d,%d,,,42,,",
+            (idx % 50 == 49) ? 0 : 1, seconds / 3600, seconds / 60 % 60, seconds % 60,
+            latitude, longitude, altitude, speed, heading, 11 + idx % 8, 6 + idx % 12);
+    check(fixes[idx].parse(line), "track line not parsed");
+    check(reports[idx].set(fixes[idx]), "report not set from the fix");
+    reports[idx].batteryVoltage = 4200 - idx * 3;
+    reports[idx].batteryLow = idx > 150;
+    reports[idx].externalPower = idx < 20;
+
+    double meters = speed / 3.6;
+    latitude += meters * cos(heading * M_PI / 180) / 111195.0;
+    longitude += meters * sin(heading * M_PI / 180) / (111195.0 * cos(latitude * M_PI / 180));
+    altitude += (idx % 7) - 3.2;
+    heading = fmod(heading + 4.5 + 360, 360);
+  }
+}
+
+static void testStream(const PositionReport *track) {
+  BinaryEncoder encoder(10);
+  encoder.setIMEI(kIMEI);
+  BinaryDecoder decoder;
+
+  static uint8_t stream[kTrackLength * BinaryEncoder::kMaxFrameSize];
+  uint16_t offsets[kTrackLength + 1];
+  uint32_t length = 0;
+  int keyframes = 0;
+  for (int idx = 0; idx < kTrackLength; idx++) {
+    offsets[idx] = length;
+    uint16_t size = encoder.encode(track[idx], stream + length, BinaryEncoder::kMaxFrameSize);
+    check(size > 0 && stream[length] == BinaryEncoder::kSync, "frame not encoded");
+    if (stream[length + 2] & 0x01) keyframes++;
+    length += size;
+  }
+  offsets[kTrackLength] = length;
+  check(keyframes == kTrackLength / 10, "keyframe interval");
+
+  // The whole stream decodes back to the track
+  int decoded = 0;
+  for (uint32_t pos = 0; pos < length; ) {
+    PositionReport report;
+    bool valid;
+    uint16_t used = decoder.decode(stream + pos, length - pos, report, valid);
+    if (used == 0) break;
+    check(valid && decoded < kTrackLength && same(report, track[decoded]), "stream report differs");
+    decoded++;
+    pos += used;
+  }
+  check(decoded == kTrackLength, "stream reports missing");
+  check(strcmp(decoder.getIMEI(), kIMEI) == 0, "IMEI");
+
+  // A decoder joining mid chain skips the deltas up to the next keyframe
+  BinaryDecoder late;
+  decoded = 0;
+  for (int idx = 3; idx < kTrackLength; idx++) {
+    PositionReport report;
+    bool valid;
+    late.decode(stream + offsets[idx], offsets[idx + 1] - offsets[idx], report, valid);
+    if (idx < 10) check(!valid, "delta decoded without a keyframe");
+    else check(valid && same(report, track[idx]), "report after joining mid chain");
+  }
+
+  // Incomplete frames need more data
+  PositionReport report;
+  bool valid;
+  check(decoder.decode(stream, offsets[1] - 1, report, valid) == 0 && !valid, "truncated frame decoded");
+}
+
+static void testCorruption(const PositionReport *track) {
+  BinaryEncoder encoder(10);
+  encoder.setIMEI(kIMEI);
+
+  static uint8_t stream[30 * BinaryEncoder::kMaxFrameSize];
+  uint16_t offsets[31];
+  uint16_t length = 0;
+  for (int idx = 0; idx < 30; idx++) {
+    offsets[idx] = length;
+    length += encoder.encode(track[idx], stream + length, BinaryEncoder::kMaxFrameSize);
+  }
+  offsets[30] = length;
+
+  // A payload byte of delta 4, the length of delta 16 and the CRC of keyframe 20
+  stream[offsets[4] + 4] ^= 0x10;
+  stream[offsets[16] + 1] += 3;
+  stream[offsets[21] - 1] ^= 0x01;
+
+  BinaryDecoder decoder;
+  bool seen[30];
+  memset(seen, 0, sizeof(seen));
+  int idx = 0;
+  for (uint16_t pos = 0; pos < length; ) {
+    PositionReport report;
+    bool valid;
+    uint16_t used = decoder.decode(stream + pos, length - pos, report, valid);
+    if (used == 0) break;
+    pos += used;
+    if (!valid) continue;
+
+    // Valid reports must be exactly the ones of the track at their offset
+    while (idx < 30 && offsets[idx + 1] < pos) idx++;
+    check(offsets[idx + 1] == pos && same(report, track[idx]), "corruption produced a wrong report");
+    seen[idx] = true;
+  }
+
+  // The damaged frames and the rest of their chains are lost, nothing else
+  for (int frame = 0; frame < 30; frame++) {
+    bool lost = (frame >= 4 && frame < 10) || (frame >= 16 && frame < 30);
+    check(seen[frame] == !lost, lost ? "frame after a corrupted one decoded" : "intact frame lost");
+  }
+}
+
+static void testBatch(const PositionReport *track) {
+  BatchEncoder batch;
+  batch.setIMEI(kIMEI);
+  BinaryDecoder decoder;
+
+  uint8_t frame[BatchEncoder::kMaxFrameSize];
+  int next = 0, frames = 0;
+  while (next < kTrackLength) {
+    int first = next;
+    while (next < kTrackLength && batch.add(track[next])) next++;
+    check(next > first, "batch took no report");
+    uint16_t size = batch.finish(frame, sizeof(frame));
+    check(size > 0 && size <= BatchEncoder::kMaxFrameSize && batch.empty(), "batch frame");
+    frames++;
+
+    PositionReport reports[BatchEncoder::kMaxReports];
+    uint8_t count;
+    check(decoder.decodeBatch(frame, size, reports, BatchEncoder::kMaxReports, count) == size, "batch not consumed");
+    check(count == next - first, "batch report count");
+    for (uint8_t idx = 0; idx < count; idx++) {
+      // Battery state is shared, from the last report of the batch
+      PositionReport expected = track[first + idx];
+      expected.batteryVoltage = track[next - 1].batteryVoltage;
+      expected.batteryLow = track[next - 1].batteryLow;
+      expected.externalPower = track[next - 1].externalPower;
+      check(same(reports[idx], expected), "batch report differs");
+    }
+
+    // A damaged batch yields nothing and is resynchronized past its sync byte
+    frame[size / 2] ^= 0x40;
+    check(decoder.decodeBatch(frame, size, reports, BatchEncoder::kMaxReports, count) == 1 && count == 0,
+          "corrupted batch decoded");
+  }
+  check(frames < kTrackLength / 10, "batches too small");
+}
+
+static void testChain(const PositionReport *track) {
+  // What the backlog holds: stored keyframes, a TK102 line and a batch
+  BinaryEncoder store, session(10);
+  store.setIMEI(kIMEI);
+  session.setIMEI(kIMEI);
+  BatchEncoder batch;
+  batch.setIMEI(kIMEI);
+
+  static uint8_t stored[40 * BinaryEncoder::kMaxFrameSize];
+  uint16_t length = 0;
+  for (int idx = 0; idx < 12; idx++) {
+    length += store.encodeKeyframe(track[idx], stored + length, BinaryEncoder::kMaxFrameSize);
+    if (idx == 5) {
+      memcpy(stored + length, "text line\n", 10);
+      length += 10;
+    }
+  }
+  for (int idx = 12; idx < 20; idx++) batch.add(track[idx]);
+  uint16_t batchStart = length;
+  length += batch.finish(stored + length, BatchEncoder::kMaxFrameSize);
+
+  static uint8_t sent[sizeof(stored)];
+  uint16_t size = session.chain(stored, length, sent, sizeof(sent));
+  check(size < length, "chain did not shrink the keyframes");
+  check(memcmp(sent + size - (length - batchStart), stored + batchStart, length - batchStart) == 0,
+        "batch not copied unchanged");
+
+  // Keyframe, deltas, a new keyframe after the interval, text, then the batch
+  BinaryDecoder decoder;
+  int decoded = 0, keyframes = 0;
+  bool text = false;
+  uint16_t pos = 0;
+  while (pos < size && sent[pos] != BatchEncoder::kSync) {
+    if (sent[pos] != BinaryEncoder::kSync) {
+      text = text || memcmp(sent + pos, "text line\n", 10) == 0;
+      pos++;
+      continue;
+    }
+    PositionReport report;
+    bool valid;
+    if (sent[pos + 2] & 0x01) keyframes++;
+    pos += decoder.decode(sent + pos, size - pos, report, valid);
+    check(valid && same(report, track[decoded]), "chained report differs");
+    decoded++;
+  }
+  check(decoded == 12 && keyframes == 2 && text, "chained stream");
+
+  PositionReport reports[BatchEncoder::kMaxReports];
+  uint8_t count;
+  decoder.decodeBatch(sent + pos, size - pos, reports, BatchEncoder::kMaxReports, count);
+  check(count == 8 && reports[7].time == track[19].time, "batch after the chain");
+
+  // The next send starts over with a keyframe
+  uint16_t again = session.chain(stored, length, sent + size, sizeof(sent) - size);
+  check(again == size && memcmp(sent, sent + size, size) == 0, "second send differs");
+}
+
+/* Bytes per report and encoding time for the same fixes */
+static void compare(GNSSFix *fixes, const PositionReport *track) {
+  const int kRounds = 200;
+  char imei[] = "123456789012345";
+  char text[180];
+  uint8_t frame[BatchEncoder::kMaxFrameSize];
+  uint32_t textBytes = 0, binaryBytes = 0, batchBytes = 0;
+
+  TK102Packet packet(imei);
+  packet.updateBattery(4200, 90);
+  clock_t start = clock();
+  for (int round = 0; round < kRounds; round++) {
+    for (int idx = 0; idx < kTrackLength; idx++) {
+      packet.update(fixes[idx]);
+      textBytes += packet.buildPacket(text, sizeof(text)) + 1;
+    }
+  }
+  double textTime = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+  BinaryEncoder encoder;
+  encoder.setIMEI(imei);
+  start = clock();
+  for (int round = 0; round < kRounds; round++) {
+    for (int idx = 0; idx < kTrackLength; idx++) {
+      PositionReport report;
+      report.set(fixes[idx]);
+      report.batteryVoltage = track[idx].batteryVoltage;
+      binaryBytes += encoder.encode(report, frame, sizeof(frame));
+    }
+  }
+  double binaryTime = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+  BatchEncoder batch;
+  batch.setIMEI(imei);
+  start = clock();
+  for (int round = 0; round < kRounds; round++) {
+    for (int idx = 0; idx < kTrackLength; idx++) {
+      PositionReport report;
+      report.set(fixes[idx]);
+      report.batteryVoltage = track[idx].batteryVoltage;
+      if (!batch.add(report)) {
+        batchBytes += batch.finish(frame, sizeof(frame));
+        batch.add(report);
+      }
+    }
+    batchBytes += batch.finish(frame, sizeof(frame));
+  }
+  double batchTime = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+  uint32_t reports = kRounds * kTrackLength;
+  printf("TK102   %5.1f bytes/report  %6.0f ns/report\n", (double)textBytes / reports, textTime * 1e9 / reports);
+  printf("binary  %5.1f bytes/report  %6.0f ns/report\n", (double)binaryBytes / reports, binaryTime * 1e9 / reports);
+  printf("batch   %5.1f bytes/report  %6.0f ns/report\n", (double)batchBytes / reports, batchTime * 1e9 / reports);
+  check(binaryBytes * 4 < textBytes && batchBytes < binaryBytes, "binary not smaller than TK102");
+}
+
+int main() {
+  static GNSSFix fixes[kTrackLength];
+  static PositionReport track[kTrackLength];
+
+  // Riga, then across the equator and the prime meridian
+  const double starts[][2] = { { 56.958513, 24.177697 }, { -0.004, -0.006 } };
+  for (unsigned start = 0; start < sizeof(starts) / sizeof(starts[0]); start++) {
+    makeTrack(fixes, track, starts[start][0], starts[start][1]);
+    testStream(track);
+    testCorruption(track);
+    testBatch(track);
+    testChain(track);
+  }
+  compare(fixes, track);
+
+  printf("%s\n", failures ? "FAILED" : "OK");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,232 @@
+/*
+ * Geofence zone checks. Runs on the host:
+ *
+ *   g++ -std=gnu++98 -Itests/host -I. -o geofence_zones tests/geofence_zones.cpp geofence.cpp && ./geofence_zones
+ *
+ * (from this directory). Fixes are placed at a given distance in meters
+ * from the zones, converted to micro-degrees with the exact spherical
+ * scale, so the checks also hold the cos(latitude) projection to within a
+ * metre. Covers circles and polygons (convex and concave), the hysteresis
+ * margin on both, the bounding box widened by the margin and several
+ * zones together.
+ */
+#include "geofence.h"
+
+#include <cmath>
+#include <cstdio>
+
+static int failures = 0;
+
+static void check(bool condition, const char *what) {
+  if (!condition) {
+    printf("%s\n", what);
+    failures++;
+  }
+}
+
+static const double kMetersPerDegree = 111195.0;
+
+/* Micro-degrees of latitude for meters north */
+static int32_t north(double meters) {
+  return (int32_t)floor(meters / kMetersPerDegree * 1e6 + 0.5);
+}
+
+/* Micro-degrees of longitude for meters east at a latitude */
+static int32_t east(double meters, int32_t latitude) {
+  double scale = kMetersPerDegree * cos(latitude / 1e6 * M_PI / 180);
+  return (int32_t)floor(meters / scale * 1e6 + 0.5);
+}
+
+/* Move to a fix, check the state and whether update() reported a change */
+static void expect(Geofence &fence, int32_t latitude, int32_t longitude, bool inside, bool changed, const char *what) {
+  bool reported = fence.update(latitude, longitude);
+  check(fence.isInside() == inside && reported == changed, what);
+}
+
+static const int32_t kHomeLat = 56950000;   // Riga
+static const int32_t kHomeLon = 24100000;
+
+static void testPolygon() {
+  // A 1 km square centered on home, 10 m margin
+  Geofence fence;
+  fence.beginPolygon();
+  fence.addVertex(kHomeLat - north(500), kHomeLon - east(500, kHomeLat));
+  fence.addVertex(kHomeLat - north(500), kHomeLon + east(500, kHomeLat));
+  fence.addVertex(kHomeLat + north(500), kHomeLon + east(500, kHomeLat));
+  fence.addVertex(kHomeLat + north(500), kHomeLon - east(500, kHomeLat));
+  check(fence.endPolygon() && fence.size() == 1, "square not added");
+  fence.setMargin(10);
+
+  // Inside until there is a home point
+  check(!fence.update(kHomeLat + north(5000), kHomeLon) && fence.isInside(), "left without a home point");
+  fence.setHome(kHomeLat, kHomeLon);
+
+  expect(fence, kHomeLat, kHomeLon, true, false, "home not inside");
+  expect(fence, kHomeLat, kHomeLon + east(505, kHomeLat), true, false, "left within the margin (east)");
+  expect(fence, kHomeLat, kHomeLon + east(515, kHomeLat), false, true, "not left past the margin (east)");
+  expect(fence, kHomeLat, kHomeLon + east(495, kHomeLat), false, false, "entered within the margin (east)");
+  expect(fence, kHomeLat, kHomeLon + east(480, kHomeLat), true, true, "not entered past the margin (east)");
+
+  // The same on a north/south edge
+  expect(fence, kHomeLat - north(505), kHomeLon, true, false, "left within the margin (south)");
+  expect(fence, kHomeLat - north(515), kHomeLon, false, true, "not left past the margin (south)");
+  expect(fence, kHomeLat - north(480), kHomeLon, true, true, "not entered past the margin (south)");
+
+  // Corner: outside on both axes but within the margin of the vertex
+  expect(fence, kHomeLat + north(505), kHomeLon + east(505, kHomeLat), true, false, "left within the margin (corner)");
+  expect(fence, kHomeLat + north(510), kHomeLon + east(510, kHomeLat), false, true, "not left past the corner margin");
+
+  // Without a margin the boundary itself decides
+  fence.setMargin(0);
+  expect(fence, kHomeLat, kHomeLon + east(499, kHomeLat), true, true, "margin 0: not inside");
+  expect(fence, kHomeLat, kHomeLon + east(501, kHomeLat), false, true, "margin 0: not outside");
+}
+
+static void testConcave() {
+  // An L shape, the notch at the top right is outside
+  Geofence fence;
+  fence.setMargin(0);
+  fence.beginPolygon();
+  fence.addVertex(0, 0);
+  fence.addVertex(0, 2000);
+  fence.addVertex(1000, 2000);
+  fence.addVertex(1000, 1000);
+  fence.addVertex(2000, 1000);
+  fence.addVertex(2000, 0);
+  fence.endPolygon();
+  fence.setHome(0, 0);
+
+  expect(fence, 500, 500, true, false, "L: corner not inside");
+  expect(fence, 500, 1500, true, false, "L: arm not inside");
+  expect(fence, 1500, 1500, false, true, "L: notch not outside");
+  expect(fence, 1500, 500, true, true, "L: other arm not inside");
+
+  // Degenerate polygons are not zones
+  Geofence line;
+  line.beginPolygon();
+  line.addVertex(0, 0);
+  line.addVertex(1000, 1000);
+  check(!line.endPolygon() && line.size() == 0, "two vertex polygon accepted");
+}
+
+static void testCircle() {
+  // 300 m circle 2 km east of home, 10 m margin
+  int32_t lat = kHomeLat;
+  int32_t lon = kHomeLon + east(2000, kHomeLat);
+  Geofence fence;
+  fence.addCircle(lat, lon, 300);
+  fence.setMargin(10);
+  fence.setHome(kHomeLat, kHomeLon);
+
+  expect(fence, kHomeLat, kHomeLon, false, true, "home not outside the circle");
+  expect(fence, lat, lon + east(295, lat), false, false, "entered the circle within the margin");
+  expect(fence, lat, lon + east(285, lat), true, true, "not entered the circle past the margin");
+  expect(fence, lat, lon + east(305, lat), true, false, "left the circle within the margin");
+  expect(fence, lat, lon + east(315, lat), false, true, "not left the circle past the margin");
+
+  // North and diagonal use the same radius
+  expect(fence, lat + north(250), lon, true, true, "circle not round (north)");
+  expect(fence, lat + north(220), lon - east(220, lat), false, true, "circle not round (diagonal, 311 m)");
+  expect(fence, lat - north(200), lon + east(200, lat), true, true, "circle not round (diagonal, 283 m)");
+
+  // A margin as large as the radius leaves no deep inside
+  fence.setMargin(300);
+  expect(fence, lat, lon + east(700, lat), false, true, "left with a margin the size of the circle");
+  expect(fence, lat + north(10), lon, false, false, "entered a circle that is all margin");
+}
+
+static void testBoundingBox() {
+  // The box reject must be widened by the margin: a fix just outside the
+  // box but within the margin of the zone is still on the boundary
+  Geofence fence;
+  fence.beginPolygon();
+  fence.addVertex(kHomeLat, kHomeLon);
+  fence.addVertex(kHomeLat, kHomeLon + east(100, kHomeLat));
+  fence.addVertex(kHomeLat + north(100), kHomeLon);
+  fence.endPolygon();
+  fence.addCircle(kHomeLat, kHomeLon + east(1000, kHomeLat), 50);
+  fence.setMargin(20);
+  fence.setHome(kHomeLat, kHomeLon);
+
+  expect(fence, kHomeLat + north(25), kHomeLon + east(25, kHomeLat), true, false, "triangle corner not inside");
+  expect(fence, kHomeLat - north(15), kHomeLon + east(50, kHomeLat), true, false, "box rejected a fix within the margin (triangle)");
+  expect(fence, kHomeLat - north(25), kHomeLon + east(50, kHomeLat), false, true, "box kept a fix past the margin (triangle)");
+
+  // Inside the box but outside the triangle, past its hypotenuse
+  expect(fence, kHomeLat + north(25), kHomeLon + east(25, kHomeLat), true, true, "back inside");
+  expect(fence, kHomeLat + north(90), kHomeLon + east(90, kHomeLat), false, true, "inside the box is not inside the zone");
+
+  // The circle's box is the square around it
+  int32_t lon = kHomeLon + east(1000, kHomeLat);
+  expect(fence, kHomeLat, lon, true, true, "circle center not inside");
+  expect(fence, kHomeLat, lon + east(65, kHomeLat), true, false, "box rejected a fix within the margin (circle)");
+  expect(fence, kHomeLat + north(60), lon + east(60, kHomeLat), false, true, "box corner of the circle inside");
+}
+
+static void testZones() {
+  // Inside any zone counts, leaving needs every zone cleared
+  Geofence fence;
+  fence.addCircle(kHomeLat, kHomeLon, 200);
+  fence.addCircle(kHomeLat, kHomeLon + east(350, kHomeLat), 200);
+  fence.setMargin(10);
+  fence.setHome(kHomeLat, kHomeLon);
+
+  expect(fence, kHomeLat, kHomeLon + east(175, kHomeLat), true, false, "overlap not inside");
+  expect(fence, kHomeLat, kHomeLon + east(500, kHomeLat), true, false, "second circle not inside");
+  expect(fence, kHomeLat, kHomeLon + east(600, kHomeLat), false, true, "not left both circles");
+  expect(fence, kHomeLat, kHomeLon - east(150, kHomeLat), true, true, "first circle not entered");
+
+  fence.clear();
+  check(fence.size() == 0 && fence.isInside(), "clear");
+  check(!fence.update(kHomeLat + north(5000), kHomeLon), "left with no zones");
+  for (int idx = 0; idx < Geofence::kMaxZones; idx++) {
+    check(fence.addCircle(kHomeLat, kHomeLon, 100), "circle rejected");
+  }
+  check(!fence.addCircle(kHomeLat, kHomeLon, 100) && !fence.beginPolygon(), "zone past kMaxZones accepted");
+}
+
+static void testProjection() {
+  // At 60 degrees a degree of longitude is half as long: a fix 1100 m east
+  // is outside a 1000 m circle, which it would not be without cos(latitude)
+  const int32_t lat = 60000000;
+  const int32_t lon = 10000000;
+  Geofence fence;
+  fence.addCircle(lat, lon, 1000);
+  fence.setMargin(10);
+  fence.setHome(lat, lon);
+
+  check(std::fabs(east(1000, lat) - 2 * north(1000)) <= 1, "test scale at 60 degrees");
+  expect(fence, lat, lon + east(980, lat), true, false, "980 m east not inside at 60 degrees");
+  expect(fence, lat, lon + east(1100, lat), false, true, "1100 m east not outside at 60 degrees");
+  expect(fence, lat, lon - east(980, lat), true, true, "980 m west not inside at 60 degrees");
+  expect(fence, lat + north(1100), lon, false, true, "1100 m north not outside at 60 degrees");
+
+  // Zones added before the home point are reprojected by setHome
+  Geofence late;
+  late.addCircle(lat, lon + east(2000, lat), 1000);
+  late.setMargin(10);
+  late.setHome(lat, lon);
+  expect(late, lat, lon + east(1100, lat), true, false, "zone not reprojected (inside)");
+  expect(late, lat, lon + east(900, lat), false, true, "zone not reprojected (outside)");
+
+  // Southern hemisphere, the scale does not depend on the sign
+  const int32_t south = -60000000;
+  Geofence fenceSouth;
+  fenceSouth.addCircle(south, lon, 1000);
+  fenceSouth.setMargin(10);
+  fenceSouth.setHome(south, lon);
+  expect(fenceSouth, south, lon + east(1100, south), false, true, "1100 m east not outside at -60 degrees");
+  expect(fenceSouth, south, lon + east(980, south), true, true, "980 m east not inside at -60 degrees");
+}
+
+int main() {
+  testPolygon();
+  testConcave();
+  testCircle();
+  testBoundingBox();
+  testZones();
+  testProjection();
+
+  printf("%s\n", failures ? "FAILED" : "OK");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,164 @@
+/*
+ * Fuzz test of the +CGNSINF parser and the TK102 sentence built from it.
+ * Runs on the host, best with the sanitizers:
+ *
+ *   g++ -std=gnu++98 -g -fsanitize=address,undefined -Itests/host -I. -o gnss_fuzz tests/gnss_fuzz.cpp gpsdata.cpp && ./gnss_fuzz
+ *
+ * (from the mbed directory). Random numbers written with a random number
+ * of decimals must parse to the exactly rounded integer, and mutated lines
+ * (bytes replaced, inserted, cut off) must never be read past their end or
+ * produce a sentence that does not fit. The seed is fixed, so a failure is
+ * reproducible; pass a seed as the first argument to explore others.
+ */
+#include "gpsdata.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static uint32_t seed = 1;
+
+static uint32_t random(uint32_t range) {
+  seed = seed * 1103515245 + 12345;
+  return ((seed >> 8) & 0xFFFFFF) % range;
+}
+
+static int failures = 0;
+
+static void fail(const char *what, const char *line) {
+  if (failures++ < 10) std::printf("%s: \"%s\"\n", what, line);
+}
+
+/*
+ * Write a random number below limit (whole units) with the given number of
+ * decimals, and return the integer the parser should make of it at keep
+ * decimals (rounded half away from zero on the first dropped digit).
+ */
+static int32_t writeNumber(char *buf, uint32_t limit, bool negative, uint8_t decimals, uint8_t keep) {
+  char *ptr = buf;
+  if (negative) *ptr++ = '-';
+  uint32_t whole = random(limit);
+  ptr += std::sprintf(ptr, "%lu", (unsigned long)whole);
+  if (decimals > 0) *ptr++ = '.';
+
+  int64_t expected = whole;
+  bool roundUp = false;
+  for (uint8_t idx = 0; idx < decimals; idx++) {
+    uint8_t digit = random(10);
+    *ptr++ = '0' + digit;
+    if (idx < keep) expected = expected * 10 + digit;
+    else if (idx == keep) roundUp = (digit >= 5);
+  }
+  *ptr = '\0';
+
+  for (uint8_t idx = decimals; idx < keep; idx++) expected *= 10;
+  if (roundUp) expected++;
+  return (int32_t)(negative ? -expected : expected);
+}
+
+static void checkNumbers(int rounds) {
+  for (int round = 0; round < rounds; round++) {
+    char lat[24], lon[24], alt[24], speed[24], course[24];
+    int32_t expLat = writeNumber(lat, 90, random(2), random(10), 6);
+    int32_t expLon = writeNumber(lon, 180, random(2), random(10), 6);
+    int32_t expAlt = writeNumber(alt, 20000, random(2), random(6), 3);
+    int32_t expSpeed = writeNumber(speed, 2000, false, random(5), 2);
+    int32_t expCourse = writeNumber(course, 360, false, 2, 2);
+
+    char line[200];
+    std::sprintf(line, "1,1,20160711201120.000,%s,%s,%s,%s,%s,1,,0.9,1.2,0.8,,11,%lu,,,42,,",
+                 lat, lon, alt, speed, course, (unsigned long)random(30));
+
+    GNSSFix fix;
+    if (!fix.parse(line)) {
+      fail("valid line rejected", line);
+      continue;
+    }
+    if (fix.latitude != expLat || fix.longitude != expLon || fix.altitude != expAlt ||
+        fix.speed != (uint32_t)expSpeed || fix.course != expCourse) {
+      fail("wrong value", line);
+    }
+  }
+}
+
+static void checkMutations(int rounds) {
+  static const char *kSeeds[] = {
+    "1,1,20160711201120.000,56.958513,24.177697,12.400,3.70,67.76,1,,0.9,1.2,0.8,,11,9,,,42,,",
+    "1,1,20161002120301.000,-33.868820,-151.209296,-5.123,123.456,359.995,1,,1.25,2.5,0.80,,17,12,4,,45,3.2,5.1\r\n",
+    "1,0,,,,,,,0,,,,,,3,0,,,20,,",
+    "0,,,,,,,,,,,,,,,,,,,,"
+  };
+  static const char kAlphabet[] = "0123456789,.-+ x\r\n";
+
+  char imei[] = "123456789012345";
+  TK102Packet packet;
+  packet.setIMEI(imei);
+  packet.allowedNumber[0] = '\0';
+  packet.status[0] = '\0';
+  packet.mcc[0] = packet.mnc[0] = packet.lac[0] = packet.cellID[0] = '\0';
+
+  for (int round = 0; round < rounds; round++) {
+    char work[256];
+    std::strcpy(work, kSeeds[random(4)]);
+    int mutations = 1 + random(6);
+    for (int idx = 0; idx < mutations; idx++) {
+      size_t length = std::strlen(work);
+      if (length == 0) break;
+      size_t pos = random(length);
+      char c = kAlphabet[random(sizeof(kAlphabet) - 1)];
+      switch (random(4)) {
+        case 0: work[pos] = c; break;
+        case 1: work[pos] = '\0'; break;
+        case 2:
+          if (length < sizeof(work) - 2) {
+            std::memmove(work + pos + 1, work + pos, length - pos + 1);
+            work[pos] = c;
+          }
+          break;
+        case 3:
+          // Long runs of digits, for the overflow checks
+          for (int n = random(30); n > 0 && std::strlen(work) < sizeof(work) - 2; n--) {
+            std::memmove(work + pos + 1, work + pos, std::strlen(work) - pos + 1);
+            work[pos] = '0' + random(10);
+          }
+          break;
+      }
+    }
+
+    // Exact size copy, so the sanitizer catches reads past the end
+    size_t length = std::strlen(work);
+    char *line = (char *)std::malloc(length + 1);
+    std::memcpy(line, work, length + 1);
+
+    GNSSFix fix;
+    bool parsed = fix.parse(line);
+    if (std::strlen(fix.datetime) >= sizeof(fix.datetime)) fail("datetime overrun", work);
+    if (fix.course >= 36000) fail("course out of range", work);
+
+    if (parsed && packet.update(fix)) {
+      char buf[200];
+      int size = packet.buildPacket(buf, sizeof(buf));
+      if (size < 0 || size >= (int)sizeof(buf) || size != (int)std::strlen(buf)) {
+        fail("sentence does not fit", work);
+      }
+
+      // The time field is what follows the date, never left over from an earlier fix
+      const char *time = std::strstr(buf, "GPRMC,");
+      if (time == NULL || std::strncmp(time + 6, fix.datetime + 8, std::strlen(fix.datetime + 8)) != 0 ||
+          time[6 + std::strlen(fix.datetime + 8)] != ',') {
+        fail("wrong time field", work);
+      }
+    }
+    std::free(line);
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1) seed = std::strtoul(argv[1], NULL, 0);
+
+  checkNumbers(200000);
+  checkMutations(500000);
+
+  std::printf("%s\n", failures ? "FAILED" : "OK");
+  return failures ? 1 : 0;
+}
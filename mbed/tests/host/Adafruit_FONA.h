@@ -0,0 +1,17 @@
+#ifndef ADAFRUIT_FONA_H
+#define ADAFRUIT_FONA_H
+
+#include <stdint.h>
+
+/*
+ * Host stand-in for the FONA driver, only what gpsdata.cpp calls. The
+ * tests feed TK102Packet through GNSSFix and updateBattery() instead.
+ */
+class Adafruit_FONA {
+public:
+  bool getBattVoltage(uint16_t *v) { *v = 0; return false; }
+  bool getBattPercent(uint16_t *p) { *p = 0; return false; }
+  uint8_t getGPS(uint8_t arg, char *buffer, uint8_t maxbuff) { buffer[0] = '\0'; return 0; }
+};
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef MBED_DIRHANDLE_H
+#define MBED_DIRHANDLE_H
+
+#include <limits.h>
+#include <sys/types.h>
+
+#include "FileHandle.h"
+
+struct dirent {
+  char d_name[NAME_MAX + 1];
+};
+
+namespace mbed {
+
+/* Host copy of the mbed DirHandle interface */
+class DirHandle {
+public:
+  virtual int closedir() = 0;
+  virtual struct dirent *readdir() = 0;
+  virtual void rewinddir() = 0;
+  virtual off_t telldir() { return -1; }
+  virtual void seekdir(off_t location) {}
+  virtual ~DirHandle() {}
+
+protected:
+  virtual void lock() {}
+  virtual void unlock() {}
+};
+
+} // namespace mbed
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef MBED_FILEHANDLE_H
+#define MBED_FILEHANDLE_H
+
+#include <stdio.h>
+#include <sys/types.h>
+
+namespace mbed {
+
+/* Host copy of the mbed FileHandle interface */
+class FileHandle {
+public:
+  virtual ssize_t write(const void *buffer, size_t length) = 0;
+  virtual int close() = 0;
+  virtual ssize_t read(void *buffer, size_t length) = 0;
+  virtual int isatty() = 0;
+  virtual off_t lseek(off_t offset, int whence) = 0;
+  virtual int fsync() = 0;
+  virtual off_t flen() = 0;
+  virtual ~FileHandle() {}
+
+protected:
+  virtual void lock() {}
+  virtual void unlock() {}
+};
+
+} // namespace mbed
+
+#endif
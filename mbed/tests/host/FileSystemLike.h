@@ -0,0 +1,42 @@
+#ifndef MBED_FILESYSTEMLIKE_H
+#define MBED_FILESYSTEMLIKE_H
+
+#include <fcntl.h>
+#include <sys/types.h>
+
+#include "platform.h"
+#include "FileHandle.h"
+#include "DirHandle.h"
+
+namespace mbed {
+
+/*
+ * Host copy of the mbed FileSystemLike interface. File systems register
+ * under their name like on the target, so fopen("/<name>/...") reaches
+ * them through retarget.cpp.
+ */
+class FileSystemLike {
+public:
+  FileSystemLike(const char *name);
+  virtual ~FileSystemLike();
+
+  const char *getName() { return _name; }
+
+  /// The file system mounted as name (len characters), 0 if none
+  static FileSystemLike *lookup(const char *name, unsigned int len);
+
+  virtual FileHandle *open(const char *filename, int flags) = 0;
+  virtual int remove(const char *filename) { return -1; }
+  virtual int rename(const char *oldname, const char *newname) { return -1; }
+  virtual DirHandle *opendir(const char *name) { return 0; }
+  virtual int mkdir(const char *name, mode_t mode) { return -1; }
+
+private:
+  static FileSystemLike *_head;
+  FileSystemLike *_next;
+  const char *_name;
+};
+
+} // namespace mbed
+
+#endif
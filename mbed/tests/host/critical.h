@@ -0,0 +1,8 @@
+#ifndef MBED_CRITICAL_H
+#define MBED_CRITICAL_H
+
+/* Host stand-in, the tests are single threaded */
+inline void core_util_critical_section_enter() {}
+inline void core_util_critical_section_exit() {}
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef MBED_H
+#define MBED_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Host stand-in for the mbed library, only what the FAT file system layer
+ * (fat/FATFileSystem.cpp and friends) uses. See retarget.cpp for stdio.
+ */
+#define error(...)  do { fprintf(stderr, __VA_ARGS__); exit(1); } while (0)
+
+#endif
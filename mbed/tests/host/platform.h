@@ -0,0 +1,17 @@
+#ifndef MBED_PLATFORM_H
+#define MBED_PLATFORM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Host stand-in, the tests are single threaded */
+class PlatformMutex {
+public:
+  void lock() {}
+  void unlock() {}
+};
+
+#endif
@@ -0,0 +1,111 @@
+/*
+ * Host stand-in for the mbed stdio retargeting. fopen() and remove() on
+ * "/<name>/<path>" go to the FileSystemLike registered as name, the way
+ * they reach SDFileSystem on the target, so code using stdio runs
+ * unchanged against a MemFileSystem. Other paths fail with ENOENT, the
+ * tests do not touch the host file system. Needs glibc (fopencookie).
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "FileSystemLike.h"
+
+using namespace mbed;
+
+FileSystemLike *FileSystemLike::_head = 0;
+
+FileSystemLike::FileSystemLike(const char *name) : _next(_head), _name(name) {
+  _head = this;
+}
+
+FileSystemLike::~FileSystemLike() {
+  for (FileSystemLike **link = &_head; *link; link = &(*link)->_next) {
+    if (*link == this) {
+      *link = _next;
+      break;
+    }
+  }
+}
+
+FileSystemLike *FileSystemLike::lookup(const char *name, unsigned int len) {
+  for (FileSystemLike *fs = _head; fs; fs = fs->_next) {
+    if (strlen(fs->_name) == len && strncmp(fs->_name, name, len) == 0) return fs;
+  }
+  return 0;
+}
+
+/* Split "/<name>/<path>" into the file system and the path on it */
+static FileSystemLike *resolve(const char *path, const char **rest) {
+  if (path[0] != '/') return 0;
+  const char *slash = strchr(path + 1, '/');
+  if (!slash) return 0;
+  *rest = slash + 1;
+  return FileSystemLike::lookup(path + 1, slash - path - 1);
+}
+
+/* stdio mode string to open() flags, as the mbed retarget layer does */
+static int openFlags(const char *mode) {
+  bool plus = strchr(mode, '+') != 0;
+  switch (mode[0]) {
+  case 'r': return plus ? O_RDWR : O_RDONLY;
+  case 'w': return (plus ? O_RDWR : O_WRONLY) | O_CREAT | O_TRUNC;
+  case 'a': return (plus ? O_RDWR : O_WRONLY) | O_CREAT | O_APPEND;
+  default:  return -1;
+  }
+}
+
+static ssize_t cookieRead(void *cookie, char *buffer, size_t size) {
+  return ((FileHandle *)cookie)->read(buffer, size);
+}
+
+static ssize_t cookieWrite(void *cookie, const char *buffer, size_t size) {
+  ssize_t n = ((FileHandle *)cookie)->write(buffer, size);
+  return (n < 0) ? 0 : n;     // 0 reports the error to stdio
+}
+
+static int cookieSeek(void *cookie, off64_t *offset, int whence) {
+  off_t position = ((FileHandle *)cookie)->lseek(*offset, whence);
+  if (position < 0) return -1;
+  *offset = position;
+  return 0;
+}
+
+static int cookieClose(void *cookie) {
+  return ((FileHandle *)cookie)->close();
+}
+
+extern "C" FILE *fopen(const char *path, const char *mode) {
+  const char *rest;
+  FileSystemLike *fs = resolve(path, &rest);
+  int flags = openFlags(mode);
+  if (!fs || flags < 0) {
+    errno = ENOENT;
+    return 0;
+  }
+
+  FileHandle *handle = fs->open(rest, flags);
+  if (!handle) {
+    errno = ENOENT;
+    return 0;
+  }
+
+  cookie_io_functions_t functions = { cookieRead, cookieWrite, cookieSeek, cookieClose };
+  FILE *file = fopencookie(handle, mode, functions);
+  if (!file) handle->close();
+  return file;
+}
+
+extern "C" int remove(const char *path) {
+  const char *rest;
+  FileSystemLike *fs = resolve(path, &rest);
+  if (!fs) {
+    errno = ENOENT;
+    return -1;
+  }
+  return fs->remove(rest);
+}
@@ -0,0 +1,18 @@
+#ifndef RTOS_H
+#define RTOS_H
+
+/*
+ * Host stand-in for the RTOS, the tests are single threaded. FatFs takes
+ * a Semaphore per volume (_FS_REENTRANT).
+ */
+class Semaphore {
+public:
+  Semaphore(int count) : _count(count) {}
+  int wait(int millisec) { return _count; }
+  void release() {}
+
+private:
+  int _count;
+};
+
+#endif
@@ -0,0 +1,231 @@
+/*
+ * PositionQueue on a FAT volume in RAM. Runs on the host:
+ *
+ *   g++ -std=gnu++98 -Itests/host -I. -Ifat -Ifat/ChaN -o posqueue_memfs tests/posqueue_memfs.cpp posqueue.cpp fat/FATFileSystem.cpp fat/FATFileHandle.cpp fat/FATDirHandle.cpp fat/SectorCache.cpp fat/ChaN/ff.cpp fat/ChaN/diskio.cpp fat/ChaN/syscall.cpp tests/host/retarget.cpp && ./posqueue_memfs
+ *
+ * (from this directory). The queue goes through stdio and FatFs exactly as
+ * on the SD card, tests/host/retarget.cpp routes "/mem/..." to the
+ * MemFileSystem. Covers push/pop, the ring wrapping, dropping the oldest
+ * report when full, corrupted records, reopening and failed writes.
+ */
+#include "posqueue.h"
+#include "MemFileSystem.h"
+
+#include <cstdio>
+#include <cstring>
+
+using namespace mbed;
+
+static const char *kPath = "/mem/queue.bin";
+static const uint32_t kCapacity = 4;
+static const long kHeaderSize = 32;   // PositionQueue::kHeaderSize
+
+static int failures = 0;
+
+static void check(bool condition, const char *what) {
+  if (!condition) {
+    printf("%s\n", what);
+    failures++;
+  }
+}
+
+/* Fails every sector transfer while broken is set */
+class FlakyFileSystem : public MemFileSystem {
+public:
+  FlakyFileSystem(const char *name) : MemFileSystem(name), broken(false) {}
+
+  virtual int disk_read(uint8_t *buffer, uint32_t sector, uint32_t count) {
+    return broken ? 1 : MemFileSystem::disk_read(buffer, sector, count);
+  }
+
+  virtual int disk_write(const uint8_t *buffer, uint32_t sector, uint32_t count) {
+    return broken ? 1 : MemFileSystem::disk_write(buffer, sector, count);
+  }
+
+  bool broken;
+};
+
+static bool pushReport(PositionQueue &queue, int number) {
+  char report[32];
+  int length = sprintf(report, "report %d\n", number);
+  return queue.push(report, length);
+}
+
+/* Read the whole queue and check it holds reports first..last in order */
+static bool holds(PositionQueue &queue, int first, int last) {
+  char batch[PositionQueue::kRecordSize * kCapacity];
+  char expected[PositionQueue::kRecordSize * kCapacity];
+  uint16_t length = 0;
+  for (int number = first; number <= last; number++) {
+    length += sprintf(expected + length, "report %d\n", number);
+  }
+
+  uint32_t count;
+  uint16_t used = queue.readBatch(batch, sizeof(batch), count);
+  return count == (uint32_t)(last - first + 1) && used == length && memcmp(batch, expected, length) == 0;
+}
+
+/* Overwrite bytes of a slot behind the queue's back */
+static void patchSlot(uint32_t slot, long offset, const char *data, size_t length) {
+  FILE *file = fopen(kPath, "r+b");
+  fseek(file, kHeaderSize + slot * PositionQueue::kRecordSize + offset, SEEK_SET);
+  fwrite(data, length, 1, file);
+  fclose(file);
+}
+
+static void testPushPop() {
+  PositionQueue queue(kPath, kCapacity);
+  check(queue.open() && queue.empty(), "new queue not empty");
+
+  uint32_t count;
+  char batch[PositionQueue::kMaxPayload];
+  check(queue.readBatch(batch, sizeof(batch), count) == 0 && count == 0, "read from empty queue");
+
+  check(pushReport(queue, 1) && pushReport(queue, 2) && pushReport(queue, 3), "push");
+  check(queue.size() == 3 && holds(queue, 1, 3), "pushed reports");
+
+  // A batch stops at the buffer size, the rest stays queued
+  uint16_t used = queue.readBatch(batch, 20, count);
+  check(count == 2 && used == 18 && memcmp(batch, "report 1\nreport 2\n", 18) == 0, "partial batch");
+
+  check(queue.pop(2) && queue.size() == 1 && holds(queue, 3, 3), "pop");
+  check(queue.pop(5) && queue.empty(), "pop more than queued");
+
+  check(!queue.push(batch, PositionQueue::kMaxPayload + 1), "oversized report accepted");
+  queue.close();
+  remove(kPath);
+}
+
+static void testWrap() {
+  PositionQueue queue(kPath, kCapacity);
+  queue.open();
+
+  // Keep two reports queued while head and tail go round the ring twice
+  int next = 1, first = 1;
+  for (int round = 0; round < 2 * (int)kCapacity; round++) {
+    pushReport(queue, next++);
+    if (queue.size() > 2) {
+      queue.pop(1);
+      first++;
+    }
+    check(holds(queue, first, next - 1), "reports lost at the wrap");
+  }
+  check(queue.getDropped() == 0, "dropped while not full");
+  queue.close();
+  remove(kPath);
+}
+
+static void testFull() {
+  PositionQueue queue(kPath, kCapacity);
+  queue.open();
+
+  for (int number = 1; number <= 6; number++) {
+    check(pushReport(queue, number), "push into full queue");
+  }
+  check(queue.size() == kCapacity && queue.getDropped() == 2, "full queue count");
+  check(holds(queue, 3, 6), "oldest reports not the ones dropped");
+  queue.close();
+  remove(kPath);
+}
+
+static void testCorruption() {
+  PositionQueue queue(kPath, kCapacity);
+  queue.open();
+  for (int number = 1; number <= 4; number++) pushReport(queue, number);
+  queue.close();
+
+  // A flipped payload byte in slot 1 and a garbage length in slot 2
+  patchSlot(1, 4, "X", 1);
+  patchSlot(2, 0, "\xff\xff", 2);
+
+  check(queue.open() && queue.size() == 4, "reopen after corruption");
+  char batch[PositionQueue::kRecordSize * kCapacity];
+  uint32_t count;
+  uint16_t used = queue.readBatch(batch, sizeof(batch), count);
+  check(count == 4, "corrupted records not consumed");
+  check(used == 18 && memcmp(batch, "report 1\nreport 4\n", 18) == 0, "corrupted records passed on");
+  check(queue.getCorrupted() == 2, "corrupted records not counted");
+  queue.close();
+  remove(kPath);
+}
+
+static void testReopen(MemFileSystem &fs) {
+  {
+    PositionQueue queue(kPath, kCapacity);
+    queue.open();
+    for (int number = 1; number <= 5; number++) pushReport(queue, number);
+    queue.pop(1);
+  }
+
+  // The index survives closing the file and remounting the volume
+  fs.unmount();
+  fs.mount();
+  {
+    PositionQueue queue(kPath, kCapacity);
+    check(queue.open() && queue.size() == 3 && holds(queue, 3, 5), "queue not restored on reopen");
+    check(pushReport(queue, 6) && holds(queue, 3, 6), "push after reopen");
+  }
+
+  // A file written with another capacity starts over
+  {
+    PositionQueue queue(kPath, 2 * kCapacity);
+    check(queue.open() && queue.empty(), "resized queue not reset");
+  }
+
+  // So does a foreign file
+  FILE *file = fopen(kPath, "wb");
+  fputs("not a queue", file);
+  fclose(file);
+  {
+    PositionQueue queue(kPath, kCapacity);
+    check(queue.open() && queue.empty() && pushReport(queue, 1) && holds(queue, 1, 1), "foreign file not reset");
+  }
+  remove(kPath);
+}
+
+static void testWriteFailure(FlakyFileSystem &fs) {
+  PositionQueue queue(kPath, kCapacity);
+  queue.open();
+  for (int number = 1; number <= 3; number++) pushReport(queue, number);
+  queue.close();
+  check(queue.open(), "reopen before the failure");
+
+  // Every sector transfer fails, the record or the header write with it
+  fs.broken = true;
+  check(!pushReport(queue, 4), "push on a failing card succeeded");
+  check(queue.size() == 3 && queue.getDropped() == 0, "index moved on a failed push");
+  check(!queue.pop(1) && queue.size() == 3, "index moved on a failed pop");
+  fs.broken = false;
+  queue.close();
+
+  check(queue.open() && queue.size() == 3 && holds(queue, 1, 3), "queue damaged by the failed push");
+  check(pushReport(queue, 4) && holds(queue, 1, 4), "push after the card recovered");
+
+  // Full: a failed push must not drop the oldest report either
+  fs.broken = true;
+  check(!pushReport(queue, 5), "push into a full queue on a failing card succeeded");
+  check(queue.size() == kCapacity && queue.getDropped() == 0, "oldest report dropped on a failed push");
+  fs.broken = false;
+  queue.close();
+  check(queue.open() && holds(queue, 1, 4), "full queue damaged by the failed push");
+  queue.close();
+  remove(kPath);
+}
+
+int main() {
+  FlakyFileSystem fs("mem");
+  if (fs.format() != 0 || fs.mount() != 0) {
+    printf("FAILED to create the volume\n");
+    return 1;
+  }
+
+  testPushPop();
+  testWrap();
+  testFull();
+  testCorruption();
+  testReopen(fs);
+  testWriteFailure(fs);
+
+  printf("%s\n", failures ? "FAILED" : "OK");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,147 @@
+/*
+ * Sector transfers with and without the SectorCache. Runs on the host:
+ *
+ *   g++ -std=gnu++98 -Itests/host -I. -Ifat -Ifat/ChaN -o sector_cache_bench tests/sector_cache_bench.cpp fat/FATFileSystem.cpp fat/FATFileHandle.cpp fat/FATDirHandle.cpp fat/SectorCache.cpp fat/ChaN/ff.cpp fat/ChaN/diskio.cpp fat/ChaN/syscall.cpp tests/host/retarget.cpp && ./sector_cache_bench
+ *
+ * (from this directory). Runs FatFs workloads on a MemFileSystem with
+ * several cache geometries and prints the reads and writes that reached
+ * the storage, with the cache counters. Every volume image left behind
+ * must be identical to the one written without the cache, otherwise the
+ * run FAILED.
+ *
+ *   directory  create, write and close 120 files in one directory, then
+ *              stat them all
+ *   append     a logger appending 48 byte records to one file and 20 byte
+ *              records to another, f_sync after each
+ */
+#include "MemFileSystem.h"
+#include "ff.h"
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+using namespace mbed;
+
+/* FAT timestamps come from time(), a fixed clock keeps the images comparable */
+extern "C" time_t time(time_t *t) {
+  if (t) *t = 1467331200;   // 2016-07-01
+  return 1467331200;
+}
+
+// One volume exists at a time, so it is always FatFs drive 0
+#define DRIVE "0:"
+
+static const int kSectors = 2000;   // MemFileSystem size
+
+static int failures = 0;
+
+static void check(bool condition, const char *what) {
+  if (!condition) {
+    printf("%s\n", what);
+    failures++;
+  }
+}
+
+static void directoryHeavy() {
+  char name[24], data[100];
+  memset(data, 'd', sizeof(data));
+  check(f_mkdir(DRIVE "/LOGS") == FR_OK, "mkdir failed");
+
+  for (int idx = 0; idx < 120; idx++) {
+    // FatFs writes the rest of a partial sector from the FIL buffer, keep
+    // it zeroed or the images pick up whatever was on the stack
+    FIL file;
+    UINT written;
+    memset(&file, 0, sizeof(file));
+    sprintf(name, DRIVE "/LOGS/F%03d.TXT", idx);
+    if (f_open(&file, name, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK) {
+      check(false, "create failed");
+      return;
+    }
+    f_write(&file, data, sizeof(data), &written);
+    check(written == sizeof(data) && f_close(&file) == FR_OK, "write failed");
+  }
+
+  for (int idx = 0; idx < 120; idx++) {
+    FILINFO info;
+    sprintf(name, DRIVE "/LOGS/F%03d.TXT", idx);
+    check(f_stat(name, &info) == FR_OK && info.fsize == sizeof(data), "stat failed");
+  }
+}
+
+static void appendHeavy() {
+  FIL track, events;
+  UINT written;
+  char record[48];
+  memset(&track, 0, sizeof(track));
+  memset(&events, 0, sizeof(events));
+  if (f_open(&track, DRIVE "/TRACK.BIN", FA_CREATE_ALWAYS | FA_WRITE) != FR_OK ||
+      f_open(&events, DRIVE "/EVENTS.LOG", FA_CREATE_ALWAYS | FA_WRITE) != FR_OK)
+  {
+    check(false, "create failed");
+    return;
+  }
+
+  for (int idx = 0; idx < 4000; idx++) {
+    memset(record, idx, sizeof(record));
+    f_write(&track, record, sizeof(record), &written);
+    check(f_sync(&track) == FR_OK, "sync failed");
+    if (idx % 4 == 0) {
+      f_write(&events, record, 20, &written);
+      check(f_sync(&events) == FR_OK, "sync failed");
+    }
+  }
+  f_close(&track);
+  f_close(&events);
+}
+
+struct Workload {
+  const char *name;
+  void (*run)();
+};
+
+/* Run a workload on a fresh volume and keep its final image */
+static void run(const Workload &workload, int sets, int ways, char *image) {
+  MemFileSystem *fs = new MemFileSystem("mem", sets, ways);
+  fs->format();
+  fs->mount();
+  fs->disk_sync();
+  fs->reads = fs->writes = 0;
+  fs->cache().reset_stats();
+
+  workload.run();
+  check(fs->unmount() == 0, "unmount failed");
+
+  printf("%-10s %dx%d  reads %5u  writes %5u  hits %5u  misses %5u  writebacks %5u\n",
+         workload.name, sets, ways, (unsigned)fs->reads, (unsigned)fs->writes,
+         (unsigned)fs->cache().hits(), (unsigned)fs->cache().misses(), (unsigned)fs->cache().writebacks());
+
+  for (int sector = 0; sector < kSectors; sector++) {
+    if (fs->sectors[sector]) memcpy(image + sector * 512, fs->sectors[sector], 512);
+    else memset(image + sector * 512, 0, 512);
+  }
+  delete fs;
+}
+
+int main() {
+  static const Workload workloads[] = {
+    { "directory", directoryHeavy },
+    { "append",    appendHeavy }
+  };
+  static const int geometries[][2] = { {1, 2}, {1, 4}, {2, 4}, {4, 4} };
+
+  static char reference[kSectors * 512];
+  static char image[kSectors * 512];
+
+  for (unsigned w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++) {
+    run(workloads[w], 0, 0, reference);
+    for (unsigned g = 0; g < sizeof(geometries) / sizeof(geometries[0]); g++) {
+      run(workloads[w], geometries[g][0], geometries[g][1], image);
+      check(memcmp(image, reference, sizeof(image)) == 0, "volume image differs from the one without the cache");
+    }
+  }
+
+  printf("%s\n", failures ? "FAILED" : "OK");
+  return failures ? 1 : 0;
+}
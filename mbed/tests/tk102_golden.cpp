@@ -0,0 +1,76 @@
+/*
+ * Golden TK102 sentences, byte for byte, for buildPacket() fed from
+ * GNSSFix integers. Runs on the host:
+ *
+ *   g++ -std=gnu++98 -Itests/host -I. -o tk102_golden tests/tk102_golden.cpp gpsdata.cpp && ./tk102_golden
+ *
+ * (from the mbed directory). Prints each mismatch and returns non-zero.
+ */
+#include "gpsdata.h"
+
+#include <cstdio>
+#include <cstring>
+
+struct GoldenCase {
+  const char *cgnsinf;      // payload after "+CGNSINF: "
+  uint16_t    millivolts;
+  uint16_t    percent;
+  const char *expected;
+};
+
+static const GoldenCase kCases[] = {
+  // Riga, the example in buildPacket()
+  { "1,1,20160711201120.000,56.958513,24.177697,12.400,3.70,67.76,1,,0.9,1.2,0.8,,11,9,,,42,,",
+    4240, 80,
+    "160711201120,,GPRMC,201120.000,A,5657.5108,N,02410.6618,E,2.0,67.8,110716,,,A*56,"
+    "F,,imei:123456789012345,9,12.4,F:4.24V,0,121,2633,,,," },
+  // Southern and western hemisphere, negative altitude
+  { "1,1,20161002120301.000,-33.868820,-151.209296,-5.123,123.456,359.994,1,,1.25,2.5,0.80,,17,12,4,,45,3.2,5.1",
+    3705, 20,
+    "161002120301,,GPRMC,120301.000,A,3352.1292,S,15112.5578,W,66.7,360.0,021016,,,A*50,"
+    "F,,imei:123456789012345,12,-5.1,L:3.71V,0,124,54137,,,," },
+  // Last known position, minutes at their largest, altitude just below zero
+  { "1,0,20170101000000.000,0.999999,-0.000001,-0.010,0.00,0.00,1,,,,,,3,0,,,20,,",
+    4200, 100,
+    "170101000000,,GPRMC,000000.000,A,0059.9999,N,00000.0001,W,0.0,0.0,010117,,,A*77,"
+    "L,,imei:123456789012345,0,-0.0,F:4.20V,0,120,30244,,,," },
+  // Half way cases round up: course 0.05, altitude 0.05 m, battery 5 mV
+  { "1,1,20160229235959.500,89.000025,179.999925,8848.050,0.93,0.05,1,,,,,,20,15,,,50,,",
+    4995, 26,
+    "160229235959,,GPRMC,235959.500,A,8900.0015,N,17959.9955,E,0.5,0.1,290216,,,A*66,"
+    "F,,imei:123456789012345,15,8848.1,F:5.00V,0,123,40513,,,," },
+};
+
+int main() {
+  char imei[] = "123456789012345";
+  int failures = 0;
+
+  for (unsigned idx = 0; idx < sizeof(kCases) / sizeof(kCases[0]); idx++) {
+    const GoldenCase &test = kCases[idx];
+
+    GNSSFix fix;
+    if (!fix.parse(test.cgnsinf)) {
+      std::printf("case %u: parse failed\n", idx);
+      failures++;
+      continue;
+    }
+
+    TK102Packet packet;
+    packet.allowedNumber[0] = '\0';
+    packet.status[0] = '\0';
+    packet.mcc[0] = packet.mnc[0] = packet.lac[0] = packet.cellID[0] = '\0';
+    packet.setIMEI(imei);
+    packet.updateBattery(test.millivolts, test.percent);
+    packet.update(fix);
+
+    char buf[200];
+    int length = packet.buildPacket(buf, sizeof(buf));
+    if (length != (int)strlen(test.expected) || 0 != strcmp(buf, test.expected)) {
+      std::printf("case %u:\n  got      %s\n  expected %s\n", idx, buf, test.expected);
+      failures++;
+    }
+  }
+
+  std::printf("%s\n", failures ? "FAILED" : "OK");
+  return failures ? 1 : 0;
+}
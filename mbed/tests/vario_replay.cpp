@@ -0,0 +1,121 @@
+/*
+ * Replay of a synthetic flight through the Variometer. Runs on the host:
+ *
+ *   g++ -std=gnu++98 -I. -o vario_replay tests/vario_replay.cpp vario.cpp && ./vario_replay
+ *
+ * (from the mbed directory). The track hovers at 500 m, then accelerates at
+ * 2 m/s^2 for 0.5 s into a steady 1 m/s climb, sampled at 100 Hz like
+ * varioTask. Barometric altitude has 0.12 m of noise (OSR4096 plus some
+ * turbulence), the accelerometer 0.3 m/s^2 of noise and a 0.15 m/s^2 bias.
+ * The estimate has to stay quiet while hovering, cross 0.5 m/s soon after
+ * the truth does (0.25 s into the step) and settle on the climb rate, with
+ * and without the accelerometer.
+ */
+#include "vario.h"
+
+#include <cmath>
+#include <cstdio>
+
+// Deterministic Gaussian noise: LCG with the Box-Muller transform
+class Noise {
+public:
+  Noise(uint32_t seed) : _state(seed), _haveSpare(false), _spare(0) {}
+
+  float next() {
+    if (_haveSpare) {
+      _haveSpare = false;
+      return _spare;
+    }
+    double u1 = (uniform() + 1.0) / 4294967297.0;
+    double u2 = uniform() / 4294967296.0;
+    double radius = std::sqrt(-2.0 * std::log(u1));
+    _spare = (float)(radius * std::sin(2 * M_PI * u2));
+    _haveSpare = true;
+    return (float)(radius * std::cos(2 * M_PI * u2));
+  }
+
+private:
+  uint32_t _state;
+  bool _haveSpare;
+  float _spare;
+
+  double uniform() {
+    _state = _state * 1664525u + 1013904223u;
+    return _state;
+  }
+};
+
+static float altitudeToPressure(double altitude) {
+  return (float)(101325.0 * std::pow(1 - altitude / 44330.77, 1 / 0.190263));
+}
+
+struct ReplayLimits {
+  bool  accelerometer;
+  float noiseRMS;           // m/s while hovering
+  float crossing;           // s after the step starts
+  float settledError;       // m/s during the last 5 s
+};
+
+static const ReplayLimits kLimits[] = {
+  { true,  0.08f, 0.45f, 0.08f },
+  { false, 0.10f, 1.00f, 0.08f },
+};
+
+static int replay(const ReplayLimits &limits) {
+  const double dt = 0.01;
+  const double stepTime = 10;
+  Noise noise(1);
+  Variometer vario;
+  double altitude = 500, speed = 0;
+  vario.reset(altitudeToPressure(altitude));
+
+  double quiet = 0, settled = 0;
+  int nQuiet = 0, nSettled = 0;
+  float crossing = -1;
+  for (int idx = 0; idx < 3000; idx++) {
+    double t = idx * dt;
+    double accel = (t >= stepTime && t < stepTime + 0.5) ? 2.0 : 0;
+    speed += accel * dt;
+    altitude += speed * dt;
+
+    if (limits.accelerometer) {
+      float z = 9.80665f + (float)accel + 0.3f * noise.next() + 0.15f;
+      vario.setAcceleration(0.3f, -0.2f, z);
+    }
+    vario.update(altitudeToPressure(altitude + 0.12f * noise.next()), (float)dt);
+
+    float estimate = vario.getVerticalSpeed();
+    if (t > 3 && t < stepTime) {
+      quiet += estimate * estimate;
+      nQuiet++;
+    }
+    if (t >= stepTime && crossing < 0 && estimate > 0.5f) {
+      crossing = (float)(t - stepTime);
+    }
+    if (t >= 25) {
+      settled += (estimate - speed) * (estimate - speed);
+      nSettled++;
+    }
+  }
+
+  float quietRMS = (float)std::sqrt(quiet / nQuiet);
+  float settledRMS = (float)std::sqrt(settled / nSettled);
+  const char *name = limits.accelerometer ? "baro+accel" : "baro only";
+  std::printf("%s: noise %.3f m/s, 0.5 m/s after %.2f s, settled error %.3f m/s\n",
+              name, quietRMS, crossing, settledRMS);
+
+  int failures = 0;
+  if (quietRMS > limits.noiseRMS) failures++;
+  if (crossing < 0 || crossing > limits.crossing) failures++;
+  if (settledRMS > limits.settledError) failures++;
+  return failures;
+}
+
+int main() {
+  int failures = 0;
+  for (unsigned idx = 0; idx < sizeof(kLimits) / sizeof(kLimits[0]); idx++) {
+    failures += replay(kLimits[idx]);
+  }
+  std::printf("%s\n", failures ? "FAILED" : "OK");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,90 @@
+#include "uplink.h"
+#include "rtos.h"
+
+#include <cstring>
+
+UplinkSession::UplinkSession(Adafruit_FONA &fona, const char *server, uint16_t port, bool quickSend)
+  : _fona(fona), _server(server), _port(port), _quickSend(quickSend), _connected(false),
+    _sessionBytes(0), _transmitted(0)
+{
+  memset(&_counters, 0, sizeof(_counters));
+  _timer.start();
+}
+
+bool UplinkSession::connect() {
+  if (_connected) return true;
+
+  _fona.TCPquickSend(_quickSend);
+  _connected = _fona.TCPconnect((char *)_server, _port);
+  if (_connected) {
+    _counters.connects++;
+    _sessionBytes = 0;
+  }
+  return _connected;
+}
+
+void UplinkSession::close() {
+  if (_connected) {
+    _fona.TCPclose();
+    _connected = false;
+  }
+}
+
+bool UplinkSession::sendLine(const char *data, uint16_t length) {
+  if (length > kMaxLineLength) return false;
+
+  // Payload and terminator go out in one CIPSEND
+  memcpy(_buffer, data, length);
+  _buffer[length++] = '\n';
+
+  return send(_buffer, length);
+}
+
+bool UplinkSession::send(const char *data, uint16_t length) {
+  if (length > kMaxLineLength + 1) return false;
+  if (!connect()) return false;
+
+  int start = _timer.read_ms();
+  bool success = _fona.TCPsend((char *)data, length);
+  uint16_t latency = _timer.read_ms() - start;
+
+  if (!success) {
+    _counters.failures++;
+    // The socket may have been closed by the server or the network
+    _connected = _fona.TCPconnected();
+    return false;
+  }
+
+  _counters.packets++;
+  _counters.bytes += length;
+  _sessionBytes += length;
+  _counters.lastLatencyMs = latency;
+  _counters.totalLatencyMs += latency;
+  if (latency > _counters.maxLatencyMs) {
+    _counters.maxLatencyMs = latency;
+  }
+  return true;
+}
+
+bool UplinkSession::updateInFlight() {
+  if (!_connected) return false;
+
+  uint16_t sent, unacked;
+  if (!_fona.TCPunacked(&sent, &unacked)) return false;
+  _transmitted = sent;
+  _counters.bytesInFlight = unacked;
+  return true;
+}
+
+bool UplinkSession::waitAcknowledged(uint32_t timeoutMs) {
+  int start = _timer.read_ms();
+
+  while (updateInFlight()) {
+    // txlen only counts what the module has put on the air, in quick send
+    // mode part of the data may still wait in its buffer
+    if (_transmitted == _sessionBytes && _counters.bytesInFlight == 0) return true;
+    if ((uint32_t)(_timer.read_ms() - start) >= timeoutMs) return false;
+    Thread::wait(kAckPollMs);
+  }
+  return false;
+}
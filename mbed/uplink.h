@@ -0,0 +1,75 @@
+#ifndef UPLINK_H
+#define UPLINK_H
+
+#include <stdint.h>
+
+#include "mbed.h"
+#include "Adafruit_FONA.h"
+
+/**
+ * Persistent TCP session to the tracking server.
+ *
+ * The socket is opened once and kept; it is only re-checked and reconnected
+ * after a failed send. Each line is sent with its terminator in one CIPSEND,
+ * and in quick send mode the module returns as soon as the data is buffered
+ * instead of waiting for the server acknowledgement.
+ */
+class UplinkSession {
+public:
+  enum {
+    kMaxLineLength = 512,     // one CIPSEND, well below the 1460 byte limit
+    kAckPollMs     = 200      // between acknowledgement queries
+  };
+
+  UplinkSession(Adafruit_FONA &fona, const char *server, uint16_t port, bool quickSend = true);
+
+  /// Open the socket if it is not open yet
+  bool connect();
+
+  /// Drop the socket (it will be reopened by the next connect/sendLine)
+  void close();
+
+  bool isConnected() { return _connected; }
+
+  /// Send data followed by '\n' in a single TCP send
+  bool sendLine(const char *data, uint16_t length);
+
+  /// Send data as is (already terminated lines, e.g. a batch from the backlog)
+  bool send(const char *data, uint16_t length);
+
+  /// Query the module for bytes sent but not yet acknowledged by the server
+  bool updateInFlight();
+
+  /**
+   * Wait until the server has acknowledged everything sent on this socket,
+   * polling the module. False on timeout or a failed query.
+   */
+  bool waitAcknowledged(uint32_t timeoutMs);
+
+  struct Counters {
+    uint32_t connects;        // successful socket opens
+    uint32_t packets;         // successful sends
+    uint32_t failures;        // failed sends
+    uint32_t bytes;           // payload bytes sent, terminators included
+    uint16_t bytesInFlight;   // as of the last updateInFlight()
+    uint16_t lastLatencyMs;   // CIPSEND to DATA ACCEPT / SEND OK
+    uint16_t maxLatencyMs;
+    uint32_t totalLatencyMs;  // divide by packets for the average
+  };
+
+  const Counters & getCounters() { return _counters; }
+
+private:
+  Adafruit_FONA & _fona;
+  const char *    _server;
+  uint16_t        _port;
+  bool            _quickSend;
+  bool            _connected;
+  Counters        _counters;
+  uint16_t        _sessionBytes;  // sent since connect, wraps like +CIPACK txlen
+  uint16_t        _transmitted;   // txlen as of the last updateInFlight()
+  Timer           _timer;
+  char            _buffer[kMaxLineLength + 1];
+};
+
+#endif
@@ -1,110 +1,100 @@
 #include "vario.h"
 
+#include <math.h>
 
-Variometer::Variometer() {
-    pFilt = 0;
-    lastPressure = 0;
-    dpFilt = 0;
+// Measurement noise of the barometric altitude (m^2), includes turbulence
+static const float kAltitudeVariance = 0.3f * 0.3f;
+// Process noise: unmodelled acceleration with and without an accelerometer (m/s^2)^2
+static const float kAccelVariance = 0.5f * 0.5f;
+static const float kManeuverVariance = 3.0f * 3.0f;
+// Accelerometer bias drift ((m/s^2)^2 per second)
+static const float kBiasVariance = 0.05f * 0.05f;
+// Gravity low-pass coefficient per accelerometer sample (~1 s at 100 Hz)
+static const float kGravityFilter = 0.01f;
 
-    dpPerMeter = 12.0f;
-    baroAvgTime = 0.400f;
-    climbAvgTime = 0.400f;  
+Variometer::Variometer() {
+  reset(101325.0f);
 }
 
 void Variometer::reset(float pressure) {
-  pFilt = lastPressure = pressure;
-  dpFilt = 0;
+  _h = pressureToAltitude(pressure);
+  _v = 0;
+  _b = 0;
+  _accel = 0;
+  _haveAccel = false;
+
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) _P[i][j] = 0;
+  }
+  _P[0][0] = kAltitudeVariance;
+  _P[1][1] = 1.0f;
+  _P[2][2] = 0.25f;
 }
 
-void Variometer::update(float pressure, float dt) {
-  pFilt += (dt / baroAvgTime) * ((float)pressure - pFilt);
+float Variometer::pressureToAltitude(float pressure) {
+  return 44330.77f * (1.0f - powf(pressure * (1.0f / 101325.0f), 0.190263f));
+}
 
-  float dp = (pFilt - lastPressure) / dt;
-  dpFilt += (dt / climbAvgTime) * (dp - dpFilt); 
+void Variometer::setAcceleration(float x, float y, float z) {
+  if (!_haveAccel) {
+    _gravity[0] = x;
+    _gravity[1] = y;
+    _gravity[2] = z;
+    _haveAccel = true;
+  }
+  else {
+    _gravity[0] += kGravityFilter * (x - _gravity[0]);
+    _gravity[1] += kGravityFilter * (y - _gravity[1]);
+    _gravity[2] += kGravityFilter * (z - _gravity[2]);
+  }
 
-  lastPressure = pFilt;
+  float g = sqrtf(_gravity[0] * _gravity[0] + _gravity[1] * _gravity[1] + _gravity[2] * _gravity[2]);
+  if (g < 1.0f) return;   // free fall or garbage
+  _accel = (x * _gravity[0] + y * _gravity[1] + z * _gravity[2]) / g - g;
 }
 
+void Variometer::update(float pressure, float dt) {
+  // Predict: h += v dt + (a - b) dt^2 / 2, v += (a - b) dt
+  float dt2 = dt * dt;
+  float a = _haveAccel ? _accel - _b : 0;
+  _h += _v * dt + 0.5f * a * dt2;
+  _v += a * dt;
 
-void varioMeasure(void const *argument) {
-  static float lastPressure = 0;
-  const float dt = 0.020;
-  
-  if (barometer.update())
-  {
-    float pressure = barometer.getPressure();
-    vario.update(pressure, dt);
-    lastPressure = pressure;
+  // P = F P F' + Q, F = [1 dt -dt^2/2; 0 1 -dt; 0 0 1]
+  float c = _haveAccel ? -0.5f * dt2 : 0;
+  float d = _haveAccel ? -dt : 0;
+  float FP[3][3];
+  for (int j = 0; j < 3; j++) {
+    FP[0][j] = _P[0][j] + dt * _P[1][j] + c * _P[2][j];
+    FP[1][j] = _P[1][j] + d * _P[2][j];
+    FP[2][j] = _P[2][j];
+  }
+  for (int i = 0; i < 3; i++) {
+    _P[i][0] = FP[i][0] + dt * FP[i][1] + c * FP[i][2];
+    _P[i][1] = FP[i][1] + d * FP[i][2];
+    _P[i][2] = FP[i][2];
   }
-  else vario.update(lastPressure, dt);
-}
-
-float climbThreshold = 0.10f;
-float sinkThreshold = -0.10f;
 
-void varioTask(void const *argument) {    
-    //sensorBus.frequency(100000);
-    if (barometer.reset()) {
-      dbg.printf("Barometer reset!\n");
-    }
-    else {
-      dbg.printf("Barometer not found!\n");
-    }
-    Thread::wait(50);
-    
-    if (!barometer.initialize()) {
-      dbg.printf("Failed to initialize!\n");
-    }
-    
-    // Calculate initial pressure by averaging measurements
-    int idx = 0;
-    float avgPressure = 0;
-    while (idx < 50) {
-      if (barometer.update()) {
-        avgPressure += barometer.getPressure();
-        idx++;
-      }
-    }
-    avgPressure /= idx;
-    vario.reset(avgPressure);
+  // Random acceleration enters through G = [dt^2/2 dt 0]
+  float q = _haveAccel ? kAccelVariance : kManeuverVariance;
+  float g0 = 0.5f * dt2, g1 = dt;
+  _P[0][0] += g0 * g0 * q;
+  _P[0][1] += g0 * g1 * q;
+  _P[1][0] += g0 * g1 * q;
+  _P[1][1] += g1 * g1 * q;
+  _P[2][2] += kBiasVariance * dt;
 
-    // Start vario update timer
-    RtosTimer measureTimer(varioMeasure, osTimerPeriodic, NULL);  
-    measureTimer.start(20);
+  // Correct with the barometric altitude, H = [1 0 0]
+  float y = pressureToAltitude(pressure) - _h;
+  float s = _P[0][0] + kAltitudeVariance;
+  float k[3] = { _P[0][0] / s, _P[1][0] / s, _P[2][0] / s };
+  _h += k[0] * y;
+  _v += k[1] * y;
+  _b += k[2] * y;
 
-    // Keep checking vertical speed
-    idx = 0;
-    int period = 10;
-    bool phase = false;
-    while (true) {
-      if (idx >= period) {
-        //if (fabsf(vertSpeed) > 0.1f) {
-        //  dbg.printf("Vertical speed: % .1f\tPressure: %.0f\n", vertSpeed, pFilt);
-        //}
-        
-        float vertSpeed = vario.getVerticalSpeed();
-        if (vertSpeed > climbThreshold) {
-          float frequency = 440 + 220 * vertSpeed;
-          buzzer.period(1.0f / frequency);
-          period = 20 - 7 * vertSpeed;
-          if (period < 3) period = 3;
-          buzzer = phase ? 0.5f : 0;
-        }
-        else if (vertSpeed < sinkThreshold) {
-          //float frequency = 440 + 220 * vertSpeed;
-          //buzzer.period(1.0f / frequency);
-          //buzzer = 0.5f;
-          buzzer = 0;
-        }
-        else {
-          buzzer = 0;
-        }
-        
-        phase = !phase;
-        idx = 0;
-      }
-        
-      idx++;
-      Thread::wait(15);
-    }
+  float row[3] = { _P[0][0], _P[0][1], _P[0][2] };
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) _P[i][j] -= k[i] * row[j];
+  }
 }
+
@@ -1,23 +1,51 @@
+#ifndef VARIO_H
+#define VARIO_H
+
 #include <stdint.h>
 
+/**
+ * Vertical state estimator: a Kalman filter over altitude, vertical speed
+ * and accelerometer bias. Barometric altitude is the measurement, the
+ * vertical acceleration (when an accelerometer is fed in) drives the
+ * prediction. Without acceleration the model is constant speed with
+ * random accelerations, which still reacts much faster than low-pass
+ * filtering the pressure.
+ */
 class Variometer {
 public:
   Variometer();
   
+  /// Start at rest at the given pressure (Pa)
   void reset(float pressure);
 
+  /**
+   * Accelerometer sample in m/s^2, any fixed orientation. Gravity is
+   * tracked with a slow low-pass filter and the projection onto it is
+   * used as vertical acceleration in the following updates.
+   */
+  void setAcceleration(float x, float y, float z);
+
+  /// Predict dt seconds ahead and correct with the measured pressure (Pa)
   void update(float pressure, float dt);
   
-  float getVerticalSpeed() {
-    return -dpFilt / dpPerMeter;
-  }
+  /// m/s, up positive
+  float getVerticalSpeed() { return _v; }
 
-private:
-    float pFilt = 0;
-    float lastPressure = 0;
-    float dpFilt = 0;
+  /// m above the 1013.25 hPa level (ISA)
+  float getAltitude() { return _h; }
+
+  /// m/s^2, estimated accelerometer offset along the vertical
+  float getAccelBias() { return _b; }
 
-    float dpPerMeter = 12.0f;
-    float baroAvgTime = 0.400f;
-    float climbAvgTime = 0.400f;
+  /// ISA altitude in m for a pressure in Pa
+  static float pressureToAltitude(float pressure);
+
+private:
+  float _h, _v, _b;       // state
+  float _P[3][3];         // state covariance
+  float _accel;           // vertical acceleration input
+  float _gravity[3];      // low-pass filtered accelerometer
+  bool  _haveAccel;
 };
+
+#endif